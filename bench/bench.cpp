@@ -0,0 +1,336 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <span>
+#include <random>
+#include <ctime>
+#include "harness.h"
+#include "ime.h"
+#include "print_exception.h"
+
+namespace {
+
+using namespace pinyin_ime;
+using namespace pinyin_ime::bench;
+
+// 典型输入：常见词语与短句的全拼、简拼
+constexpr std::string_view s_typical[]{
+    "nihao", "zhongguo", "woxiangqubeijing", "shurufa", "jintiantianqihenhao", "zg", "bjdx", "srf"
+};
+// 同一组词语的简拼（含 zh/ch/sh 声母与全拼、简拼混合）与全拼，用于比较两者的查询耗时
+constexpr std::string_view s_jianpin[]{
+    "bjdx", "zhrmghg", "srf", "zhongh", "zhg", "chqd", "shji", "xsh"
+};
+constexpr std::string_view s_full_pinyin[]{
+    "beijingdaxue", "zhonghuarenmingongheguo", "shurufa", "zhonghua", "zhongguo", "chongqingda", "shiji", "xuesheng"
+};
+// 对抗输入：大量可能的切分方式、连续声母与无效字符。
+// 切分方式的数量随长度指数增长，更长的 "nana..." 在 PinYin 中耗时与内存都难以接受
+constexpr std::string_view s_adversarial[]{
+    "xianxianxianxianxian",
+    "nananananananana",
+    "fangangenangenangan",
+    "zhzhzhzhzhzhzhzhzhzhzhzhzhzhzh",
+    "vvvvvvvvvvvvvvvvvvvvvvvvvvvvvv"
+};
+
+void print_usage(const char *name)
+{
+    std::cerr << "Usage: " << name
+              << " [-f <filter>] [-t <min time ms>] [-r <repetitions>] [-j <json output>] [-c <baseline json>] [dict]\n"
+              << "    dict defaults to " << BENCH_DEFAULT_DICT << std::endl;
+}
+
+void add_trie_benchmarks(Runner &runner, std::shared_ptr<const Engine::Snapshot> snapshot)
+{
+    static constexpr std::string_view s_acronyms[]{ "n", "nh", "zg", "wxqbj", "srf", "jttqhh", "zzzzzz", "bjdx" };
+    runner.add("trie/match", [snapshot](State &state) {
+        auto &trie{ *snapshot->m_system_trie };
+        for (size_t i{ 0 }; i < state.iterations(); ++i)
+            do_not_optimize(trie.match(s_acronyms[i % std::size(s_acronyms)]));
+    });
+    runner.add("trie/data", [snapshot](State &state) {
+        static constexpr std::string_view s_existing[]{ "n", "nh", "zg", "bjdx" };
+        auto &trie{ *snapshot->m_system_trie };
+        for (size_t i{ 0 }; i < state.iterations(); ++i)
+            do_not_optimize(&trie.data(s_existing[i % std::size(s_existing)]));
+    });
+    runner.add("trie/match_syllable", [](State &state) {
+        static constexpr std::string_view s_syllables[]{ "zhuang", "xian", "n", "ang", "shu", "q", "lve", "abc" };
+        auto &trie{ PinYin::syllableTrie() };
+        for (size_t i{ 0 }; i < state.iterations(); ++i)
+            do_not_optimize(trie.match(s_syllables[i % std::size(s_syllables)]));
+    });
+}
+
+void add_pinyin_benchmarks(Runner &runner)
+{
+    auto push_back_whole{ [](std::span<const std::string_view> inputs) {
+        return [inputs](State &state) {
+            PinYin pinyin;
+            for (size_t i{ 0 }; i < state.iterations(); ++i) {
+                pinyin.clear();
+                do_not_optimize(pinyin.push_back(inputs[i % inputs.size()]).size());
+            }
+        };
+    } };
+    // 逐个字母输入，每次 push_back 都重新切分未固定的部分
+    auto push_back_chars{ [](std::span<const std::string_view> inputs) {
+        return [inputs](State &state) {
+            PinYin pinyin;
+            for (size_t i{ 0 }; i < state.iterations(); ++i) {
+                pinyin.clear();
+                for (char ch : inputs[i % inputs.size()])
+                    do_not_optimize(pinyin.push_back(ch).size());
+            }
+        };
+    } };
+    runner.add("pinyin/push_back/typical", push_back_whole(s_typical));
+    runner.add("pinyin/push_back/adversarial", push_back_whole(s_adversarial));
+    runner.add("pinyin/push_back_chars/typical", push_back_chars(s_typical));
+    runner.add("pinyin/push_back_chars/adversarial", push_back_chars(s_adversarial));
+}
+
+void add_dict_benchmarks(Runner &runner, std::shared_ptr<const Engine::Snapshot> snapshot)
+{
+    // PinYin 不可移动，以 shared_ptr 保存在测试体中，Token 视图随之有效
+    auto dict_search{ [snapshot](std::string_view input, std::string_view acronym) {
+        auto pinyin{ std::make_shared<PinYin>() };
+        pinyin->push_back(input);
+        const Dict *dict{ &snapshot->m_system_trie->data(acronym) };
+        return [snapshot, pinyin, dict](State &state) {
+            auto tokens{ pinyin->tokens() };
+            for (size_t i{ 0 }; i < state.iterations(); ++i)
+                do_not_optimize(dict->search(tokens).size());
+        };
+    } };
+    runner.add("dict/search/full", dict_search("zhongguo", "zg"));
+    runner.add("dict/search/initials", dict_search("zg", "zg"));
+    runner.add("dict/search/single", dict_search("shi", "s"));
+    runner.add("dict/search/mixed", dict_search("zhongh", "zh"));
+    runner.add("dict/search/zh_initial", dict_search("zhg", "zg"));
+
+    runner.add("dict/auto_inc_freq", [snapshot](State &state) {
+        state.pause();
+        // 修改副本，首次修改时的拷贝（copy-on-write）不计入
+        Dict dict{ snapshot->m_system_trie->data("zg") };
+        size_t first{ 0 };
+        dict.auto_inc_freq(std::span{ &first, 1 });
+        state.resume();
+        for (size_t i{ 0 }; i < state.iterations(); ++i) {
+            size_t index{ (i * 7) % dict.size() };
+            dict.auto_inc_freq(std::span{ &index, 1 });
+        }
+    });
+}
+
+void add_ime_benchmarks(Runner &runner, std::shared_ptr<Engine> engine, std::string dict_file,
+                        std::filesystem::path temp_dir)
+{
+    // 以下测试各自使用独立的 IME，共用 engine，不学习
+    runner.add("ime/search/typical", [engine](State &state) {
+        IME ime{ engine };
+        for (size_t i{ 0 }; i < state.iterations(); ++i) {
+            ime.reset_search();
+            do_not_optimize(ime.search(s_typical[i % std::size(s_typical)]).size());
+        }
+    });
+    runner.add("ime/search/adversarial", [engine](State &state) {
+        IME ime{ engine };
+        for (size_t i{ 0 }; i < state.iterations(); ++i) {
+            ime.reset_search();
+            do_not_optimize(ime.search(s_adversarial[i % std::size(s_adversarial)]).size());
+        }
+    });
+    auto search_each{ [engine](std::span<const std::string_view> inputs) {
+        return [engine, inputs](State &state) {
+            IME ime{ engine };
+            for (size_t i{ 0 }; i < state.iterations(); ++i) {
+                ime.reset_search();
+                do_not_optimize(ime.search(inputs[i % inputs.size()]).size());
+            }
+        };
+    } };
+    runner.add("ime/search/jianpin", search_each(s_jianpin));
+    runner.add("ime/search/full_pinyin", search_each(s_full_pinyin));
+    // 逐个字母输入，沿用上次的查询结果
+    runner.add("ime/search/incremental", [engine](State &state) {
+        IME ime{ engine };
+        std::string_view input{ "woxiangqubeijing" };
+        for (size_t i{ 0 }; i < state.iterations(); ++i) {
+            ime.reset_search();
+            for (size_t k{ 1 }; k <= input.size(); ++k)
+                do_not_optimize(ime.search(input.substr(0, k)).size());
+        }
+    });
+    runner.add("ime/choose", [engine](State &state) {
+        IME ime{ engine };
+        for (size_t i{ 0 }; i < state.iterations(); ++i) {
+            state.pause();
+            ime.reset_search();
+            ime.search("woxiangqubeijing");
+            state.resume();
+            do_not_optimize(ime.choose(0).size());
+        }
+    });
+    // 选择候选词固定前面的 Token 后，再逐个字母输入有多种切分方式的音节（回归输入：
+    // 曾经在固定字母之后恢复切分时越过字符串末尾）
+    runner.add("ime/choose_then_type", [engine](State &state) {
+        IME ime{ engine };
+        for (size_t i{ 0 }; i < state.iterations(); ++i) {
+            ime.reset_search();
+            ime.search("wo");
+            ime.choose(0);
+            for (char ch : std::string_view{ "xian" })
+                ime.push_back(std::string_view{ &ch, 1 });
+            do_not_optimize(ime.candidates().size());
+        }
+    });
+    auto text_file{ (temp_dir / "bench_dict.txt").string() };
+    auto compiled_file{ (temp_dir / "bench_dict.dict").string() };
+    engine->save(text_file);
+    engine->save_compiled(compiled_file);
+
+    // 会学习的测试每次运行使用自己的 Engine，不修改其它测试共用的 Engine 的用户词库。
+    // finish_search() 只将学习事件加入队列：不等待时，后台线程应用学习结果的分配不计入，
+    // 并在计时之外等待其完成，使其不与之后的计时重叠；等待时计入后台线程的全部工作
+    auto finish_search{ [compiled_file](bool flush) {
+        return [compiled_file, flush](State &state) {
+            state.pause();
+            IME ime{ std::make_shared<Engine>(compiled_file) };
+            for (size_t i{ 0 }; i < state.iterations(); ++i) {
+                ime.search("woxiangqubeijing");
+                while (!ime.unfixed_tokens().empty() && !ime.candidates().empty())
+                    ime.choose(0);
+                state.resume();
+                ime.finish_search(true, true);
+                if (flush)
+                    ime.flush();
+                state.pause();
+                if (!flush)
+                    ime.flush();
+            }
+        };
+    } };
+    runner.add("ime/finish_search", finish_search(false), AllocScope::Thread);
+    runner.add("ime/finish_search+flush", finish_search(true));
+
+    auto load{ [](std::string file) {
+        return [file](State &state) {
+            for (size_t i{ 0 }; i < state.iterations(); ++i) {
+                auto ime{ std::make_unique<IME>() };
+                ime->load(file);
+                state.pause();
+                ime.reset();
+                state.resume();
+            }
+        };
+    } };
+    runner.add("ime/load/text", load(dict_file));
+    runner.add("ime/load/compiled", load(compiled_file));
+    runner.add("ime/save/text", [engine, text_file](State &state) {
+        IME ime{ engine };
+        for (size_t i{ 0 }; i < state.iterations(); ++i)
+            ime.save(text_file);
+    });
+    runner.add("ime/save/compiled", [engine, compiled_file](State &state) {
+        IME ime{ engine };
+        for (size_t i{ 0 }; i < state.iterations(); ++i)
+            ime.save_compiled(compiled_file);
+    });
+}
+
+std::string json_context(std::string_view dict_file)
+{
+    std::ostringstream out;
+    auto now{ std::time(nullptr) };
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    out << "{\"date\": \"" << date << "\", \"build_type\": \"" << BENCH_BUILD_TYPE
+        << "\", \"dict\": \"" << dict_file << "\"}";
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string filter;
+    std::chrono::milliseconds min_time{ 200 };
+    size_t repetitions{ 5 };
+    std::string json_file;
+    std::string baseline_file;
+    int i{ 1 };
+    try {
+        for (; i < argc && argv[i][0] == '-'; ++i) {
+            std::string_view option{ argv[i] };
+            if (option == "-f" && i + 1 < argc)
+                filter = argv[++i];
+            else if (option == "-t" && i + 1 < argc)
+                min_time = std::chrono::milliseconds{ std::stoul(argv[++i]) };
+            else if (option == "-r" && i + 1 < argc)
+                repetitions = std::stoul(argv[++i]);
+            else if (option == "-j" && i + 1 < argc)
+                json_file = argv[++i];
+            else if (option == "-c" && i + 1 < argc)
+                baseline_file = argv[++i];
+            else
+                throw std::invalid_argument{ "Unknown option" };
+        }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (argc - i > 1 || repetitions == 0) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    std::string dict_file{ i < argc ? argv[i] : BENCH_DEFAULT_DICT };
+
+    std::filesystem::path temp_dir;
+    int status{ 0 };
+    try {
+        auto engine{ std::make_shared<Engine>() };
+        try {
+            engine->load(dict_file);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Load dict failed" });
+        }
+        temp_dir = std::filesystem::temp_directory_path()
+                   / ("pinyin_ime_bench_" + std::to_string(std::random_device{}()));
+        std::filesystem::create_directory(temp_dir);
+
+        Runner runner;
+        add_trie_benchmarks(runner, engine->snapshot());
+        add_pinyin_benchmarks(runner);
+        add_dict_benchmarks(runner, engine->snapshot());
+        add_ime_benchmarks(runner, engine, dict_file, temp_dir);
+
+        auto results{ runner.run(filter, min_time, repetitions) };
+        if (!json_file.empty()) {
+            try {
+                Runner::write_json(results, json_context(dict_file), json_file);
+            } catch (const std::exception &e) {
+                std::throw_with_nested(std::runtime_error{ "Write json failed" });
+            }
+        }
+        if (!baseline_file.empty()) {
+            try {
+                Runner::compare(results, baseline_file);
+            } catch (const std::exception &e) {
+                std::throw_with_nested(std::runtime_error{ "Compare with baseline failed" });
+            }
+        }
+    } catch (const std::exception &e) {
+        print_exception(e);
+        status = 1;
+    }
+    if (!temp_dir.empty()) {
+        std::error_code ec;
+        std::filesystem::remove_all(temp_dir, ec);
+    }
+    return status;
+}
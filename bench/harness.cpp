@@ -0,0 +1,186 @@
+#include "harness.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace pinyin_ime::bench {
+
+State::State(size_t iterations, AllocScope alloc_scope) noexcept
+    : m_iterations{ iterations },
+      m_alloc_scope{ alloc_scope }
+{}
+
+size_t State::iterations() const noexcept
+{
+    return m_iterations;
+}
+
+void State::start() noexcept
+{
+    m_elapsed = std::chrono::nanoseconds{ 0 };
+    m_allocs = {};
+    resume();
+}
+
+void State::stop() noexcept
+{
+    pause();
+}
+
+void State::pause() noexcept
+{
+    if (!m_running)
+        return;
+    auto end{ std::chrono::steady_clock::now() };
+    auto end_allocs{ current_allocs() };
+    m_elapsed += end - m_start;
+    m_allocs.m_count += end_allocs.m_count - m_start_allocs.m_count;
+    m_allocs.m_bytes += end_allocs.m_bytes - m_start_allocs.m_bytes;
+    m_running = false;
+}
+
+void State::resume() noexcept
+{
+    if (m_running)
+        return;
+    m_running = true;
+    m_start_allocs = current_allocs();
+    m_start = std::chrono::steady_clock::now();
+}
+
+std::chrono::nanoseconds State::elapsed() const noexcept
+{
+    return m_elapsed;
+}
+
+AllocCounter State::allocs() const noexcept
+{
+    return m_allocs;
+}
+
+AllocCounter State::current_allocs() const noexcept
+{
+    return m_alloc_scope == AllocScope::Thread ? AllocCounter::thread_now() : AllocCounter::now();
+}
+
+void Runner::add(std::string name, Body body, AllocScope alloc_scope)
+{
+    m_benchmarks.push_back({ std::move(name), std::move(body), alloc_scope });
+}
+
+std::vector<Result> Runner::run(std::string_view filter, std::chrono::milliseconds min_time, size_t repetitions)
+{
+    auto timed_run{ [](const Body &body, size_t iterations, AllocScope alloc_scope) {
+        State state{ iterations, alloc_scope };
+        state.start();
+        body(state);
+        state.stop();
+        return state;
+    } };
+
+    std::vector<Result> results;
+    for (auto &[name, body, alloc_scope] : m_benchmarks) {
+        if (name.find(filter) == std::string::npos)
+            continue;
+        // 校准：迭代次数按预计耗时放大，直到一次运行不短于 min_time
+        size_t iterations{ 1 };
+        for (;;) {
+            auto elapsed{ timed_run(body, iterations, alloc_scope).elapsed() };
+            if (elapsed >= min_time)
+                break;
+            double scale{ elapsed.count() > 0 ? 1.5 * min_time / elapsed : 100.0 };
+            iterations = static_cast<size_t>(iterations * std::clamp(scale, 2.0, 100.0));
+        }
+
+        std::vector<double> ns_per_op;
+        AllocCounter allocs;
+        for (size_t r{ 0 }; r < repetitions; ++r) {
+            auto state{ timed_run(body, iterations, alloc_scope) };
+            ns_per_op.push_back(static_cast<double>(state.elapsed().count()) / iterations);
+            allocs.m_count += state.allocs().m_count;
+            allocs.m_bytes += state.allocs().m_bytes;
+        }
+        std::sort(ns_per_op.begin(), ns_per_op.end());
+        double total_ops{ static_cast<double>(iterations * repetitions) };
+        Result result{
+            name, iterations, ns_per_op[ns_per_op.size() / 2], ns_per_op.front(),
+            allocs.m_count / total_ops, allocs.m_bytes / total_ops
+        };
+        std::cout << std::left << std::setw(36) << result.m_name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(14) << result.m_ns_per_op << " ns/op"
+                  << std::setw(14) << result.m_min_ns_per_op << " min"
+                  << std::setprecision(2) << std::setw(12) << result.m_allocs_per_op << " allocs/op"
+                  << std::setprecision(0) << std::setw(12) << result.m_bytes_per_op << " B/op"
+                  << std::setw(12) << result.m_iterations << " iters" << std::endl;
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+void Runner::write_json(const std::vector<Result> &results, std::string_view context, std::string_view file)
+{
+    std::ofstream out{ std::string{ file } };
+    if (!out)
+        throw std::runtime_error{ "Open file failed" };
+    out << std::fixed << "{\n\"context\": " << context << ",\n\"benchmarks\": [\n";
+    for (size_t i{ 0 }; i < results.size(); ++i) {
+        auto &r{ results[i] };
+        out << std::setprecision(1)
+            << "{\"name\": \"" << r.m_name << "\", \"iterations\": " << r.m_iterations
+            << ", \"ns_per_op\": " << r.m_ns_per_op << ", \"min_ns_per_op\": " << r.m_min_ns_per_op
+            << std::setprecision(3)
+            << ", \"allocs_per_op\": " << r.m_allocs_per_op << ", \"bytes_per_op\": " << r.m_bytes_per_op << '}'
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n}\n";
+    if (!out.flush())
+        throw std::runtime_error{ "Write file failed" };
+}
+
+void Runner::compare(const std::vector<Result> &results, std::string_view baseline_file)
+{
+    std::ifstream in{ std::string{ baseline_file } };
+    if (!in)
+        throw std::runtime_error{ "Open file failed" };
+    // 只读取 write_json() 写入的格式：每个测试一行，字段顺序固定
+    auto field{ [](std::string_view line, std::string_view key) -> std::string_view {
+        auto pos{ line.find(key) };
+        if (pos == std::string_view::npos)
+            return {};
+        line.remove_prefix(pos + key.size());
+        return line.substr(0, line.find_first_of(",}"));
+    } };
+    std::unordered_map<std::string, std::pair<double, double>> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        auto name{ field(line, "\"name\": \"") };
+        if (name.empty())
+            continue;
+        name = name.substr(0, name.find('"'));
+        baseline[std::string{ name }] = {
+            std::stod(std::string{ field(line, "\"ns_per_op\": ") }),
+            std::stod(std::string{ field(line, "\"allocs_per_op\": ") })
+        };
+    }
+    if (in.bad())
+        throw std::runtime_error{ "Read file failed" };
+
+    std::cout << "\nCompared with " << baseline_file << ":\n";
+    for (auto &r : results) {
+        auto it{ baseline.find(r.m_name) };
+        if (it == baseline.end())
+            continue;
+        auto [ns, allocs]{ it->second };
+        std::cout << std::left << std::setw(36) << r.m_name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << ns << " -> " << std::setw(12) << r.m_ns_per_op << " ns/op ("
+                  << std::showpos << (ns > 0 ? (r.m_ns_per_op / ns - 1) * 100 : 0.0) << std::noshowpos << "%)"
+                  << std::setprecision(2) << std::setw(12) << allocs << " -> " << r.m_allocs_per_op
+                  << " allocs/op" << std::endl;
+    }
+}
+
+} // namespace pinyin_ime::bench
@@ -0,0 +1,134 @@
+#ifndef PINYIN_IME_BENCH_HARNESS_H
+#define PINYIN_IME_BENCH_HARNESS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "alloc_counter.h"
+
+namespace pinyin_ime::bench {
+
+/**
+ * \brief 分配次数的统计范围。
+ */
+enum class AllocScope {
+    // 进程内所有线程的分配，包括被测操作交给后台线程的工作
+    Process,
+    // 只统计运行测试体的线程，用于测量后台线程同时在工作的异步操作
+    Thread
+};
+
+/**
+ * \brief 一次计时运行的状态，传递给测试体。
+ * \details 测试体需要执行 iterations() 次被测操作；每次操作前的准备工作可以放在
+ *          pause() 与 resume() 之间，不计入耗时与分配次数。
+ */
+class State {
+public:
+    explicit State(size_t iterations, AllocScope alloc_scope = AllocScope::Process) noexcept;
+
+    size_t iterations() const noexcept;
+
+    /**
+     * \brief 暂停计时与分配计数。
+     */
+    void pause() noexcept;
+
+    /**
+     * \brief 恢复计时与分配计数。
+     */
+    void resume() noexcept;
+
+    /**
+     * \brief 开始计时，由 Runner 在调用测试体前调用。
+     */
+    void start() noexcept;
+
+    /**
+     * \brief 结束计时，由 Runner 在测试体返回后调用。
+     */
+    void stop() noexcept;
+
+    std::chrono::nanoseconds elapsed() const noexcept;
+    AllocCounter allocs() const noexcept;
+private:
+    AllocCounter current_allocs() const noexcept;
+
+    size_t m_iterations;
+    AllocScope m_alloc_scope;
+    bool m_running{ false };
+    std::chrono::steady_clock::time_point m_start;
+    AllocCounter m_start_allocs;
+    std::chrono::nanoseconds m_elapsed{ 0 };
+    AllocCounter m_allocs;
+};
+
+/**
+ * \brief 一个基准测试的结果，耗时取各次重复的中位数。
+ */
+struct Result {
+    std::string m_name;
+    size_t m_iterations{ 0 };
+    double m_ns_per_op{ 0 };
+    double m_min_ns_per_op{ 0 };
+    double m_allocs_per_op{ 0 };
+    double m_bytes_per_op{ 0 };
+};
+
+/**
+ * \brief 注册并运行基准测试。
+ * \details 每个测试先以倍增的迭代次数校准，使一次运行不短于 min_time，
+ *          然后以相同的迭代次数重复运行 repetitions 次。
+ */
+class Runner {
+public:
+    using Body = std::function<void(State&)>;
+
+    void add(std::string name, Body body, AllocScope alloc_scope = AllocScope::Process);
+
+    /**
+     * \brief 运行名称包含 filter 的测试，每个测试完成后输出一行结果到 std::cout。
+     */
+    std::vector<Result> run(std::string_view filter, std::chrono::milliseconds min_time, size_t repetitions);
+
+    /**
+     * \brief 将结果以 JSON 格式写入文件，每个测试占一行，便于 compare() 读取和逐行比较。
+     * \throws std::runtime_error 如果写入失败。
+     */
+    static void write_json(const std::vector<Result> &results, std::string_view context, std::string_view file);
+
+    /**
+     * \brief 读取 write_json() 写入的基线文件，输出各测试相对基线的耗时与分配次数变化。
+     * \throws std::runtime_error 如果读取失败。
+     */
+    static void compare(const std::vector<Result> &results, std::string_view baseline_file);
+private:
+    struct Benchmark {
+        std::string m_name;
+        Body m_body;
+        AllocScope m_alloc_scope;
+    };
+
+    std::vector<Benchmark> m_benchmarks;
+};
+
+/**
+ * \brief 阻止编译器优化掉 value 的计算。
+ */
+template <class T>
+inline void do_not_optimize(const T &value) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *s_sink;
+    s_sink = &value;
+#endif
+}
+
+} // namespace pinyin_ime::bench
+
+#endif // PINYIN_IME_BENCH_HARNESS_H
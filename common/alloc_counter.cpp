@@ -0,0 +1,103 @@
+#include "alloc_counter.h"
+#include "stats.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> s_alloc_count{ 0 };
+std::atomic<uint64_t> s_alloc_bytes{ 0 };
+// 常量初始化，operator new 中访问不会触发线程局部变量的动态初始化
+thread_local uint64_t s_thread_alloc_count{ 0 };
+thread_local uint64_t s_thread_alloc_bytes{ 0 };
+
+void* counted_alloc(std::size_t size, std::size_t align = 0) noexcept
+{
+    s_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    s_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    ++s_thread_alloc_count;
+    s_thread_alloc_bytes += size;
+    pinyin_ime::Stats::note_allocation();
+    if (size == 0)
+        size = 1;
+    if (align <= alignof(std::max_align_t))
+        return std::malloc(size);
+    // aligned_alloc 要求 size 为 align 的整数倍
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+} // namespace
+
+// 替换全局 operator new 以统计分配次数，对应的 operator delete 一并替换
+void* operator new(std::size_t size)
+{
+    if (auto p{ counted_alloc(size) })
+        return p;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    if (auto p{ counted_alloc(size, static_cast<std::size_t>(align)) })
+        return p;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return ::operator new(size, align);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace pinyin_ime {
+
+AllocCounter AllocCounter::now() noexcept
+{
+    return { s_alloc_count.load(std::memory_order_relaxed), s_alloc_bytes.load(std::memory_order_relaxed) };
+}
+
+AllocCounter AllocCounter::thread_now() noexcept
+{
+    return { s_thread_alloc_count, s_thread_alloc_bytes };
+}
+
+} // namespace pinyin_ime
@@ -0,0 +1,30 @@
+#ifndef PINYIN_IME_COMMON_ALLOC_COUNTER_H
+#define PINYIN_IME_COMMON_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 进程内所有线程的内存分配计数，由 alloc_counter.cpp 中替换的全局 operator new 维护。
+ * \details 链接 pinyin_ime_alloc_counter 目标的程序才会替换 operator new。替换的 operator new
+ *          同时调用 Stats::note_allocation()，启用 PINYIN_IME_STATS 时各阶段也统计分配次数。
+ */
+struct AllocCounter {
+    uint64_t m_count{ 0 };
+    uint64_t m_bytes{ 0 };
+
+    /**
+     * \brief 获取当前的累计计数。
+     */
+    static AllocCounter now() noexcept;
+
+    /**
+     * \brief 获取调用线程的累计计数，不包含其它线程（如 Engine 的学习线程）的分配。
+     */
+    static AllocCounter thread_now() noexcept;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_COMMON_ALLOC_COUNTER_H
@@ -0,0 +1,28 @@
+#ifndef PINYIN_IME_COMMON_PRINT_EXCEPTION_H
+#define PINYIN_IME_COMMON_PRINT_EXCEPTION_H
+
+#include <exception>
+#include <iostream>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 将异常及其嵌套的异常（见 std::throw_with_nested()）输出到 std::cerr，以 ": " 分隔，最后换行。
+ */
+inline void print_exception(const std::exception& e, bool nested = false)
+{
+    if (nested)
+        std::cerr << ": " << e.what();
+    else
+        std::cerr << e.what();
+    try {
+        std::rethrow_if_nested(e);
+        std::cerr << '\n';
+    } catch (const std::exception& nestedException) {
+        print_exception(nestedException, true);
+    } catch (...) {}
+}
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_COMMON_PRINT_EXCEPTION_H
@@ -0,0 +1,178 @@
+#include "client.h"
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace pinyin_ime::daemon {
+
+namespace {
+
+std::runtime_error io_error(const char *what, int err)
+{
+    using std::operator""s;
+    return std::runtime_error{ what + ": "s + std::error_code(err, std::generic_category()).message() };
+}
+
+void write_all(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        ssize_t n{ ::send(fd, data.data(), data.size(), MSG_NOSIGNAL) };
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw io_error("Send request failed", errno);
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+}
+
+void read_all(int fd, char *data, size_t size)
+{
+    while (size) {
+        ssize_t n{ ::read(fd, data, size) };
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw io_error("Receive response failed", errno);
+        }
+        if (n == 0)
+            throw std::runtime_error{ "Connection closed by server" };
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+} // namespace
+
+Client::Client(std::string_view socket_path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument{ "Invalid socket path" };
+    std::memcpy(addr.sun_path, socket_path.data(), socket_path.size());
+
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+        throw io_error("Create socket failed", errno);
+    try {
+        if (::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            throw io_error("Connect failed", errno);
+        m_request.clear();
+        FrameWriter{ m_request, static_cast<uint8_t>(Op::Hello) }.put(s_version).finish();
+        call();
+    } catch (...) {
+        ::close(m_fd);
+        throw;
+    }
+}
+
+Client::~Client()
+{
+    ::close(m_fd);
+}
+
+const Client::State& Client::search(std::string_view pinyin, uint32_t page)
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::Search) }.put(pinyin).put(page).finish();
+    return read_state(call());
+}
+
+const Client::State& Client::push_back(std::string_view pinyin, uint32_t page)
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::PushBack) }.put(pinyin).put(page).finish();
+    return read_state(call());
+}
+
+const Client::State& Client::backspace(uint32_t count, uint32_t page)
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::Backspace) }.put(count).put(page).finish();
+    return read_state(call());
+}
+
+const Client::State& Client::choose(uint32_t idx, uint32_t page)
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::Choose) }.put(idx).put(page).finish();
+    return read_state(call());
+}
+
+const Client::State& Client::page(uint32_t start, uint32_t page)
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::Page) }.put(start).put(page).finish();
+    return read_state(call());
+}
+
+std::string Client::commit(bool inc_freq, bool add_new_sentence)
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::Commit) }
+        .put(static_cast<uint8_t>(inc_freq))
+        .put(static_cast<uint8_t>(add_new_sentence))
+        .finish();
+    m_state = {};
+    return std::string{ call().get_string() };
+}
+
+void Client::reset()
+{
+    m_request.clear();
+    FrameWriter{ m_request, static_cast<uint8_t>(Op::Reset) }.finish();
+    call();
+    m_state = {};
+}
+
+const Client::State& Client::state() const noexcept
+{
+    return m_state;
+}
+
+FrameReader Client::call()
+{
+    write_all(m_fd, m_request);
+    FrameHeader header;
+    read_all(m_fd, reinterpret_cast<char*>(&header), sizeof(header));
+    if (header.m_size > s_max_payload)
+        throw std::runtime_error{ "Response too large" };
+    m_response.resize(header.m_size);
+    read_all(m_fd, m_response.data(), m_response.size());
+    FrameReader reader{ m_response };
+    if (header.m_code != static_cast<uint8_t>(Status::Ok)) {
+        using std::operator""s;
+        throw std::runtime_error{ "Server error: "s + std::string{ reader.get_string() } };
+    }
+    return reader;
+}
+
+const Client::State& Client::read_state(FrameReader reader)
+{
+    try {
+        m_state.m_candidate_count = reader.get<uint32_t>();
+        m_state.m_fixed_letters = reader.get_string();
+        m_state.m_unfixed_letters = reader.get_string();
+        m_state.m_page_start = reader.get<uint32_t>();
+        auto count{ reader.get<uint32_t>() };
+        // 每个候选词至少占用字符串长度与频率两个 uint32_t
+        if (count > reader.remaining() / (2 * sizeof(uint32_t)))
+            throw std::invalid_argument{ "Too many candidates" };
+        // 复用已有 Candidate 的字符串缓冲区
+        m_state.m_page.resize(count);
+        for (auto &candidate : m_state.m_page) {
+            candidate.m_chinese = reader.get_string();
+            candidate.m_freq = reader.get<uint32_t>();
+        }
+    } catch (const std::invalid_argument&) {
+        throw std::runtime_error{ "Malformed response" };
+    }
+    return m_state;
+}
+
+} // namespace pinyin_ime::daemon
@@ -0,0 +1,101 @@
+#ifndef PINYIN_IME_DAEMON_CLIENT_H
+#define PINYIN_IME_DAEMON_CLIENT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "protocol.h"
+
+namespace pinyin_ime::daemon {
+
+/**
+ * \brief 输入法守护进程（见 Server）的客户端，一个 Client 对应服务端的一个 Session。
+ * \details 只依赖协议定义，不链接输入法库，也不加载词库。
+ *          每个调用发送一个请求并阻塞等待响应，接口含义与 Session 的同名接口相同。
+ *          返回的 State 在下一次调用前有效，其内部缓冲区在调用之间复用。
+ * \note 不是线程安全的，每个线程应使用自己的 Client。
+ */
+class Client {
+public:
+    static constexpr uint32_t s_default_page{ 10 };
+
+    struct Candidate {
+        std::string m_chinese;
+        uint32_t m_freq;
+    };
+
+    /**
+     * \brief 服务端 Session 的状态及一页候选词。
+     */
+    struct State {
+        // 候选词总数
+        size_t m_candidate_count{ 0 };
+        std::string m_fixed_letters;
+        std::string m_unfixed_letters;
+        // 本页第一个候选词的下标
+        size_t m_page_start{ 0 };
+        std::vector<Candidate> m_page;
+    };
+
+    /**
+     * \brief 连接守护进程并校验协议版本。
+     * \throws std::invalid_argument 如果路径过长。
+     *         std::runtime_error 如果连接失败或协议版本不符。
+     */
+    explicit Client(std::string_view socket_path);
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client();
+
+    /**
+     * \throws std::runtime_error 如果通信发生错误或服务端处理请求失败。
+     */
+    const State& search(std::string_view pinyin, uint32_t page = s_default_page);
+    const State& push_back(std::string_view pinyin, uint32_t page = s_default_page);
+    const State& backspace(uint32_t count = 1, uint32_t page = s_default_page);
+    const State& choose(uint32_t idx, uint32_t page = s_default_page);
+
+    /**
+     * \brief 获取从 start 开始的一页候选词，不改变输入状态。
+     * \throws std::runtime_error 如果通信发生错误或服务端处理请求失败。
+     */
+    const State& page(uint32_t start, uint32_t page = s_default_page);
+
+    /**
+     * \brief 结束本次输入，见 Session::finish_search()。
+     * \return 已选择项拼接成的文本，即应上屏的文本。
+     * \throws std::runtime_error 如果通信发生错误或服务端处理请求失败。
+     */
+    std::string commit(bool inc_freq = true, bool add_new_sentence = true);
+
+    /**
+     * \brief 放弃本次输入，见 Session::reset_search()。
+     * \throws std::runtime_error 如果通信发生错误。
+     */
+    void reset();
+
+    /**
+     * \brief 获取最近一次返回的状态。
+     */
+    const State& state() const noexcept;
+private:
+    /**
+     * \brief 发送 m_request 中的请求帧并读取响应负载。
+     * \throws std::runtime_error 如果通信发生错误或服务端返回错误。
+     */
+    FrameReader call();
+
+    const State& read_state(FrameReader reader);
+
+    int m_fd{ -1 };
+    std::string m_request;
+    std::string m_response;
+    State m_state;
+};
+
+} // namespace pinyin_ime::daemon
+
+#endif // PINYIN_IME_DAEMON_CLIENT_H
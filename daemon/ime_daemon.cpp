@@ -0,0 +1,109 @@
+#include <iostream>
+#include <string>
+#include <csignal>
+#include <optional>
+#include "server.h"
+#include "dict_watcher.h"
+#include "print_exception.h"
+
+namespace {
+
+pinyin_ime::daemon::Server *s_server{ nullptr };
+
+void handle_signal(int)
+{
+    if (s_server)
+        s_server->stop();
+}
+
+void print_usage(const char *name)
+{
+    std::cerr << "Usage: " << name
+              << " [-w <worker count>] [-j <journal>] [-n <ngram model>] [-r] <dict> <socket path>\n"
+              << "    -r  reload the dict when the file is updated" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    using namespace pinyin_ime;
+
+    size_t worker_count{ 0 };
+    std::string journal_file;
+    std::string ngram_file;
+    bool watch{ false };
+    int i{ 1 };
+    try {
+        for (; i < argc && argv[i][0] == '-'; ++i) {
+            std::string_view option{ argv[i] };
+            if (option == "-r")
+                watch = true;
+            else if (option == "-w" && i + 1 < argc)
+                worker_count = std::stoul(argv[++i]);
+            else if (option == "-j" && i + 1 < argc)
+                journal_file = argv[++i];
+            else if (option == "-n" && i + 1 < argc)
+                ngram_file = argv[++i];
+            else
+                throw std::invalid_argument{ "Unknown option" };
+        }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (argc - i != 2) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    try {
+        // 所有连接共享同一个 Engine，词库只加载一份
+        auto engine{ std::make_shared<Engine>() };
+        try {
+            engine->load(argv[i]);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Load dict failed" });
+        }
+        if (!journal_file.empty()) {
+            try {
+                engine->open_journal(journal_file);
+            } catch (const std::exception &e) {
+                std::throw_with_nested(std::runtime_error{ "Open journal failed" });
+            }
+        }
+        if (!ngram_file.empty()) {
+            try {
+                engine->load_ngram(ngram_file);
+            } catch (const std::exception &e) {
+                std::throw_with_nested(std::runtime_error{ "Load ngram model failed" });
+            }
+        }
+
+        std::optional<DictWatcher> watcher;
+        if (watch) {
+            watcher.emplace(engine, argv[i], [](std::exception_ptr error) {
+                try {
+                    std::rethrow_exception(error);
+                } catch (const std::exception &e) {
+                    std::cerr << "Reload dict failed: ";
+                    print_exception(e);
+                }
+            });
+        }
+
+        daemon::Server server{ engine, argv[i + 1], worker_count };
+        s_server = &server;
+        std::signal(SIGINT, handle_signal);
+        std::signal(SIGTERM, handle_signal);
+        std::signal(SIGPIPE, SIG_IGN);
+        server.run();
+        s_server = nullptr;
+
+        if (!journal_file.empty())
+            engine->close_journal();
+        return 0;
+    } catch (const std::exception &e) {
+        print_exception(e);
+        return 1;
+    }
+}
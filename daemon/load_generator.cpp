@@ -0,0 +1,113 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include "client.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 模拟逐个字母输入拼音、选择首个候选词并上屏
+constexpr std::string_view s_script[]{
+    "nihao", "zhongguo", "woxiangqu", "beijing", "kankan",
+    "shijie", "shurufa", "jintian", "tianqi", "henhao"
+};
+
+void print_usage(const char *name)
+{
+    std::cerr << "Usage: " << name
+              << " [-c <client count>] [-d <seconds>] [-l] <socket path>\n"
+              << "    -l  learn on commit (modifies the daemon's user dict)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    using namespace pinyin_ime::daemon;
+
+    size_t client_count{ 4 };
+    size_t seconds{ 5 };
+    bool learn{ false };
+    int i{ 1 };
+    try {
+        for (; i < argc && argv[i][0] == '-'; ++i) {
+            std::string_view option{ argv[i] };
+            if (option == "-c" && i + 1 < argc)
+                client_count = std::stoul(argv[++i]);
+            else if (option == "-d" && i + 1 < argc)
+                seconds = std::stoul(argv[++i]);
+            else if (option == "-l")
+                learn = true;
+            else
+                throw std::invalid_argument{ "Unknown option" };
+        }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (argc - i != 1 || client_count == 0) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    std::string_view socket_path{ argv[i] };
+
+    // 每个客户端线程各自记录请求耗时（纳秒），结束后合并
+    std::vector<std::vector<int64_t>> latencies(client_count);
+    std::atomic<size_t> failed{ 0 };
+    auto deadline{ Clock::now() + std::chrono::seconds{ seconds } };
+    std::vector<std::thread> clients;
+    for (size_t c{ 0 }; c < client_count; ++c) {
+        clients.emplace_back([&, c] {
+            auto &samples{ latencies[c] };
+            auto timed{ [&](auto &&request) {
+                auto start{ Clock::now() };
+                request();
+                samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            } };
+            try {
+                Client client{ socket_path };
+                for (size_t n{ c }; Clock::now() < deadline; ++n) {
+                    std::string_view pinyin{ s_script[n % std::size(s_script)] };
+                    for (size_t k{ 0 }; k < pinyin.size(); ++k)
+                        timed([&] { client.push_back(pinyin.substr(k, 1)); });
+                    timed([&] { client.choose(0); });
+                    timed([&] { client.commit(learn, learn); });
+                }
+            } catch (const std::exception &e) {
+                std::cerr << "Client " << c << ": " << e.what() << std::endl;
+                ++failed;
+            }
+        });
+    }
+    for (auto &client : clients)
+        client.join();
+
+    std::vector<int64_t> all;
+    for (auto &samples : latencies)
+        all.insert(all.end(), samples.begin(), samples.end());
+    if (all.empty()) {
+        std::cerr << "No request completed" << std::endl;
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile{ [&](double p) {
+        return static_cast<double>(all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]) / 1000.0;
+    } };
+    double mean{ static_cast<double>(std::accumulate(all.begin(), all.end(), int64_t{ 0 })) / all.size() / 1000.0 };
+    std::cout << std::fixed << std::setprecision(1)
+              << "clients: " << client_count << ", failed: " << failed << '\n'
+              << "requests: " << all.size() << ", " << static_cast<double>(all.size()) / seconds << " req/s\n"
+              << "latency (us): mean " << mean
+              << ", p50 " << percentile(0.5)
+              << ", p90 " << percentile(0.9)
+              << ", p99 " << percentile(0.99)
+              << ", max " << static_cast<double>(all.back()) / 1000.0 << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#ifndef PINYIN_IME_DAEMON_PROTOCOL_H
+#define PINYIN_IME_DAEMON_PROTOCOL_H
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace pinyin_ime::daemon {
+
+/**
+ * \brief 守护进程与客户端之间的二进制协议。
+ * \details 通信只在本机的 Unix 域套接字上进行，整数均以本机字节序存放。
+ *          每个请求、响应都是一帧：帧头（FrameHeader）之后紧跟 m_size 字节的负载。
+ *          请求帧头的 m_code 为 Op，响应帧头的 m_code 为 Status。
+ *          字符串以 uint32_t 长度加内容表示，不以 '\0' 结尾。
+ *          一个连接对应服务端的一个 Session，连接建立后必须先发送 Op::Hello 校验协议版本。
+ *          客户端可以连续发送多个请求，服务端按顺序逐个响应。
+ *
+ *          各请求的负载与成功时的响应负载：
+ *          - Hello：uint32_t 版本号；响应为空。
+ *          - Search、PushBack：字符串 pinyin，uint32_t 页大小；响应为 State。
+ *          - Backspace：uint32_t 删除个数，uint32_t 页大小；响应为 State。
+ *          - Choose：uint32_t 候选词下标，uint32_t 页大小；响应为 State。
+ *          - Page：uint32_t 起始下标，uint32_t 页大小；响应为 State。
+ *          - Commit：uint8_t inc_freq，uint8_t add_new_sentence；响应为字符串，即已选择项拼接成的文本。
+ *          - Reset：空；响应为空。
+ *
+ *          State 依次为：uint32_t 候选词总数，字符串 fixed_letters，字符串 unfixed_letters，
+ *          uint32_t 本页起始下标，uint32_t 本页个数，之后每个候选词为字符串 chinese、uint32_t freq。
+ *          出错时响应的 m_code 为 Status::Error，负载为错误信息字符串。
+ */
+inline constexpr uint32_t s_version{ 1 };
+// 单帧负载的上限，超过时服务端关闭连接
+inline constexpr uint32_t s_max_payload{ 1 << 20 };
+
+enum class Op : uint8_t {
+    Hello = 1,
+    Search,
+    PushBack,
+    Backspace,
+    Choose,
+    Page,
+    Commit,
+    Reset
+};
+
+enum class Status : uint8_t {
+    Ok = 0,
+    Error
+};
+
+struct FrameHeader {
+    uint32_t m_size;
+    uint8_t m_code;
+    uint8_t m_reserved[3];
+};
+static_assert(sizeof(FrameHeader) == 8);
+
+/**
+ * \brief 向缓冲区追加一帧的编码器，构造时写入帧头，finish() 时回填负载大小。
+ */
+class FrameWriter {
+public:
+    FrameWriter(std::string &buffer, uint8_t code)
+        : m_buffer{ buffer }, m_start{ buffer.size() }
+    {
+        FrameHeader header{ 0, code, {} };
+        put_raw(&header, sizeof(header));
+    }
+
+    template <class T>
+    requires std::is_integral_v<T>
+    FrameWriter& put(T value)
+    {
+        put_raw(&value, sizeof(value));
+        return *this;
+    }
+
+    FrameWriter& put(std::string_view str)
+    {
+        put(static_cast<uint32_t>(str.size()));
+        put_raw(str.data(), str.size());
+        return *this;
+    }
+
+    void finish() noexcept
+    {
+        uint32_t size{ static_cast<uint32_t>(m_buffer.size() - m_start - sizeof(FrameHeader)) };
+        std::memcpy(m_buffer.data() + m_start, &size, sizeof(size));
+    }
+private:
+    void put_raw(const void *data, size_t size)
+    {
+        m_buffer.append(static_cast<const char*>(data), size);
+    }
+
+    std::string &m_buffer;
+    size_t m_start;
+};
+
+/**
+ * \brief 解码一帧负载的读取器。
+ * \throws std::invalid_argument 如果负载长度不足。
+ */
+class FrameReader {
+public:
+    explicit FrameReader(std::string_view payload) noexcept
+        : m_payload{ payload }
+    {}
+
+    template <class T>
+    requires std::is_integral_v<T>
+    T get()
+    {
+        T value;
+        std::memcpy(&value, take(sizeof(value)).data(), sizeof(value));
+        return value;
+    }
+
+    std::string_view get_string()
+    {
+        return take(get<uint32_t>());
+    }
+
+    size_t remaining() const noexcept
+    {
+        return m_payload.size();
+    }
+private:
+    std::string_view take(size_t size)
+    {
+        if (m_payload.size() < size)
+            throw std::invalid_argument{ "Frame payload too short" };
+        std::string_view result{ m_payload.substr(0, size) };
+        m_payload.remove_prefix(size);
+        return result;
+    }
+
+    std::string_view m_payload;
+};
+
+} // namespace pinyin_ime::daemon
+
+#endif // PINYIN_IME_DAEMON_PROTOCOL_H
@@ -0,0 +1,385 @@
+#include "server.h"
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace pinyin_ime::daemon {
+
+namespace {
+
+// 一次处理中最多读取的请求数据，避免单个连接长时间占用工作线程
+constexpr size_t s_read_limit{ 64 * 1024 };
+// 每页最多返回的候选词数量
+constexpr uint32_t s_max_page{ 1024 };
+
+std::runtime_error io_error(const char *what, int err)
+{
+    using std::operator""s;
+    return std::runtime_error{ what + ": "s + std::error_code(err, std::generic_category()).message() };
+}
+
+std::string describe(const std::exception &e)
+{
+    std::string message{ e.what() };
+    try {
+        std::rethrow_if_nested(e);
+    } catch (const std::exception &nested) {
+        message += ": ";
+        message += describe(nested);
+    } catch (...) {}
+    return message;
+}
+
+void put_state(FrameWriter &writer, const Session &session, uint32_t start, uint32_t page)
+{
+    const Candidates &candidates{ session.candidates() };
+    size_t total{ candidates.size() };
+    size_t first{ std::min<size_t>(start, total) };
+    size_t count{ std::min<size_t>({ page, s_max_page, total - first }) };
+    writer.put(static_cast<uint32_t>(total))
+          .put(session.fixed_letters())
+          .put(session.unfixed_letters())
+          .put(static_cast<uint32_t>(first))
+          .put(static_cast<uint32_t>(count));
+    for (size_t i{ first }; i < first + count; ++i) {
+        const DictItem &item{ candidates[i] };
+        writer.put(item.chinese()).put(item.freq());
+    }
+}
+
+} // namespace
+
+Server::Server(std::shared_ptr<Engine> engine, std::string_view socket_path, size_t worker_count)
+    : m_engine{ engine ? std::move(engine) : throw std::invalid_argument{ "Engine is null" } },
+      m_socket_path{ socket_path },
+      m_worker_count{ worker_count ? worker_count : std::max(1u, std::thread::hardware_concurrency()) }
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (m_socket_path.empty() || m_socket_path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument{ "Invalid socket path" };
+    std::memcpy(addr.sun_path, m_socket_path.data(), m_socket_path.size());
+
+    auto cleanup{ [this] {
+        for (int fd : { m_listen_fd, m_epoll_fd, m_stop_fd })
+            if (fd >= 0)
+                ::close(fd);
+    } };
+    try {
+        m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listen_fd < 0)
+            throw io_error("Create socket failed", errno);
+        ::unlink(m_socket_path.c_str());
+        if (::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            throw io_error("Bind socket failed", errno);
+        if (::listen(m_listen_fd, SOMAXCONN) < 0)
+            throw io_error("Listen socket failed", errno);
+        m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd < 0)
+            throw io_error("Create epoll failed", errno);
+        m_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_stop_fd < 0)
+            throw io_error("Create eventfd failed", errno);
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = &m_listen_fd;
+        if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &event) < 0)
+            throw io_error("Register socket failed", errno);
+        event.events = EPOLLIN;
+        event.data.ptr = &m_stop_fd;
+        if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_stop_fd, &event) < 0)
+            throw io_error("Register eventfd failed", errno);
+    } catch (...) {
+        cleanup();
+        ::unlink(m_socket_path.c_str());
+        throw;
+    }
+}
+
+Server::~Server()
+{
+    for (auto &[fd, conn] : m_connections)
+        ::close(fd);
+    m_connections.clear();
+    for (int fd : { m_listen_fd, m_epoll_fd, m_stop_fd })
+        ::close(fd);
+    ::unlink(m_socket_path.c_str());
+}
+
+void Server::run()
+{
+    // 当前线程也作为一个工作线程
+    std::vector<std::thread> workers;
+    workers.reserve(m_worker_count - 1);
+    try {
+        for (size_t i{ 1 }; i < m_worker_count; ++i)
+            workers.emplace_back([this] { worker_loop(); });
+    } catch (...) {
+        stop();
+        for (auto &worker : workers)
+            worker.join();
+        throw;
+    }
+    worker_loop();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void Server::stop() noexcept
+{
+    uint64_t one{ 1 };
+    [[maybe_unused]] auto n{ ::write(m_stop_fd, &one, sizeof(one)) };
+}
+
+void Server::worker_loop() noexcept
+{
+    for (;;) {
+        // 每次只取一个事件，避免一个线程积压多个连接而其它线程空闲
+        epoll_event event;
+        int n{ ::epoll_wait(m_epoll_fd, &event, 1, -1) };
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 || event.data.ptr == &m_stop_fd)
+            return;
+        if (n == 0)
+            continue;
+        if (event.data.ptr == &m_listen_fd) {
+            accept_all();
+            continue;
+        }
+        Connection &conn{ *static_cast<Connection*>(event.data.ptr) };
+        if ((event.events & EPOLLERR) || !handle(conn))
+            close_connection(conn);
+        else
+            rearm(conn);
+    }
+}
+
+void Server::accept_all() noexcept
+{
+    for (;;) {
+        int fd{ ::accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // EAGAIN 表示没有等待中的连接，其它错误（如文件描述符耗尽）留待下次事件重试
+            return;
+        }
+        Connection *conn;
+        try {
+            auto owner{ std::make_unique<Connection>(fd, m_engine) };
+            conn = owner.get();
+            std::lock_guard lock{ m_connections_mutex };
+            // close_connection() 在释放 fd 之前移除映射，fd 不会与仍在映射中的连接重复
+            if (!m_connections.emplace(fd, std::move(owner)).second) {
+                ::close(fd);
+                continue;
+            }
+        } catch (...) {
+            ::close(fd);
+            continue;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.ptr = conn;
+        if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+            close_connection(*conn);
+    }
+}
+
+bool Server::handle(Connection &conn) noexcept
+{
+    if (!flush_output(conn))
+        return false;
+    if (conn.m_output_pos < conn.m_output.size())
+        return true;
+
+    bool eof{ false };
+    char buffer[4096];
+    while (conn.m_input.size() < s_read_limit) {
+        ssize_t n{ ::read(conn.m_fd, buffer, sizeof(buffer)) };
+        if (n > 0) {
+            try {
+                conn.m_input.append(buffer, static_cast<size_t>(n));
+            } catch (...) {
+                return false;
+            }
+        } else if (n == 0) {
+            eof = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    if (!process_input(conn) || !flush_output(conn))
+        return false;
+    return !eof;
+}
+
+bool Server::process_input(Connection &conn) noexcept
+{
+    std::string_view input{ conn.m_input };
+    size_t pos{ 0 };
+    while (input.size() - pos >= sizeof(FrameHeader)) {
+        FrameHeader header;
+        std::memcpy(&header, input.data() + pos, sizeof(header));
+        if (header.m_size > s_max_payload)
+            return false;
+        if (input.size() - pos - sizeof(header) < header.m_size)
+            break;
+        if (!dispatch(conn, static_cast<Op>(header.m_code), input.substr(pos + sizeof(header), header.m_size)))
+            return false;
+        pos += sizeof(header) + header.m_size;
+    }
+    conn.m_input.erase(0, pos);
+    return true;
+}
+
+bool Server::dispatch(Connection &conn, Op op, std::string_view payload) noexcept
+{
+    std::string &output{ conn.m_output };
+    size_t mark{ output.size() };
+    try {
+        FrameReader reader{ payload };
+        Session &session{ conn.m_session };
+        if (!conn.m_hello && op != Op::Hello)
+            throw std::logic_error{ "Hello expected" };
+        FrameWriter writer{ output, static_cast<uint8_t>(Status::Ok) };
+        switch (op) {
+        case Op::Hello:
+            if (reader.get<uint32_t>() != s_version)
+                throw std::invalid_argument{ "Protocol version mismatch" };
+            conn.m_hello = true;
+            break;
+        case Op::Search:
+        case Op::PushBack: {
+            auto pinyin{ reader.get_string() };
+            auto page{ reader.get<uint32_t>() };
+            if (op == Op::Search)
+                session.search(pinyin);
+            else
+                session.push_back(pinyin);
+            put_state(writer, session, 0, page);
+            break;
+        }
+        case Op::Backspace: {
+            auto count{ reader.get<uint32_t>() };
+            auto page{ reader.get<uint32_t>() };
+            session.backspace(count);
+            put_state(writer, session, 0, page);
+            break;
+        }
+        case Op::Choose: {
+            auto idx{ reader.get<uint32_t>() };
+            auto page{ reader.get<uint32_t>() };
+            session.choose(idx);
+            put_state(writer, session, 0, page);
+            break;
+        }
+        case Op::Page: {
+            auto start{ reader.get<uint32_t>() };
+            auto page{ reader.get<uint32_t>() };
+            put_state(writer, session, start, page);
+            break;
+        }
+        case Op::Commit: {
+            bool inc_freq{ reader.get<uint8_t>() != 0 };
+            bool add_new_sentence{ reader.get<uint8_t>() != 0 };
+            std::string text;
+            for (auto &choice : session.choices())
+                text += choice.chinese();
+            session.finish_search(inc_freq, add_new_sentence);
+            writer.put(std::string_view{ text });
+            break;
+        }
+        case Op::Reset:
+            session.reset_search();
+            break;
+        default:
+            throw std::invalid_argument{ "Unknown op" };
+        }
+        writer.finish();
+        return true;
+    } catch (const std::exception &e) {
+        try {
+            output.resize(mark);
+            FrameWriter writer{ output, static_cast<uint8_t>(Status::Error) };
+            writer.put(std::string_view{ describe(e) });
+            writer.finish();
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+}
+
+bool Server::flush_output(Connection &conn) noexcept
+{
+    std::string &output{ conn.m_output };
+    while (conn.m_output_pos < output.size()) {
+        ssize_t n{ ::send(conn.m_fd, output.data() + conn.m_output_pos,
+                          output.size() - conn.m_output_pos, MSG_NOSIGNAL) };
+        if (n >= 0)
+            conn.m_output_pos += static_cast<size_t>(n);
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+        else if (errno != EINTR)
+            return false;
+    }
+    output.clear();
+    conn.m_output_pos = 0;
+    return true;
+}
+
+void Server::rearm(Connection &conn) noexcept
+{
+    epoll_event event{};
+    event.events = EPOLLRDHUP | EPOLLONESHOT
+        | (conn.m_output_pos < conn.m_output.size() ? EPOLLOUT : EPOLLIN);
+    event.data.ptr = &conn;
+    if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, conn.m_fd, &event) < 0)
+        close_connection(conn);
+}
+
+void Server::close_connection(Connection &conn) noexcept
+{
+    // 先从映射中取出连接再关闭 fd：关闭后 fd 可能立即被其它线程的 accept4() 复用，
+    // 此时映射中不能再有旧连接的记录。连接在释放锁之后析构。
+    std::unique_ptr<Connection> owner;
+    bool last{ false };
+    {
+        std::lock_guard lock{ m_connections_mutex };
+        int fd{ conn.m_fd };
+        if (auto it{ m_connections.find(fd) }; it != m_connections.end() && it->second.get() == &conn) {
+            owner = std::move(it->second);
+            m_connections.erase(it);
+            last = m_connections.empty();
+        }
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+    }
+    owner.reset();
+    // 最后一个连接关闭后没有 Session 持有快照，回收重新加载词库后不再使用的文本；
+    // 没有替换过词库或期间有新的连接时直接返回
+    if (last) {
+        try {
+            m_engine->compact_strings();
+        } catch (...) {}
+    }
+}
+
+} // namespace pinyin_ime::daemon
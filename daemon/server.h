@@ -0,0 +1,123 @@
+#ifndef PINYIN_IME_DAEMON_SERVER_H
+#define PINYIN_IME_DAEMON_SERVER_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "session.h"
+#include "protocol.h"
+
+namespace pinyin_ime::daemon {
+
+/**
+ * \brief 在 Unix 域套接字上提供输入服务，所有连接共享同一个 Engine（即同一份词库）。
+ * \details 每个连接对应一个 Session，协议见 protocol.h。
+ *          run() 启动固定数量的工作线程，每个工作线程都在同一个 epoll 实例上等待事件，
+ *          连接以 EPOLLONESHOT 方式注册，同一时刻只有一个工作线程处理某个连接，
+ *          因此 Session 不需要加锁，请求也不需要在线程之间转交。
+ *          监听套接字以 EPOLLEXCLUSIVE 方式注册，新连接只唤醒一个工作线程。
+ *          客户端不读取响应时，服务端暂停处理该连接的请求，直到响应发送完毕。
+ */
+class Server {
+public:
+    /**
+     * \brief 创建并监听 socket_path，若该路径已存在则先删除。
+     * \param engine 共享的 Engine，不可为空。
+     * \param socket_path 套接字路径。
+     * \param worker_count 工作线程数量，为 0 时使用硬件线程数量。
+     * \throws std::invalid_argument 如果 engine 为空或路径过长。
+     *         std::runtime_error 如果创建套接字发生错误。
+     */
+    Server(std::shared_ptr<Engine> engine, std::string_view socket_path, size_t worker_count = 0);
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    /**
+     * \brief 关闭所有连接与监听套接字，并删除套接字文件。
+     */
+    ~Server();
+
+    /**
+     * \brief 启动工作线程并阻塞，直到 stop() 被调用且所有工作线程退出。
+     * \throws std::exception 如果发生错误。
+     */
+    void run();
+
+    /**
+     * \brief 通知工作线程退出，可以在其它线程或信号处理函数中调用。
+     */
+    void stop() noexcept;
+private:
+    struct Connection {
+        Connection(int fd, std::shared_ptr<Engine> engine)
+            : m_fd{ fd }, m_session{ std::move(engine) }
+        {}
+
+        int m_fd;
+        Session m_session;
+        bool m_hello{ false };
+        // 已读取但未处理的请求数据
+        std::string m_input;
+        // 未发送完的响应数据
+        std::string m_output;
+        size_t m_output_pos{ 0 };
+    };
+
+    /**
+     * \brief 工作线程的主循环。
+     */
+    void worker_loop() noexcept;
+
+    /**
+     * \brief 接受所有等待中的连接。
+     */
+    void accept_all() noexcept;
+
+    /**
+     * \brief 处理一个连接上的事件，返回 false 表示连接应被关闭。
+     */
+    bool handle(Connection &conn) noexcept;
+
+    /**
+     * \brief 处理 conn.m_input 中所有完整的请求帧，返回 false 表示协议错误。
+     */
+    bool process_input(Connection &conn) noexcept;
+
+    /**
+     * \brief 处理一个请求并将响应追加到 conn.m_output，返回 false 表示无法生成响应。
+     */
+    bool dispatch(Connection &conn, Op op, std::string_view payload) noexcept;
+
+    /**
+     * \brief 尽可能发送 conn.m_output，返回 false 表示连接已断开。
+     */
+    static bool flush_output(Connection &conn) noexcept;
+
+    /**
+     * \brief 以 EPOLLONESHOT 重新注册连接，有未发送的响应时只等待可写事件。
+     */
+    void rearm(Connection &conn) noexcept;
+
+    /**
+     * \brief 关闭连接并释放其 Session，最后一个连接关闭时尝试压缩字符串池，见 Engine::compact_strings()。
+     */
+    void close_connection(Connection &conn) noexcept;
+
+    std::shared_ptr<Engine> m_engine;
+    std::string m_socket_path;
+    size_t m_worker_count;
+    int m_listen_fd{ -1 };
+    int m_epoll_fd{ -1 };
+    // 通知工作线程退出的 eventfd，以水平触发方式注册，写入后唤醒所有工作线程
+    int m_stop_fd{ -1 };
+    // 只在建立、关闭连接时加锁
+    std::mutex m_connections_mutex;
+    std::unordered_map<int, std::unique_ptr<Connection>> m_connections;
+};
+
+} // namespace pinyin_ime::daemon
+
+#endif // PINYIN_IME_DAEMON_SERVER_H
@@ -0,0 +1,71 @@
+#ifndef PINYIN_IME_BATCH_CONVERTER_H
+#define PINYIN_IME_BATCH_CONVERTER_H
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "engine.h"
+#include "session.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 批量将拼音字符串转换为中文，用于离线处理大量输入（如搜索日志、字幕）。
+ * \details 所有工作线程共享同一个 Engine 的只读快照，每个工作线程使用自己的 Session，
+ *          转换不会学习，也不会修改词库。
+ *          每个输入的结果依次为：整句组合结果（见 SentenceComposer），以及覆盖全部拼音的候选词，
+ *          去除重复后取前 top_n 个。
+ *          输入以工作窃取的方式分配：每个工作线程先处理均分给自己的一段连续输入，处理完后
+ *          从剩余最多的工作线程的段尾窃取一半。连续的输入由同一个 Session 处理，
+ *          相邻输入拼音开头相同时可以沿用上次的查询与词网。
+ * \note convert() 不是线程安全的，不同的 BatchConverter 可以在不同线程中同时使用。
+ */
+class BatchConverter {
+public:
+    // 工作线程每次从自己的段中取出的输入数量
+    static constexpr size_t s_grain{ 16 };
+    // 每个输入整句组合的时间预算，批量转换更看重结果而不是延迟
+    static constexpr std::chrono::microseconds s_compose_budget{ 50000 };
+
+    /**
+     * \brief 构造函数。
+     * \param engine 共享的 Engine，不可为空。
+     * \param thread_count 工作线程数量，为 0 时使用硬件支持的并发线程数量。
+     * \throws std::invalid_argument 如果 engine 为空。
+     *         std::exception 如果发生错误。
+     */
+    explicit BatchConverter(std::shared_ptr<Engine> engine, size_t thread_count = 0);
+
+    BatchConverter(const BatchConverter&) = delete;
+    BatchConverter& operator=(const BatchConverter&) = delete;
+
+    /**
+     * \brief 并行转换一批拼音字符串。
+     * \param pinyins 拼音字符串，格式同 IME::search()。
+     * \param top_n 每个输入最多返回的结果数量。
+     * \return 与 pinyins 一一对应的结果，无法转换的输入（如含有非拼音字符）结果为空。
+     * \throws std::exception 如果发生错误。
+     */
+    std::vector<std::vector<std::string>> convert(std::span<const std::string_view> pinyins, size_t top_n = 1);
+
+    /**
+     * \brief 获取工作线程数量。
+     */
+    size_t thread_count() const noexcept;
+private:
+    /**
+     * \brief 使用 session 转换一个输入。
+     */
+    static std::vector<std::string> convert_one(Session &session, std::string_view pinyin, size_t top_n);
+
+    std::shared_ptr<Engine> m_engine;
+    // 每个工作线程一个 Session，在多次 convert() 之间复用
+    std::vector<std::unique_ptr<Session>> m_sessions;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_BATCH_CONVERTER_H
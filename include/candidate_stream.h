@@ -0,0 +1,117 @@
+#ifndef PINYIN_IME_CANDIDATE_STREAM_H
+#define PINYIN_IME_CANDIDATE_STREAM_H
+
+#include <vector>
+#include <functional>
+#include "query.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 惰性求值的候选词流，按评分对各拼音前缀的查询结果进行多路归并。
+ * \details 与 Candidates 按前缀长度从长到短拼接各 Query 的结果不同，CandidateStream 以
+ *          评分函数（Scorer，综合 DictItem 的频率与前缀的 Token 数量）对所有前缀的结果统一排序。
+ *          每个前缀（数据源）对应一个 Query，Query 在归并真正需要其第一个元素之前不会执行：
+ *          未执行的数据源以其 Dict 中频率最高的 DictItem（即 Dict 的首个元素）的评分作为上界参与归并，
+ *          该上界到达堆顶时才执行查询。因此获取第一页候选词只需要执行必要的查询，
+ *          之后的候选词通过 fetch() 按需产生。
+ *          评分函数对于相同的 Token 数量，必须随频率单调不减，否则归并结果的顺序无法保证。
+ * \note CandidateStream 与 Candidates 一样引用 IME 内部的 Dict 与 Token，
+ *       IME 状态改变后不可继续使用。
+ */
+class CandidateStream {
+public:
+    /**
+     * \brief 一个候选词，包括 DictItem、其对应的拼音 Token 以及评分。
+     */
+    struct Entry {
+        std::reference_wrapper<const DictItem> m_item;
+        PinYin::TokenSpan m_tokens;
+        double m_score{ 0 };
+    };
+
+    using Scorer = std::function<double(const DictItem &item, size_t token_count)>;
+
+    /**
+     * \brief 默认评分函数，频率取对数，每个 Token 增加 s_token_weight。
+     */
+    static double default_score(const DictItem &item, size_t token_count) noexcept;
+
+    /**
+     * \brief 构造函数。
+     * \param scorer 评分函数，为空时使用 default_score()。
+     */
+    explicit CandidateStream(Scorer scorer = {});
+
+    /**
+     * \brief 添加一个数据源，即一个拼音前缀及其对应的系统、用户 Dict，此时不执行查询。
+     * \details 评分相同时，先添加的数据源优先。
+     * \param system_dict 系统 Dict，可以为 nullptr。
+     * \param user_dict 用户 Dict，可以为 nullptr。
+     * \param tokens 前缀对应的 TokenSpan。
+     * \param owner Dict 的所有者，CandidateStream 会一直持有它，见 Query。
+     * \throws std::exception 如果发生错误。
+     */
+    void add_source(const Dict *system_dict, const Dict *user_dict, PinYin::TokenSpan tokens,
+                    std::shared_ptr<const void> owner = {});
+
+    /**
+     * \brief 按评分从高到低继续产生至多 count 个候选词。
+     * \return 实际产生的候选词数量。
+     * \throws std::exception 如果发生错误。
+     */
+    size_t fetch(size_t count);
+
+    /**
+     * \brief 判断是否已经产生了所有候选词。
+     */
+    bool exhausted() const noexcept;
+
+    /**
+     * \brief 返回已经产生的候选词数量。
+     */
+    size_t size() const noexcept;
+
+    /**
+     * \brief 获取已经产生的第 idx 个候选词。
+     */
+    const Entry& operator[](size_t idx) const noexcept;
+
+    /**
+     * \brief 返回已经执行的查询数量。
+     */
+    size_t executed_query_count() const noexcept;
+private:
+    static constexpr double s_token_weight{ 4.0 };
+
+    struct Source {
+        const Dict *m_system_dict;
+        const Dict *m_user_dict;
+        PinYin::TokenSpan m_tokens;
+        std::shared_ptr<const void> m_owner;
+        Query m_query;
+        bool m_executed{ false };
+    };
+
+    /**
+     * \brief 归并堆元素：已执行的数据源为其第 m_pos 个结果的评分，未执行的数据源为评分上界。
+     */
+    struct HeapItem {
+        double m_score;
+        size_t m_source;
+        size_t m_pos;
+    };
+
+    static bool heap_less(const HeapItem &lhs, const HeapItem &rhs) noexcept;
+    void push(HeapItem item);
+
+    Scorer m_scorer;
+    std::vector<Source> m_sources;
+    std::vector<HeapItem> m_heap;
+    std::vector<Entry> m_entries;
+    size_t m_executed_count{ 0 };
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_CANDIDATE_STREAM_H
@@ -1,6 +1,8 @@
 #ifndef PINYIN_IME_CANDIDATES_H
 #define PINYIN_IME_CANDIDATES_H
 
+#include <compare>
+#include <iterator>
 #include "query.h"
 
 namespace pinyin_ime {
@@ -9,28 +11,41 @@ namespace pinyin_ime {
  * \brief IME 向外部提供候选词的类，本质上是对多个 Query 对象（std::vector<Query>）的封装，
  *        使外部能以连续的形式访问多个 Query 对象的查询结果的集合。\
  * \details 借助 shared_ptr，Candidates 允许外部高效拷贝使用。
+ *          Candidates 在加入 Query 时维护各 Query 结果数量的前缀和，size() 为 O(1)，
+ *          按索引访问为 O(log q)（q 为 Query 数量），迭代器满足 std::random_access_iterator。
  */
 class Candidates {
 public:
     using QueryRef = std::reference_wrapper<Query>;
 
     /**
-     * \brief Candidates 迭代器，解引用获取 const DictItem&。
+     * \brief Candidates 随机访问迭代器，解引用获取 const DictItem&。
      */
     class Iterator {
     public:
+        using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept = std::random_access_iterator_tag;
+        using value_type = DictItem;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const DictItem*;
+        using reference = const DictItem&;
+
         Iterator() = default;
         Iterator(const Candidates *c, size_t i)
             : m_candidates{ c }, m_idx{ i }
         {}
-        const DictItem& operator*() const
+        reference operator*() const
         {
             return (*m_candidates)[m_idx];
         }
-        const DictItem* operator->() const
+        pointer operator->() const
         {
             return &((*m_candidates)[m_idx]);
         }
+        reference operator[](difference_type offset) const
+        {
+            return (*m_candidates)[m_idx + offset];
+        }
         Iterator& operator++()
         {
             ++m_idx;
@@ -53,29 +68,39 @@ public:
             --m_idx;
             return i;
         }
-        Iterator& operator+(size_t offset)
+        Iterator& operator+=(difference_type offset)
         {
             m_idx += offset;
             return *this;
         }
-        Iterator& operator-(size_t offset)
+        Iterator& operator-=(difference_type offset)
         {
             m_idx -= offset;
             return *this;
         }
-        std::ptrdiff_t operator-(const Iterator& rhs)
+        friend Iterator operator+(Iterator it, difference_type offset)
+        {
+            return it += offset;
+        }
+        friend Iterator operator+(difference_type offset, Iterator it)
+        {
+            return it += offset;
+        }
+        friend Iterator operator-(Iterator it, difference_type offset)
+        {
+            return it -= offset;
+        }
+        friend difference_type operator-(const Iterator &lhs, const Iterator &rhs)
         {
-            if (m_idx >= rhs.m_idx)
-                return static_cast<std::ptrdiff_t>(m_idx - rhs.m_idx);
-            return -(static_cast<std::ptrdiff_t>(rhs.m_idx - m_idx));
+            return static_cast<difference_type>(lhs.m_idx) - static_cast<difference_type>(rhs.m_idx);
         }
-        bool operator==(const Iterator& rhs)
+        bool operator==(const Iterator &rhs) const
         {
             return m_candidates == rhs.m_candidates && m_idx == rhs.m_idx;
         }
-        bool operator!=(const Iterator& rhs)
+        std::strong_ordering operator<=>(const Iterator &rhs) const
         {
-            return !(*this == rhs);
+            return m_idx <=> rhs.m_idx;
         }
     private:
         const Candidates* m_candidates{ nullptr };
@@ -90,7 +115,7 @@ public:
     Candidates();
 
     /**
-     * \brief 返回 Candidates 中候选词 DictItem 的总数。
+     * \brief 返回 Candidates 中候选词 DictItem 的总数，复杂度 O(1)。
      */
     size_t size() const noexcept;
 
@@ -100,7 +125,7 @@ public:
     bool empty() const noexcept;
 
     /**
-     * \brief 获取 idx 对应的 const DictItem&。
+     * \brief 获取 idx 对应的 const DictItem&，通过偏移表二分查找所在的 Query，复杂度 O(log q)。
      */
     const DictItem& operator[](size_t idx) const noexcept;
 
@@ -125,6 +150,11 @@ private:
      */
     void clear() noexcept;
 
+    /**
+     * \brief 取出所有 Query，之后 Candidates 为空。
+     */
+    std::vector<Query> take() noexcept;
+
     /**
      * \brief 将 Candidates 迭代器转换为内部 Query 和 Query 的结果索引。
      * \throws std::out_of_range 如果 it 无效。
@@ -137,10 +167,19 @@ private:
      */
     std::pair<QueryRef, size_t> to_query_and_index(size_t idx);
 
+    /**
+     * \brief 将 Candidates 索引转换为所在 Query 的位置，要求 idx 小于 size()。
+     */
+    size_t query_position(size_t idx) const noexcept;
+
     std::shared_ptr<std::vector<Query>> m_queries;
-    friend class IME;
+    // m_offsets[i] 为第 i 个 Query 之前的候选词数量，最后一个元素为候选词总数，与 m_queries 一同共享
+    std::shared_ptr<std::vector<size_t>> m_offsets;
+    friend class Session;
 };
 
+static_assert(std::random_access_iterator<Candidates::Iterator>);
+
 } // namespace pinyin_ime
 
 #endif // PINYIN_IME_CANDIDATES_H
\ No newline at end of file
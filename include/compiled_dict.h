@@ -0,0 +1,153 @@
+#ifndef PINYIN_IME_COMPILED_DICT_H
+#define PINYIN_IME_COMPILED_DICT_H
+
+#include <string_view>
+#include <span>
+#include <memory>
+#include <cstdint>
+#include "dict.h"
+#include "mapped_file.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 编译词库文件，即预先构建好的二进制词库，可以通过映射文件直接使用而无需解析。
+ * \details 文件由文件头和以下各段组成，各段按 8 字节对齐：
+ *              1. 音节表：按音节 ID 顺序排列的音节文本，DictItem 中的音节 ID 即其索引。
+ *              2. 字符串池：按 StringPool 块布局组织的中文文本，DictItem 中的 StringPool::Ref
+ *                 即文本在此段中的位置。
+ *              3. 字符串位置表：字符串池中所有文本的位置，用于 StringPool 建立索引。
+ *              4. DictItem 数组：按 acronym 分组，每组内已排序。
+ *              5. acronym 索引：按 acronym 字典序排列，记录每个 acronym 对应的 DictItem 范围。
+ *          文件格式与版本号 s_version、DictItem 的内存布局和字节序绑定，不符时拒绝加载。
+ */
+class CompiledDict {
+public:
+    static constexpr uint32_t s_version{ 1 };
+
+    /**
+     * \brief 映射并校验编译词库文件。
+     * \details 除索引结构外，还校验每个 DictItem：音节数量与所在 acronym 一致、音节 ID 在音节表范围内
+     *          且首字母与 acronym 相符、中文位置在字符串池段内。
+     * \param file 编译词库文件路径。
+     * \throws std::invalid_argument 如果文件格式或版本不符，或内容损坏。
+     *         std::runtime_error 如果读取文件发生错误。
+     */
+    explicit CompiledDict(std::string_view file);
+
+    /**
+     * \brief 判断文件是否为编译词库文件（仅检查文件头标识）。
+     */
+    static bool is_compiled(std::string_view file) noexcept;
+
+    /**
+     * \brief 将词典列表写入为编译词库文件。
+     * \details 先写入临时文件并落盘，再替换目标文件并将所在目录落盘。
+     * \param dicts 要写入的词典列表，空词典被忽略。
+     * \param file 编译词库文件路径。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    static void write(std::span<const Dict> dicts, std::string_view file);
+
+    /**
+     * \brief 获取音节数量。
+     */
+    size_t syllable_count() const noexcept;
+
+    /**
+     * \brief 获取文件中 ID 为 id 的音节。
+     */
+    std::string_view syllable(size_t id) const noexcept;
+
+    /**
+     * \brief 获取字符串池段的内容。
+     */
+    std::span<const char> strings() const noexcept;
+
+    /**
+     * \brief 获取字符串池中所有文本的位置。
+     */
+    std::span<const StringPool::Ref> string_refs() const noexcept;
+
+    /**
+     * \brief 获取文件中字符串池内给定位置的文本。
+     */
+    std::string_view string(StringPool::Ref ref) const noexcept;
+
+    /**
+     * \brief 获取 acronym 数量。
+     */
+    size_t acronym_count() const noexcept;
+
+    /**
+     * \brief 获取第 i 个 acronym。
+     */
+    std::string_view acronym(size_t i) const noexcept;
+
+    /**
+     * \brief 获取第 i 个 acronym 对应的、已排序的 DictItem 数组，直接指向映射的文件内容。
+     * \note DictItem 中的音节 ID 与中文位置是文件内的值，只有在 SyllableTable 与 StringPool
+     *       与文件一致时（见 IME::load()）才能直接访问其拼音与中文。
+     */
+    std::span<const DictItem> items(size_t i) const noexcept;
+private:
+    struct Section {
+        uint64_t m_offset;
+        uint64_t m_size;
+    };
+    struct Header {
+        char m_magic[8];
+        uint32_t m_version;
+        uint32_t m_byte_order;
+        uint32_t m_item_size;
+        uint32_t m_max_syllables;
+        uint32_t m_block_size;
+        uint32_t m_reserved;
+        Section m_syllables;
+        Section m_syllable_text;
+        Section m_strings;
+        Section m_string_refs;
+        Section m_items;
+        Section m_acronyms;
+        Section m_acronym_text;
+    };
+    struct TextEntry {
+        uint32_t m_offset;
+        uint32_t m_size;
+    };
+    struct AcronymEntry {
+        uint32_t m_text_offset;
+        uint32_t m_text_size;
+        uint32_t m_item_begin;
+        uint32_t m_item_count;
+    };
+    static constexpr char s_magic[8]{ 'P', 'Y', 'I', 'M', 'E', 'D', 'C', 'T' };
+    static constexpr uint32_t s_byte_order{ 0x01020304 };
+
+    template <class T>
+    std::span<const T> section(const Section &s) const;
+
+    /**
+     * \brief 判断字符串池中的位置是否在字符串池段内且不跨越块边界。
+     */
+    bool valid_ref(StringPool::Ref ref) const noexcept;
+
+    /**
+     * \brief 判断 acronym 中的 DictItem 是否有效，见 CompiledDict()。
+     */
+    bool valid_item(const DictItem &item, std::string_view acronym) const noexcept;
+
+    std::unique_ptr<MappedFile> m_file;
+    std::span<const TextEntry> m_syllables;
+    std::span<const char> m_syllable_text;
+    std::span<const char> m_strings;
+    std::span<const StringPool::Ref> m_string_refs;
+    std::span<const DictItem> m_items;
+    std::span<const AcronymEntry> m_acronyms;
+    std::span<const char> m_acronym_text;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_COMPILED_DICT_H
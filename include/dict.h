@@ -3,9 +3,13 @@
 
 #include <vector>
 #include <span>
+#include <memory>
+#include <memory_resource>
 #include <functional>
 #include "pinyin.h"
 #include "dict_item.h"
+#include "memory_usage.h"
+#include "dict_selection.h"
 
 namespace pinyin_ime {
 
@@ -16,11 +20,57 @@ namespace pinyin_ime {
  *              1. vector 中的 DictItem 有相同的 acronym。
  *              2. vector 中的 DictItem 是已排序的。
  *          同时提供词典层面的查找功能，以及对 DictItem 的频率修改功能。
+ *          Dict 也可以通过 share() 直接引用外部只读的 DictItem 数组（如映射的编译词库文件），
+ *          此时查询直接访问外部数组，仅在首次修改时将其拷贝为内部 vector（copy-on-write）。
+ *          freeze() 以同样的方式将内部 vector 转为多个拷贝共享的只读数组。
  */
 class Dict {
 public:
     using ItemCRefVec = std::vector<std::reference_wrapper<const DictItem>>;
+    using const_iterator = std::span<const DictItem>::iterator;
+    using allocator_type = std::pmr::polymorphic_allocator<DictItem>;
     static constexpr size_t s_npos{ std::numeric_limits<size_t>::max() };
+    // 建立音节索引所需的最少 DictItem 数量，更小的 Dict 直接扫描更快，见 build_index()
+    static constexpr size_t s_index_min_items{ 64 };
+
+    /**
+     * \brief 默认构造函数，DictItem 数组从默认内存资源分配。
+     */
+    Dict() = default;
+
+    /**
+     * \brief 构造函数，DictItem 数组从 alloc 的内存资源分配。
+     * \details Dict 是分配器感知（allocator-aware）的类型，BasicTrie 以 uses-allocator 方式构造 Dict，
+     *          使 DictItem 数组与词典树的节点使用同一内存资源。
+     */
+    explicit Dict(const allocator_type &alloc) noexcept;
+
+    /**
+     * \brief 拷贝构造，拷贝的 DictItem 数组从默认内存资源分配。
+     */
+    Dict(const Dict&) = default;
+
+    /**
+     * \brief 拷贝构造，拷贝的 DictItem 数组从 alloc 的内存资源分配。
+     * \throws std::exception 如果发生错误。
+     */
+    Dict(const Dict &other, const allocator_type &alloc);
+
+    Dict(Dict&&) noexcept = default;
+
+    /**
+     * \brief 移动构造，若 alloc 与 other 的内存资源不同，逐个移动 DictItem。
+     * \throws std::exception 如果发生错误。
+     */
+    Dict(Dict &&other, const allocator_type &alloc);
+
+    Dict& operator=(const Dict&) = default;
+    Dict& operator=(Dict&&) = default;
+
+    /**
+     * \brief 获取 DictItem 数组使用的分配器。
+     */
+    allocator_type get_allocator() const noexcept;
 
     /**
      * \brief 添加一个 DictItem，要求 DictItem 的 acronym 与词典一致，除非词典为空。
@@ -31,6 +81,15 @@ public:
      */
     bool add(DictItem item);
 
+    /**
+     * \brief 批量添加 DictItem，要求 DictItem 的 acronym 与词典一致（词典为空时以首个 DictItem 为准），
+     *        添加后统一排序一次。
+     * \param items 需要加入到 Dict 的 DictItem 列表。
+     * \throws std::logic_error 若 DictItem 的 acronym 不一致。
+     *         std::exception 如果发生错误。
+     */
+    void merge(std::span<const DictItem> items);
+
     /**
      * \brief 移除一个满足参数 Pred 的 DictItem。
      * \throws std::exception 如果发生错误。
@@ -38,9 +97,64 @@ public:
     template<class Pred>
     void erase(Pred pred)
     {
+        detach();
+        m_index.clear();
         std::erase_if(m_items, pred);
     }
 
+    /**
+     * \brief 将词典内容替换为外部只读 DictItem 数组，不进行拷贝。
+     * \param items 外部 DictItem 数组，要求 acronym 相同且已排序。
+     * \param owner items 的所有者，Dict 引用 items 期间会一直持有它。
+     * \throws std::exception 如果发生错误。
+     */
+    void share(std::span<const DictItem> items, std::shared_ptr<const void> owner);
+
+    /**
+     * \brief 将内部 vector 移入只读的共享数组，之后拷贝 Dict 只增加其引用计数，不拷贝 DictItem，
+     *        任一拷贝首次修改时才将其拷贝为内部 vector（copy-on-write）。
+     * \details 用于每次修改前整体拷贝的词库树（见 Engine 的用户词库），未修改的 Dict 在各个拷贝之间共享 DictItem 数组。
+     *          已经引用外部或共享数组时无效果。
+     * \throws std::exception 如果发生错误。
+     */
+    void freeze();
+
+    /**
+     * \brief 判断词典是否正在引用外部只读 DictItem 数组或共享数组，见 share()、freeze()。
+     */
+    bool is_shared() const noexcept;
+
+    /**
+     * \brief 以 remap 更新每个 DictItem 的中文在 StringPool 中的位置，用于压缩字符串池（见 StringPool::prepare_compact()）。
+     * \details 文本不变，DictItem 的顺序与音节索引保持不变。只比较与替换位置，不读取文本，
+     *          因此可以在提交压缩之前调用。引用外部数组时，只有位置改变才拷贝为内部 vector。
+     * \throws std::exception 如果发生错误。
+     */
+    void remap_chinese(const std::function<StringPool::Ref(StringPool::Ref)> &remap);
+
+    /**
+     * \brief 为每个音节位置建立按音节文本排序的 DictItem 索引，使 search() 先通过二分查找确定候选，
+     *        而不是扫描整个 Dict。
+     * \details 以同一前缀开头的音节在索引中是连续的，因此简拼的声母（包括 "zh"、"ch"、"sh"）、
+     *          未输入完的音节（如 "zhon"）与完整的音节都对应索引中的一个范围。
+     *          search() 选择范围最小的音节位置，只检查该范围内的 DictItem；范围不够小时仍然扫描整个 Dict。
+     *          索引从 DictItem 数组的内存资源分配，每个 DictItem 的每个音节占用 4 字节。
+     *          DictItem 少于 s_index_min_items 时不建立索引，修改 Dict 的操作会清除索引。
+     * \throws std::exception 如果发生错误。
+     */
+    void build_index();
+
+    /**
+     * \brief 判断是否已经建立音节索引，见 build_index()。
+     */
+    bool has_index() const noexcept;
+
+    /**
+     * \brief 统计词典的内存占用：内部 vector 的已用与空余容量、音节索引、引用的外部数组以及 acronym 的堆内存，
+     *        freeze() 得到的共享数组计为已使用的堆内存，不包括 Dict 对象本身与 DictItem 引用的文本。
+     */
+    MemoryUsage memory_usage() const noexcept;
+
     /**
      * \brief 获取拼音音节的首字母缩略词。
      * \return 指向内部 acronym 的 string_view，在 add_item() 后可能失效。
@@ -56,6 +170,20 @@ public:
      */
     void auto_inc_freq(std::span<size_t> item_indexes);
 
+    /**
+     * \brief 批量设置给定索引对应的 DictItem 的 freq，设置完成后统一排序一次。
+     * \param freqs 索引与新 freq 组成的列表，超出范围的索引被忽略。
+     * \note 与 auto_inc_freq() 相同，调用此函数后之前获取的关于 DictItem 的引用、索引不再可信。
+     * \throws std::exception 如果发生错误。
+     */
+    void set_freq(std::span<const std::pair<size_t, uint32_t>> freqs);
+
+    /**
+     * \brief 查找与给定 DictItem 为同一词条的 DictItem，见 DictItem::same_entry()。
+     * \return 若存在，返回其索引，否则返回 s_npos。
+     */
+    size_t find(const DictItem &item) const noexcept;
+
     /**
      * \brief 返回 DictItem 引用所对应的索引。
      * \param item 查询的 DictItem 的引用。
@@ -66,12 +194,12 @@ public:
     /**
      * \brief 封装接口，返回内部 vector<DictItem> 的 begin() const。
      */
-    std::vector<DictItem>::const_iterator begin() const noexcept;
+    const_iterator begin() const noexcept;
 
     /**
      * \brief 封装接口，返回内部 vector<DictItem> 的 end() const。
      */
-    std::vector<DictItem>::const_iterator end() const noexcept;
+    const_iterator end() const noexcept;
 
     /**
      * \brief 封装接口，返回内部 vector<DictItem> 的 size()。
@@ -100,6 +228,45 @@ public:
      */
     ItemCRefVec search(PinYin::TokenSpan tokens) const;
 
+    /**
+     * \brief 同 search(PinYin::TokenSpan)，同时返回结果是否为完全匹配。
+     * \param tokens 用于查找的 PinYin::TokenSpan。
+     * \param full_match 结果为完全匹配时设为 true，为仅开头匹配或为空时设为 false。
+     * \throws std::exception 如果发生错误。
+     */
+    ItemCRefVec search(PinYin::TokenSpan tokens, bool &full_match) const;
+
+    /**
+     * \brief 以与 search(PinYin::TokenSpan) 相同的规则，从已有的结果列表中筛选符合给定 TokenSpan 的 DictItem。
+     * \details 若 items 包含了所有与 tokens 开头匹配的 DictItem，筛选结果与重新调用 search() 相同，
+     *          可用于 Token 在尾部增加字符后缩小之前的查询结果，而不需要重新扫描 Dict。
+     * \param items 待筛选的结果列表。
+     * \param tokens 用于筛选的 PinYin::TokenSpan。
+     * \param full_match 结果为完全匹配时设为 true，为仅开头匹配或为空时设为 false。
+     * \throws std::exception 如果发生错误。
+     */
+    static ItemCRefVec filter(const ItemCRefVec &items, PinYin::TokenSpan tokens, bool &full_match);
+
+    /**
+     * \brief 同 search(PinYin::TokenSpan, bool&)，结果以 DictItem 索引的集合表示，不逐个保存引用。
+     * \param tokens 用于查找的 PinYin::TokenSpan。
+     * \param result 保存结果的集合，原有内容被清除，已分配的内存可以重复使用。
+     * \param full_match 结果为完全匹配时设为 true，为仅开头匹配或为空时设为 false。
+     * \throws std::exception 如果发生错误。
+     */
+    void search(PinYin::TokenSpan tokens, DictSelection &result, bool &full_match) const;
+
+    /**
+     * \brief 同 filter(const ItemCRefVec&, PinYin::TokenSpan, bool&)，从此 Dict 的索引集合 selection 中筛选。
+     * \param selection 待筛选的集合，不能与 result 为同一对象。
+     * \param tokens 用于筛选的 PinYin::TokenSpan。
+     * \param result 保存结果的集合，原有内容被清除。
+     * \param full_match 结果为完全匹配时设为 true，为仅开头匹配或为空时设为 false。
+     * \throws std::exception 如果发生错误。
+     */
+    void filter(const DictSelection &selection, PinYin::TokenSpan tokens,
+                DictSelection &result, bool &full_match) const;
+
     /**
      * \brief 查找符合给定 std::string_view 的 DictItem。
      * \param pinyin 用于查找的 std::string_view。
@@ -129,7 +296,38 @@ private:
      */
     void sort();
 
-    std::vector<DictItem> m_items;
+    /**
+     * \brief 获取当前的 DictItem 数组，即外部只读数组或内部 vector。
+     */
+    std::span<const DictItem> items() const noexcept;
+
+    /**
+     * \brief 若正在引用外部只读数组，将其拷贝为内部 vector 并释放对外部数组的引用。
+     * \param extra 拷贝时额外预留的 DictItem 数量，用于随后批量添加，避免再次扩容。
+     * \throws std::exception 如果发生错误。
+     */
+    void detach(size_t extra = 0);
+
+    /**
+     * \brief 通过音节索引确定可能与 tokens 匹配的 DictItem，以位图的形式写入 candidates。
+     * \return 若没有建立索引，或索引不能有效缩小范围（此时直接扫描更快），返回 false。
+     * \throws std::exception 如果发生错误。
+     */
+    bool index_candidates(PinYin::TokenSpan tokens, std::vector<uint64_t> &candidates) const;
+
+    /**
+     * \brief 返回音节索引中第 pos 个音节与 token 匹配的 DictItem 索引，要求已经建立音节索引。
+     * \details Initial 与 Extendible 类型的 Token 匹配以其开头的音节，其它类型匹配相同的音节。
+     */
+    std::span<const uint32_t> index_range(size_t pos, const PinYin::Token &token) const noexcept;
+
+    std::pmr::vector<DictItem> m_items;
+    // 音节索引，第 pos 个音节位置占用 [pos * size(), (pos + 1) * size())，按该位置的音节文本排序
+    std::pmr::vector<uint32_t> m_index;
+    std::span<const DictItem> m_shared_items;
+    std::shared_ptr<const void> m_shared_owner;
+    // 引用的是 freeze() 得到的堆内存数组，而不是外部只读内存
+    bool m_shared_heap{ false };
     // 词典 acronym，取自首个加入的 DictItem。
     std::string m_acronym;
 };
@@ -3,49 +3,124 @@
 
 #include <compare>
 #include <string>
-#include <vector>
+#include <span>
 #include <cstdint>
+#include <type_traits>
+#include "syllable_table.h"
+#include "string_pool.h"
 
 namespace pinyin_ime {
 
 /**
  * \brief 词典项，用于存储一个字/词的中文、拼音和频率。
- * 
+ *
  * \details 除了存储字词的中文、拼音、频率外，DictItem 构造时会根据解析拼音，获取拼音中的
  *          音节（syllable，即单个字的拼音）列表，比如中文 "输入法" 的拼音是 "shu'ru'fa"，包含
  *          三个音节 "shu"、"ru"、"fa"。
- *          音节列表可以通过 syllables() 获取。
+ *          拼音以音节 ID（见 SyllableTable）数组的形式内联存储，不保存拼音字符串，
+ *          pinyin() 会根据音节 ID 重新拼接出拼音字符串。
+ *          中文存放在 StringPool 中，DictItem 只保存其位置，因此 DictItem 是可平凡复制的，
+ *          可以直接按字节拷贝或序列化。
+ *          音节可以通过 syllable()、syllable_ids() 获取。
  *          通过 acronym() 可以获取音节首字母组成的缩略词，如 "shu'ru'fa" 的 acronym 为 "srf"。
  */
 class DictItem {
 public:
-    DictItem(std::string chinese, std::string pinyin, uint32_t freq);
-    DictItem(const DictItem &other);
-    DictItem(DictItem &&other);
-    DictItem& operator=(const DictItem &other);
-    DictItem& operator=(DictItem &&other);
+    using SyllableId = SyllableTable::Id;
+
+    /**
+     * \brief 一个 DictItem 最多包含的音节数量。
+     * \details 音节内联存储，超过此数量的词、句无法表示为 DictItem：加载文本词库与回放学习日志时跳过，
+     *          学习时不作为新句子保存，跳过的数量见 Engine::skipped_items()。
+     */
+    static constexpr size_t s_max_syllables{ 8 };
+
+    /**
+     * \brief 计算以 PinYin::s_delim 分割音节的拼音字符串中的音节数量，不分配音节 ID。
+     */
+    static size_t count_syllables(std::string_view pinyin) noexcept;
+
+    /**
+     * \brief 构造函数，中文会被加入 StringPool。
+     * \param chinese 中文。
+     * \param pinyin 以 PinYin::s_delim 分割音节的拼音字符串。
+     * \param freq 频率。
+     * \throws std::length_error 若音节数量超过 s_max_syllables，或中文无法加入 StringPool。
+     *         std::exception 如果发生错误。
+     */
+    DictItem(std::string_view chinese, std::string_view pinyin, uint32_t freq);
+
+    /**
+     * \brief 构造函数，直接使用已存在于 StringPool 中的中文和已分配的音节 ID。
+     * \param chinese 中文在 StringPool 中的位置。
+     * \param syllables 音节 ID 列表。
+     * \param freq 频率。
+     * \throws std::length_error 若音节数量超过 s_max_syllables。
+     */
+    DictItem(StringPool::Ref chinese, std::span<const SyllableId> syllables, uint32_t freq);
+    DictItem(const DictItem &other) = default;
+    DictItem(DictItem &&other) noexcept = default;
+    DictItem& operator=(const DictItem &other) = default;
+    DictItem& operator=(DictItem &&other) noexcept = default;
 
     std::string_view chinese() const noexcept;
-    void set_chinese(std::string chinese) noexcept;
+    void set_chinese(std::string_view chinese);
+
+    /**
+     * \brief 获取中文在 StringPool 中的位置，相同中文的 DictItem 位置相同。
+     */
+    StringPool::Ref chinese_ref() const noexcept;
 
-    std::string_view pinyin() const noexcept;
-    void set_pinyin(std::string pinyin);
+    /**
+     * \brief 根据音节 ID 拼接出拼音字符串，音节之间以 PinYin::s_delim 分割。
+     */
+    std::string pinyin() const;
+    void set_pinyin(std::string_view pinyin);
 
     uint32_t freq() const noexcept;
     void set_freq(uint32_t freq) noexcept;
 
     std::string acronym() const;
-    const std::vector<std::string_view>& syllables() const noexcept;
+
+    /**
+     * \brief 获取音节数量。
+     */
+    size_t syllable_count() const noexcept;
+
+    /**
+     * \brief 获取第 i 个音节的字符串视图，视图在程序运行期间始终有效。
+     */
+    std::string_view syllable(size_t i) const noexcept;
+
+    /**
+     * \brief 获取音节 ID 列表。
+     */
+    std::span<const SyllableId> syllable_ids() const noexcept;
+
+    /**
+     * \brief 判断两个 DictItem 是否为同一词条，即中文与音节均相同（不比较 freq）。
+     */
+    bool same_entry(const DictItem &other) const noexcept;
+
+    /**
+     * \brief 判断两个 DictItem 的 acronym 是否相同，逐音节比较首字母，不构造字符串。
+     */
+    bool same_acronym(const DictItem &other) const noexcept;
 
     std::strong_ordering operator<=>(const DictItem &other) const noexcept;
 private:
-    void build_syllables_view();
-    std::string m_chinese;
-    std::string m_pinyin;
+    void parse_pinyin(std::string_view pinyin);
+    // 成员布局没有填充字节，DictItem 可以按字节写入编译词库文件（见 CompiledDict）
+    StringPool::Ref m_chinese;
     uint32_t m_freq;
-    std::vector<std::string_view> m_syllables;
+    SyllableId m_syllables[s_max_syllables]{};
+    uint8_t m_syllable_count{ 0 };
+    uint8_t m_reserved[3]{};
 };
 
+static_assert(std::is_trivially_copyable_v<DictItem>);
+static_assert(sizeof(DictItem) == 32);
+
 } // namespace pinyin_ime
 
-#endif // PINYIN_IME_DICT_ITEM_H
\ No newline at end of file
+#endif // PINYIN_IME_DICT_ITEM_H
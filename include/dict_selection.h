@@ -0,0 +1,106 @@
+#ifndef PINYIN_IME_DICT_SELECTION_H
+#define PINYIN_IME_DICT_SELECTION_H
+
+#include <vector>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 一个 Dict 中被选中的 DictItem 的索引集合，用于表示查询结果而不逐个保存 DictItem 的引用。
+ * \details 索引按递增顺序加入，即保持 DictItem 在 Dict 中的顺序。集合以连续区间（run）的列表表示，
+ *          查询结果通常由少数几个连续区间组成（如按 acronym 查找的结果为整个 Dict），
+ *          占用的内存与区间数量成正比，而不是与结果数量成正比；当区间过于分散、区间列表比位图更大时，
+ *          改为以位图表示，并为每 64 位记录之前的元素数量，以支持按序号访问。
+ *          两种表示的按序号访问 index() 均为对数复杂度。
+ */
+class DictSelection {
+public:
+    /**
+     * \brief 默认构造函数，构造空集合，需要先调用 reset() 指定 Dict 的大小才能加入索引。
+     */
+    DictSelection() = default;
+
+    /**
+     * \brief 清空集合，并指定所属 Dict 的 DictItem 数量，之后加入的索引必须小于 dict_size。
+     * \details 保留已分配的内存。
+     */
+    void reset(size_t dict_size) noexcept;
+
+    /**
+     * \brief 清空集合，不改变所属 Dict 的大小，保留已分配的内存。
+     */
+    void clear() noexcept;
+
+    /**
+     * \brief 加入一个索引，要求大于之前加入的所有索引。
+     * \throws std::exception 如果发生错误。
+     */
+    void push_back(size_t idx);
+
+    /**
+     * \brief 返回集合中索引的数量。
+     */
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    /**
+     * \brief 判断集合是否为空。
+     */
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+    /**
+     * \brief 返回按递增顺序第 rank 个索引，要求 rank < size()。
+     */
+    size_t index(size_t rank) const noexcept;
+
+    /**
+     * \brief 按递增顺序对每个索引调用 f(idx)。
+     */
+    template <class F>
+    void for_each(F &&f) const
+    {
+        if (!m_bitmap) {
+            for (auto &run : m_runs) {
+                for (size_t idx{ run.m_begin }; idx < run.m_end; ++idx)
+                    f(idx);
+            }
+            return;
+        }
+        for (size_t word{ 0 }; word < m_bits.size(); ++word) {
+            for (auto bits{ m_bits[word] }; bits; bits &= bits - 1)
+                f(word * 64 + static_cast<size_t>(std::countr_zero(bits)));
+        }
+    }
+private:
+    struct Run {
+        uint32_t m_begin;
+        uint32_t m_end;
+        // 此区间之前的索引数量
+        uint32_t m_rank;
+    };
+
+    void to_bitmap();
+    void set_bit(size_t idx) noexcept;
+
+    std::vector<Run> m_runs;
+    std::vector<uint64_t> m_bits;
+    // m_word_ranks[i] 为第 i 个字之前的索引数量，只维护到最后一个非零字
+    std::vector<uint32_t> m_word_ranks;
+    size_t m_dict_size{ 0 };
+    size_t m_size{ 0 };
+    // 最后一个非零字的下一个位置
+    size_t m_word_end{ 0 };
+    bool m_bitmap{ false };
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_DICT_SELECTION_H
@@ -0,0 +1,78 @@
+#ifndef PINYIN_IME_DICT_WATCHER_H
+#define PINYIN_IME_DICT_WATCHER_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "engine.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 监视系统词库文件，文件更新后在后台线程中重新加载（见 Engine::reload()）。
+ * \details 监视的是文件所在的目录，因此以“写入临时文件再重命名”方式替换的文件
+ *          （如 IME::save_compiled()、dict_compiler 生成的文件）同样能被发现。
+ *          文件写入完成或被替换后，等待 s_settle_time 内不再有新的修改，才重新加载一次。
+ *          重新加载在监视线程中进行，完成后以一次快照交换发布，查询不会被阻塞。
+ * \note 仅支持 Linux（inotify），其它平台上构造时抛出 std::runtime_error。
+ */
+class DictWatcher {
+public:
+    // 文件修改后等待其稳定的时间
+    static constexpr std::chrono::milliseconds s_settle_time{ 100 };
+
+    /**
+     * \brief 重新加载失败时的回调，在监视线程中调用，参数为加载时抛出的异常。
+     */
+    using ErrorHandler = std::function<void(std::exception_ptr)>;
+
+    /**
+     * \brief 开始监视 dict_file，不立即加载。
+     * \param engine 重新加载的 Engine，不可为空。
+     * \param dict_file 词库文件路径，文本或编译词库均可。
+     * \param on_error 重新加载失败时的回调，为空时忽略错误，Engine 继续使用之前的词库。
+     * \throws std::invalid_argument 如果 engine 为空。
+     *         std::runtime_error 如果无法监视文件所在目录，或平台不支持。
+     *         std::exception 如果发生错误。
+     */
+    DictWatcher(std::shared_ptr<Engine> engine, std::string_view dict_file, ErrorHandler on_error = {});
+
+    DictWatcher(const DictWatcher&) = delete;
+    DictWatcher& operator=(const DictWatcher&) = delete;
+
+    /**
+     * \brief 停止监视，等待进行中的重新加载完成。
+     */
+    ~DictWatcher();
+
+    /**
+     * \brief 获取已成功重新加载的次数。
+     */
+    size_t reload_count() const noexcept;
+private:
+    /**
+     * \brief 监视线程的主循环。
+     */
+    void watch_loop() noexcept;
+
+    std::shared_ptr<Engine> m_engine;
+    std::string m_dict_file;
+    // 词库文件在其目录中的文件名，用于过滤目录中的事件
+    std::string m_file_name;
+    ErrorHandler m_on_error;
+    int m_inotify_fd{ -1 };
+    // 通知监视线程退出的 eventfd
+    int m_stop_fd{ -1 };
+    std::atomic<size_t> m_reload_count{ 0 };
+    // 最后构造，保证监视线程启动时其它成员均已初始化
+    std::thread m_thread;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_DICT_WATCHER_H
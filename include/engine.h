@@ -0,0 +1,512 @@
+#ifndef PINYIN_IME_ENGINE_H
+#define PINYIN_IME_ENGINE_H
+
+#include <string_view>
+#include <span>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include "trie.h"
+#include "dict.h"
+#include "pinyin.h"
+#include "journal.h"
+#include "ngram_model.h"
+#include "mpsc_queue.h"
+#include "stats.h"
+#include "memory_usage.h"
+
+namespace pinyin_ime {
+
+class CompiledDict;
+
+/**
+ * \brief 输入法引擎的共享部分，管理词库、学习日志与语言模型，可以被多个 Session 同时使用。
+ * \details 词库数据以不可变的快照（Snapshot）发布：系统词库树与用户词库树一经发布便不再修改，
+ *          Session 在一次输入过程中持有同一个快照，查询时不需要加锁。
+ *          加载词库、学习等写操作在内部串行执行，在拷贝上修改后原子地发布新的快照，
+ *          旧的快照在最后一个持有它的 Session 释放后销毁。
+ *          学习只修改用户词库树的共享拷贝，用户词库树的节点与 DictItem 数组在各个快照之间共享，
+ *          每批学习只复制被修改的 acronym 路径上的节点，代价与已学习的内容多少和系统词库大小无关。
+ *          学习在后台线程中进行：learn() 只将学习事件压入无锁队列后立即返回，
+ *          后台线程一次取走队列中的所有事件，在同一个拷贝上合并应用，每个受影响的 Dict
+ *          只重新排序一次，日志只提交一次，最后发布一个新的快照。flush() 等待之前的事件应用完毕。
+ *          所有公有接口都是线程安全的。
+ */
+class Engine {
+public:
+    // load_async() 第一阶段每个 acronym 加载的 DictItem 数量
+    static constexpr size_t s_default_head_size{ 2 };
+    // memory_usage() 默认报告的最大 Dict 数量
+    static constexpr size_t s_default_top_buckets{ 10 };
+
+    /**
+     * \brief 异步加载（见 load_async()）的阶段。
+     */
+    enum class LoadStage : uint8_t {
+        // 正在加载，尚未发布新的词库内容
+        Loading,
+        // 已发布每个 acronym 中频率最高的部分 DictItem，其余部分仍在加载
+        Partial,
+        // 加载完成，或未进行过异步加载
+        Complete,
+        // 加载失败，错误由 wait_load() 抛出
+        Failed
+    };
+
+    /**
+     * \brief 异步加载的进度。
+     */
+    struct LoadProgress {
+        LoadStage m_stage;
+        // 已发布的 DictItem 数量
+        size_t m_loaded_items;
+        // 词库文件中 DictItem 的总数，阶段为 Loading 时可能为 0
+        size_t m_total_items;
+    };
+
+    /**
+     * \brief 一个拼音前缀在两层词典树中对应的 Dict。
+     */
+    struct PrefixDicts {
+        size_t m_token_count;
+        const Dict *m_system_dict;
+        const Dict *m_user_dict;
+    };
+
+    /**
+     * \brief 某一时刻的词库数据，发布后只读。
+     */
+    struct Snapshot {
+        // 系统词库，加载后只读
+        std::shared_ptr<const BasicTrie<Dict>> m_system_trie;
+        // 用户词库，保存学习结果
+        std::shared_ptr<const BasicTrie<Dict>> m_user_trie;
+        // 语言模型，可以为空；其增量表在内部同步
+        std::shared_ptr<NGramModel> m_ngram;
+
+        /**
+         * \brief 对 tokens 的 acronym 在两层词典树中各进行一次公共前缀搜索，
+         *        按 Token 数量从多到少返回存在 Dict 的前缀。
+         * \param resource 结果与临时对象使用的内存资源，如 Session 独占的临时内存池。
+         * \throws std::exception 如果发生错误。
+         */
+        std::pmr::vector<PrefixDicts> prefix_dicts(
+            PinYin::TokenSpan tokens,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+        /**
+         * \brief 判断系统词库或用户词库中是否存在与 item 为同一词条的 DictItem。
+         */
+        bool contains_entry(const DictItem &item) const;
+    };
+
+    /**
+     * \brief 默认构造函数，词库为空。
+     */
+    Engine();
+
+    /**
+     * \brief 构造 Engine 对象，并通过 load() 加载词库文件。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    explicit Engine(std::string_view dict_file);
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    /**
+     * \brief 等待进行中的异步加载完成，应用所有已提交的学习事件，等待进行中的压缩完成。
+     */
+    ~Engine();
+
+    /**
+     * \brief 获取当前发布的快照。
+     */
+    std::shared_ptr<const Snapshot> snapshot() const noexcept;
+
+    /**
+     * \brief 获取各处理阶段的计数与耗时，见 Stats。
+     * \note 统计是进程范围的，包含所有 Engine 的计数；未启用 PINYIN_IME_STATS 时全部为零。
+     */
+    static Stats::Snapshot stats() noexcept;
+
+    /**
+     * \brief 将各处理阶段的计数与耗时清零，见 Stats::reset()。
+     */
+    static void reset_stats() noexcept;
+
+    /**
+     * \brief 获取当前快照中各子系统的内存占用，见 MemoryReport。
+     * \details 只读取已发布的不可变快照，不等待加载与学习，也不阻塞查询与写操作；
+     *          StringPool、SyllableTable、音节树与语言模型增量表只在统计期间短暂持有各自的锁。
+     * \param top_buckets 报告 DictItem 数组占用字节数最多的 Dict 的数量。
+     * \throws std::exception 如果发生错误。
+     */
+    MemoryReport memory_usage(size_t top_buckets = s_default_top_buckets) const;
+
+    /**
+     * \brief 从词库文件加载词典数据至系统词库树，见 IME::load()。
+     * \details 先等待进行中的异步加载完成，其错误不再抛出。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void load(std::string_view dict_file);
+
+    /**
+     * \brief 在后台线程中渐进地加载词库文件至系统词库树，立即返回。
+     * \details 加载分两个阶段：先为每个 acronym 只加载频率最高的 head_size 个 DictItem 并发布快照，
+     *          使常用词尽早可以输入；再加载全部 DictItem，发布替换第一阶段的快照。
+     *          加载期间的查询使用当时已发布的快照，Session 在空闲时切换到新的快照。
+     *          文本词库的第一阶段仍需扫描全部行，但只为保留的行构造 DictItem；
+     *          编译词库的第一阶段直接引用映射文件中每个 Dict 的开头部分。
+     *          先等待之前的异步加载完成，其错误不再抛出。
+     * \param head_size 第一阶段每个 acronym 加载的 DictItem 数量。
+     * \throws std::exception 如果无法启动后台线程。
+     */
+    void load_async(std::string_view dict_file, size_t head_size = s_default_head_size);
+
+    /**
+     * \brief 以词库文件替换系统词库，用于词库更新后的热加载。
+     * \details 与 load() 不同，新的系统词库树从空树开始构造，不保留之前加载的内容；
+     *          用户词库与语言模型不受影响。构造完成后以一次快照交换发布，查询不需要等待，
+     *          仍在使用旧快照的 Session、Query 与 CandidateStream 在释放前继续有效。
+     *          先等待进行中的异步加载完成，其错误不再抛出。
+     * \note 编译词库只有在任何其它词库之前加载时才能直接引用映射的文件内容（见 IME::load()），
+     *       重新加载时总是拷贝其内容。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void reload(std::string_view dict_file);
+
+    /**
+     * \brief 压缩进程范围的字符串池（见 StringPool::prepare_compact()），回收重新加载后不再使用的文本。
+     * \details 字符串池只追加，reload()、load_ngram() 等替换词库内容后，只在旧内容中出现的文本仍然保留。
+     *          压缩拷贝当前快照的词库树，更新其中 DictItem 与语言模型的文本位置后发布为新的快照，
+     *          代价与一次重新加载相当。只有以下条件都满足时才会压缩，否则直接返回 false：
+     *          - 上次压缩之后替换过系统词库或语言模型；
+     *          - 进程中只有这一个 Engine；
+     *          - 除 Engine 外没有任何对象持有快照，即没有存活的 Session、Query、CandidateStream 等；
+     *          - 没有尚未应用的学习事件。
+     *          进行中的加载与学习日志压缩会先等待其完成。
+     *          压缩期间获取快照会等待，因此压缩与新的 Session 不会交错。
+     * \warning 调用者需要保证没有在 Engine 之外保存 DictItem 或 StringPool::Ref（如自行解析的词库）。
+     * \return 是否进行了压缩。
+     * \throws std::exception 如果发生错误，此时快照、字符串池与语言模型都不变。
+     */
+    bool compact_strings();
+
+    /**
+     * \brief 在后台线程中执行 reload()，立即返回。
+     * \details 阶段与进度见 load_progress()，不经过 LoadStage::Partial；错误由 wait_load() 抛出。
+     * \throws std::exception 如果无法启动后台线程。
+     */
+    void reload_async(std::string_view dict_file);
+
+    /**
+     * \brief 获取最近一次异步加载的进度。
+     */
+    LoadProgress load_progress() const noexcept;
+
+    /**
+     * \brief 获取因音节数量超过 DictItem::s_max_syllables 而被跳过的词、句数量。
+     * \details 包括加载文本词库时跳过的行、回放学习日志时跳过的记录，以及学习时未作为新句子保存的选择序列，
+     *          自 Engine 构造起累计。被跳过的内容不影响其余内容的加载与学习。
+     */
+    size_t skipped_items() const noexcept;
+
+    /**
+     * \brief 等待进行中的异步加载完成。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果加载发生其它错误，每个错误只抛出一次。
+     */
+    void wait_load() const;
+
+    /**
+     * \brief 等待异步加载完成、学习事件应用完毕后，将系统词库与用户词库合并保存为词库文件。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     *         std::exception 如果异步加载发生错误。
+     */
+    void save(std::string_view dict_file) const;
+
+    /**
+     * \brief 等待异步加载完成、学习事件应用完毕后，将系统词库与用户词库合并保存为编译词库文件，
+     *        见 CompiledDict。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void save_compiled(std::string_view dict_file) const;
+
+    /**
+     * \brief 从文本词库文件加载词典数据至用户词库树。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void load_user(std::string_view dict_file);
+
+    /**
+     * \brief 等待学习事件应用完毕后，仅将用户词库保存为文本词库文件。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     */
+    void save_user(std::string_view dict_file) const;
+
+    /**
+     * \brief 打开学习日志并回放至用户词库树，见 IME::open_journal()。
+     * \throws std::invalid_argument 如果文件不是日志文件。
+     *         std::runtime_error 如果读写文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void open_journal(std::string_view journal_file);
+
+    /**
+     * \brief 等待学习事件应用完毕、进行中的压缩完成后关闭学习日志。
+     * \throws std::exception 如果压缩发生错误。
+     */
+    void close_journal();
+
+    /**
+     * \brief 在后台压缩学习日志，见 IME::compact()。
+     * \details 先等待学习事件应用完毕，快照不可变，后台线程直接读取当前快照的用户词库树。
+     * \throws std::exception 如果之前的压缩发生错误。
+     */
+    void compact(std::string_view dict_file);
+
+    /**
+     * \brief 等待进行中的压缩完成。
+     * \throws std::exception 如果压缩发生错误。
+     */
+    void wait_compaction();
+
+    /**
+     * \brief 将字符串形式的 DictItem 加入到用户词库树。
+     * \throws std::invalid_argument 如果 line 格式不符。
+     *         std::exception 如果发生错误。
+     */
+    void add_item_from_line(std::string_view line);
+
+    /**
+     * \brief 加载 n-gram 模型文件，见 NGramModel。
+     * \throws std::invalid_argument 如果文件格式或版本不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void load_ngram(std::string_view ngram_file);
+
+    /**
+     * \brief 提交一次输入的选择结果，由后台线程更新用户词库并发布新的快照。
+     * \details 立即返回，学习结果在之后发布的快照中可见，需要等待时调用 flush()。
+     * \param items 依次选择的 DictItem。
+     * \param inc_freq 是否自动增加已选择项的频率。
+     * \param add_new_sentence 是否根据已选择项自动添加新的词、句至词库，
+     *        音节总数超过 DictItem::s_max_syllables 的句子不会被添加，只计入 skipped_items()。
+     * \throws std::exception 如果发生错误。
+     */
+    void learn(std::span<const DictItem> items, bool inc_freq = true, bool add_new_sentence = true);
+
+    /**
+     * \brief 等待在此之前提交的所有学习事件应用完毕，其结果已在当前快照中。
+     * \throws std::exception 如果后台应用学习事件时发生错误，每个错误只抛出一次。
+     */
+    void flush() const;
+private:
+    /**
+     * \brief 学习事件，即一次输入的选择结果。
+     */
+    struct LearnEvent {
+        std::vector<DictItem> m_items;
+        bool m_inc_freq;
+        bool m_add_new_sentence;
+    };
+
+    /**
+     * \brief 后台学习线程的主循环，退出前应用队列中剩余的事件。
+     */
+    void learn_loop() noexcept;
+
+    /**
+     * \brief 在用户词库树的一个拷贝上依次应用一批学习事件，并发布新的快照。
+     * \throws std::exception 如果发生错误。
+     */
+    void apply_learn_events(std::span<const LearnEvent> events);
+
+    /**
+     * \brief 已打开的编译词库文件，音节与字符串池只在打开时处理一次，之后可以多次加入词库树。
+     */
+    struct CompiledSource {
+        std::shared_ptr<const CompiledDict> m_dict;
+        // 文件中的音节 ID 到 SyllableTable ID 的映射
+        std::vector<SyllableTable::Id> m_syllable_ids;
+        // 字符串池已挂载文件内容，DictItem 可以直接引用映射的文件内容
+        bool m_zero_copy;
+    };
+
+    /**
+     * \brief 一次加载加入的 DictItem 数量、文件中 DictItem 的总数与跳过的数量。
+     */
+    struct ItemCount {
+        size_t m_loaded;
+        size_t m_total;
+        // 因音节数量超过 DictItem::s_max_syllables 而跳过的 DictItem 数量
+        size_t m_skipped;
+    };
+
+    /**
+     * \brief 等待之前的异步加载完成后，重置进度并在后台线程中执行 task。
+     * \throws std::exception 如果无法启动后台线程。
+     */
+    void start_loading(std::function<void()> task);
+
+    /**
+     * \brief 在后台线程中执行 load_async() 的两个阶段。
+     * \throws std::exception 如果发生错误。
+     */
+    void load_progressively(const std::string &dict_file, size_t head_size);
+
+    /**
+     * \brief 在 base 的拷贝上加载全部词典数据并发布，base 为空指针时从空树开始，即替换系统词库。
+     * \details 调用者需持有 m_load_mutex，或作为 m_loading 在后台线程中执行。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void load_full(std::string_view dict_file, const BasicTrie<Dict> *base);
+
+    /**
+     * \brief 以 system_trie 替换当前快照中的系统词库树并发布。
+     */
+    void publish_system(std::shared_ptr<const BasicTrie<Dict>> system_trie);
+
+    /**
+     * \brief 映射编译词库文件，将其中的音节加入音节表，并尝试以文件内容挂载字符串池。
+     * \throws std::invalid_argument 如果文件格式或版本不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    static CompiledSource open_compiled(std::string_view dict_file);
+
+    /**
+     * \brief 将编译词库中每个 acronym 的前 head_size 个 DictItem 加入 dict_trie。
+     * \throws std::invalid_argument 如果文件内容损坏。
+     *         std::exception 如果发生错误。
+     */
+    static ItemCount load_compiled(const CompiledSource &source, BasicTrie<Dict> &dict_trie, size_t head_size);
+
+    /**
+     * \brief 解析文本词库文件，将每个 acronym 中频率最高的 head_size 个 DictItem 加入 dict_trie。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    static ItemCount load_text(std::string_view dict_file, BasicTrie<Dict> &dict_trie, size_t head_size);
+
+    /**
+     * \brief 拷贝词库树中的所有 Dict，共享外部数组的 Dict 不拷贝其内容。
+     * \throws std::exception 如果发生错误。
+     */
+    static std::vector<Dict> dicts(const BasicTrie<Dict> &dict_trie);
+
+    /**
+     * \brief 为词库树中的所有 Dict 建立音节索引（见 Dict::build_index()），在发布系统词库树之前调用。
+     * \details 用户词库在每次学习时拷贝后修改，且通常很小，不建立索引。
+     * \throws std::exception 如果发生错误。
+     */
+    static void build_indexes(BasicTrie<Dict> &dict_trie);
+
+    /**
+     * \brief 创建空的词库树。
+     * \details arena 为 true 时，词库树的节点、Dict 及其 DictItem 数组都从词库树独占的单调内存池
+     *          （std::pmr::monotonic_buffer_resource）中分配，随词库树一起整体释放。
+     *          系统词库树构造后只读，适合使用单调内存池；用户词库树在每次学习时拷贝后修改，使用默认的内存资源。
+     * \throws std::exception 如果发生错误。
+     */
+    static std::shared_ptr<BasicTrie<Dict>> make_trie(bool arena);
+
+    /**
+     * \brief 拷贝整个词库树，用于在发布新快照前修改，arena 的含义见 make_trie()。
+     * \details 引用外部或共享数组的 Dict 只拷贝引用，不拷贝 DictItem。
+     * \throws std::exception 如果发生错误。
+     */
+    static std::shared_ptr<BasicTrie<Dict>> clone(const BasicTrie<Dict> &dict_trie, bool arena = false);
+
+    /**
+     * \brief 构造与用户词库树 dict_trie 共享节点的拷贝（见 BasicTrie(const BasicTrie&, ShareTag)），代价为常数。
+     * \details 修改拷贝时只复制被修改的 acronym 路径上的节点数组及其中的 Dict 对象，
+     *          Dict 的 DictItem 数组已冻结（见 freeze_dicts()），复制 Dict 对象不拷贝 DictItem，
+     *          因此每批学习的代价只与其涉及的 Dict 相关，而不是与已学习的全部内容相关。
+     *          拷贝中被修改的 Dict 需要在发布前重新冻结。
+     * \throws std::exception 如果发生错误。
+     */
+    static std::shared_ptr<BasicTrie<Dict>> share(const BasicTrie<Dict> &dict_trie);
+
+    /**
+     * \brief 将词库树中所有 Dict 的 DictItem 数组转为共享数组（见 Dict::freeze()），
+     *        在发布整体拷贝（clone()）得到的用户词库树之前调用。
+     * \throws std::exception 如果发生错误。
+     */
+    static void freeze_dicts(BasicTrie<Dict> &dict_trie);
+
+    /**
+     * \brief 拷贝系统词库树中的所有 Dict，并将用户词库合并进拷贝。
+     * \throws std::exception 如果发生错误。
+     */
+    static std::vector<Dict> merged_dicts(const Snapshot &snapshot);
+
+    /**
+     * \brief 将词典列表写入为文本词库文件，先写入临时文件并落盘，再替换目标文件并将所在目录落盘。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     */
+    static void write_text(std::span<const Dict> dicts, std::string_view dict_file);
+
+    /**
+     * \brief 以给定的词库树与语言模型发布新的快照，调用者需持有 m_write_mutex。
+     */
+    void publish(std::shared_ptr<const BasicTrie<Dict>> system_trie,
+                 std::shared_ptr<const BasicTrie<Dict>> user_trie,
+                 std::shared_ptr<NGramModel> ngram);
+
+    // 进程中 Engine 的数量，只有一个 Engine 时才能压缩字符串池，见 compact_strings()
+    static std::atomic<size_t> s_instance_count;
+
+    // 只保护 m_snapshot 指针本身的读写
+    mutable std::mutex m_snapshot_mutex;
+    std::shared_ptr<const Snapshot> m_snapshot;
+    // 串行化所有写操作
+    std::mutex m_write_mutex;
+    // 替换系统词库或语言模型后置位，见 compact_strings()
+    std::atomic<bool> m_strings_replaced{ false };
+    std::shared_ptr<Journal> m_journal;
+    std::future<void> m_compaction;
+    // 串行化系统词库的加载，系统词库树只由加载修改
+    mutable std::mutex m_load_mutex;
+    mutable std::future<void> m_loading;
+    std::atomic<LoadStage> m_load_stage{ LoadStage::Complete };
+    std::atomic<size_t> m_loaded_items{ 0 };
+    std::atomic<size_t> m_total_items{ 0 };
+    // 见 skipped_items()
+    std::atomic<size_t> m_skipped_items{ 0 };
+    MpscQueue<LearnEvent> m_learn_queue;
+    // 已压入队列与已应用的事件数量，flush() 据此等待
+    std::atomic<uint64_t> m_learn_pushed{ 0 };
+    std::atomic<uint64_t> m_learn_applied{ 0 };
+    // 唤醒后台线程的信号，每次压入事件或停止时加一
+    std::atomic<uint64_t> m_learn_signal{ 0 };
+    std::atomic<bool> m_learn_stopping{ false };
+    mutable std::mutex m_learn_error_mutex;
+    mutable std::exception_ptr m_learn_error;
+    // 最后构造，保证后台线程启动时其它成员均已初始化
+    std::thread m_learner;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_ENGINE_H
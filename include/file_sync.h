@@ -0,0 +1,30 @@
+#ifndef PINYIN_IME_FILE_SYNC_H
+#define PINYIN_IME_FILE_SYNC_H
+
+#include <string_view>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 文件落盘工具，用于以"写临时文件、落盘、替换目标文件、落盘所在目录"的方式持久地替换文件。
+ * \details 词库文件、编译词库、语言模型与学习日志的重写都按此顺序进行，崩溃后只会看到替换前或替换后的完整文件。
+ */
+class FileSync {
+public:
+    /**
+     * \brief 将文件内容落盘（fsync），用于保证替换文件前新文件的持久性。
+     * \throws std::runtime_error 如果发生错误。
+     */
+    static void sync_file(std::string_view file);
+
+    /**
+     * \brief 将文件所在目录落盘，用于保证替换文件（rename）本身的持久性。
+     * \details 只有目录落盘后，崩溃后才能保证看到的是替换后的文件；Windows 上为空操作。
+     * \throws std::runtime_error 如果发生错误。
+     */
+    static void sync_parent_dir(std::string_view file);
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_FILE_SYNC_H
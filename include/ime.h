@@ -1,23 +1,23 @@
 #ifndef PINYIN_IME_IME_H
 #define PINYIN_IME_IME_H
 
-#include <ranges>
 #include <string_view>
-#include <cerrno>
-#include "trie.h"
-#include "dict.h"
-#include "pinyin.h"
-#include "candidates.h"
+#include <memory>
+#include "engine.h"
+#include "session.h"
+#include "keystroke_trace.h"
 
 namespace pinyin_ime {
 
 /**
  * \brief 输入法引擎（Input Method Engine）类，输入法库对外接口。
- * \details IME 管理着一个 PinYin 对象和一个 BasicTrie<Dict> 对象，其行为相当于 PinYin 对象的代理，
- *          对外部提供间接修改 PinYin 的接口（search()、push_back()、backspace()、choose()等），
- *          同时也是 PinYin 对象与 BasicTrie<Dict> 对象的中介，在 PinYin 对象发生改变后，
- *          根据 PinYin 对象的 Token 状态，前往 BasicTrie<Dict> 查询匹配的结果
- *          （借助 Query 类实现）并保存以供外部访问。
+ * \details IME 是 Engine 与 Session 的组合：Engine 管理词库（系统词库与用户词库两层）、
+ *          学习日志与语言模型，Session 管理拼音、候选词与已选择项等输入状态，IME 将接口转发给二者。
+ *          词库分为两层：系统词库由 load() 加载，加载后只读，可以直接引用映射的编译词库文件；
+ *          用户词库保存学习得到的频率与新词、句，以及 add_item_from_line() 添加的词条，
+ *          查询时两层的结果合并，用户词库中的词条覆盖系统词库中的同一词条。
+ *          学习只修改用户词库，其大小与学习内容相关，与系统词库大小无关。
+ *          需要同时服务多个用户时，可以让多个 IME（或 Session）共享同一个 Engine，词库只保存一份。
  * \note IME 是一个状态机，改变其状态（拼音/选择）后，若有之前保存的从 IME 获取到
  *       的 Candidates、Choice 等对象，均视为失效，不可继续使用。
  */
@@ -25,25 +25,20 @@ class IME {
 public:
 
     /**
-     * \brief 表明 IME 的一次选择，存有该选择对应的拼音 Token、Dict 以及 DictItem 在 Dict 的索引。
+     * \brief 表明 IME 的一次选择，见 Session::Choice。
      */
-    class Choice {
-    public:
-        PinYin::TokenSpan tokens() const noexcept;
-        std::string_view chinese() const noexcept;
-    private:
-        Choice(PinYin::TokenSpan tokens, Dict &dict, size_t index) noexcept;
-        PinYin::TokenSpan m_tokens;
-        Dict& m_dict;
-        size_t m_idx;
+    using Choice = Session::Choice;
 
-        friend class IME;
-    };
+    /**
+     * \brief 默认构造函数，创建一个词库为空的 Engine。
+     */
+    IME();
 
     /**
-     * \brief 默认构造函数。
+     * \brief 使用已有的 Engine 构造 IME，多个 IME 可以共享同一个 Engine。
+     * \throws std::invalid_argument 如果 engine 为空。
      */
-    IME() = default;
+    explicit IME(std::shared_ptr<Engine> engine);
 
     /**
      * \brief 构造 IME 对象，并通过 load() 从词库文件加载词典数据。
@@ -76,8 +71,10 @@ public:
     IME& operator=(IME&&) = delete;
 
     /**
-     * \brief 从词库文件加载词典数据至词库树。
-     * \details 词库文件为文本形式，每一行包含一个 DcitItem。
+     * \brief 从词库文件加载词典数据至系统词库树。
+     * \details 词库文件为文本形式，每一行包含一个 DcitItem；也可以是由 save_compiled() 生成的
+     *          编译词库文件（见 CompiledDict），此时不进行解析，若在加载任何其它词库之前加载，
+     *          词典直接引用映射的文件内容，仅在被修改时拷贝。
      * \param dict_file 词库文件路径。
      * \throws std::invalid_argument 如果文件内容格式不符。
      *         std::runtime_error 如果读取文件发生错误。
@@ -86,15 +83,127 @@ public:
     void load(std::string_view dict_file);
 
     /**
-     * \brief 将词典树 BasicTrie<Dict> 保存为词库文件。
-     * \details 词库文件为文本形式，每一行包含一个 DcitItem。
+     * \brief 在后台渐进地加载词库文件至系统词库树，立即返回，见 Engine::load_async()。
+     * \details 先发布每个 acronym 中频率最高的 head_size 个 DictItem，再发布全部 DictItem。
+     *          加载期间可以正常输入，开始新的输入（拼音为空）时使用最新发布的词库内容。
+     * \param dict_file 词库文件路径，格式同 load()。
+     * \param head_size 第一阶段每个 acronym 加载的 DictItem 数量。
+     * \throws std::exception 如果无法启动后台线程。
+     */
+    void load_async(std::string_view dict_file, size_t head_size = Engine::s_default_head_size);
+
+    /**
+     * \brief 以词库文件替换系统词库，见 Engine::reload()。
+     * \details 用户词库、学习日志与输入状态均保留，正在进行的输入在结束前继续使用旧的词库。
+     *          需要在文件更新时自动重新加载时，可以通过 engine() 构造 DictWatcher。
+     * \param dict_file 词库文件路径，格式同 load()。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void reload(std::string_view dict_file);
+
+    /**
+     * \brief 在后台执行 reload()，立即返回，见 Engine::reload_async()。
+     * \throws std::exception 如果无法启动后台线程。
+     */
+    void reload_async(std::string_view dict_file);
+
+    /**
+     * \brief 获取异步加载的阶段与进度，见 Engine::LoadProgress。
+     */
+    Engine::LoadProgress load_progress() const noexcept;
+
+    /**
+     * \brief 等待异步加载完成。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void wait_load();
+
+    /**
+     * \brief 将系统词库与用户词库合并后保存为词库文件。
+     * \details 词库文件为文本形式，每一行包含一个 DcitItem。先写入临时文件并落盘，再替换目标文件。
      * \param dict_file 词库文件路径。
      * \throws std::runtime_error 如果写入文件发生错误。
      */
     void save(std::string_view dict_file) const;
 
     /**
-     * \brief 将字符串形式的 DictItem 加入到词库树。
+     * \brief 将系统词库与用户词库合并后保存为编译词库文件，见 CompiledDict。
+     * \param dict_file 编译词库文件路径。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void save_compiled(std::string_view dict_file) const;
+
+    /**
+     * \brief 从文本词库文件加载词典数据至用户词库树，通常为 save_user() 或 compact() 保存的文件。
+     * \param dict_file 词库文件路径。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void load_user(std::string_view dict_file);
+
+    /**
+     * \brief 仅将用户词库保存为文本词库文件。
+     * \param dict_file 词库文件路径。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     */
+    void save_user(std::string_view dict_file) const;
+
+    /**
+     * \brief 打开学习日志，将日志中的记录回放至用户词库树，之后 finish_search() 的学习结果都会写入日志。
+     * \details 应该在加载系统词库与用户词库文件之后调用。后台每应用一批学习结果只向日志追加少量记录并提交一次，
+     *          不需要像 save() 一样重写整个词库，见 Journal。
+     * \param journal_file 日志文件路径，不存在则创建。
+     * \throws std::invalid_argument 如果文件不是日志文件。
+     *         std::runtime_error 如果读写文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void open_journal(std::string_view journal_file);
+
+    /**
+     * \brief 等待进行中的压缩完成后关闭学习日志。
+     * \throws std::exception 如果压缩发生错误。
+     */
+    void close_journal();
+
+    /**
+     * \brief 开始将之后的输入操作记录为按键轨迹，见 KeystrokeTrace。
+     * \details search()、push_back()、backspace()、choose(size_t)、choose(const SentenceComposer::Sentence&)、
+     *          finish_search() 与 reset_search() 被记录，每次 finish_search() 后写入文件。
+     *          choose(const CandidateStream::Entry&) 无法以索引表示，不被记录。
+     * \param trace_file 轨迹文件路径，已存在则清空。
+     * \throws std::runtime_error 如果打开文件发生错误。
+     */
+    void open_trace(std::string_view trace_file);
+
+    /**
+     * \brief 停止记录按键轨迹，写入缓冲的事件并关闭文件。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     */
+    void close_trace();
+
+    /**
+     * \brief 在后台压缩学习日志：将当前用户词库写入新的用户词库文件，之后丢弃已经合并进文件的日志记录。
+     * \details 后台线程读取当前发布的用户词库快照并写入文件，期间可以继续使用 IME。
+     *          若已有压缩在进行中，先等待其完成。未打开日志时仅在后台保存用户词库文件。
+     * \param dict_file 新的用户词库文件路径，通常为启动时通过 load_user() 加载的文件。
+     * \throws std::exception 如果之前的压缩发生错误。
+     */
+    void compact(std::string_view dict_file);
+
+    /**
+     * \brief 等待进行中的压缩完成。
+     * \throws std::exception 如果压缩发生错误。
+     */
+    void wait_compaction();
+
+    /**
+     * \brief 将字符串形式的 DictItem 加入到用户词库树。
      * \param line 文本形式的 DictItem。
      * \throws std::invalid_argument 如果 line 格式不符。
      *         std::exception 如果发生错误。
@@ -124,6 +233,55 @@ public:
      */
     const Candidates& choose(size_t idx);
 
+    /**
+     * \brief 选择由 candidate_stream() 产生的候选词，效果与 choose(size_t) 相同。
+     * \param entry 候选词，必须来自当前状态下获取的 CandidateStream。
+     * \return 新的当前候选词的 const 引用。
+     * \throws std::runtime_error 如果发生错误。
+     */
+    const Candidates& choose(const CandidateStream::Entry &entry);
+
+    /**
+     * \brief 获取当前未固定拼音的惰性候选词流，见 CandidateStream。
+     * \details 与 candidates() 不同，候选词按评分在所有拼音前缀之间统一排序，
+     *          查询仅在需要时执行，适合只显示第一页候选词的场景。
+     * \param scorer 评分函数，为空时使用 CandidateStream::default_score()。
+     * \throws std::exception 如果发生错误。
+     */
+    CandidateStream candidate_stream(CandidateStream::Scorer scorer = {}) const;
+
+    /**
+     * \brief 将当前未固定的拼音组合为整句，见 SentenceComposer。
+     * \details 词网在两次调用之间缓存，逐键输入时只查询新增或改变的部分。
+     * \param budget 构建词网的时间预算，超出时结果的 m_truncated 为 true。
+     * \throws std::exception 如果发生错误。
+     */
+    SentenceComposer::Sentence compose_sentence(std::chrono::microseconds budget = SentenceComposer::s_default_budget);
+
+    /**
+     * \brief 设置整句组合使用的二元代价函数，见 SentenceComposer::set_bigram_cost()。
+     */
+    void set_bigram_cost(SentenceComposer::BigramCost cost, size_t beam_width = SentenceComposer::s_default_beam_width);
+
+    /**
+     * \brief 加载 n-gram 模型文件（见 NGramModel），并以其二元代价作为整句组合的二元代价。
+     * \details 之后 finish_search() 的选择序列会记录到模型的增量表中。
+     * \param ngram_file 由 NGramModel::write() 生成的模型文件路径。
+     * \throws std::invalid_argument 如果文件格式或版本不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void load_ngram(std::string_view ngram_file);
+
+    /**
+     * \brief 选择由 compose_sentence() 产生的整句，按顺序将其中的每个词作为一次选择。
+     * \details 遇到没有词覆盖的段时停止，该段及之后的拼音保持未固定。
+     * \param sentence 整句，必须来自当前状态下的 compose_sentence()。
+     * \return 新的当前候选词的 const 引用。
+     * \throws std::runtime_error 如果发生错误。
+     */
+    const Candidates& choose(const SentenceComposer::Sentence &sentence);
+
     /**
      * \brief 尾添加拼音。
      * \param pinyin 需要添加的拼音字符串。
@@ -141,13 +299,21 @@ public:
     const Candidates& backspace(size_t count = 1);
 
     /**
-     * \brief 结束搜索，更新词库数据后重置搜索状态。
+     * \brief 结束搜索，提交学习结果后重置搜索状态，学习结果由后台线程应用。
      * \param inc_freq 是否自动增加已选择项的频率。
      * \param add_new_sentence 是否根据已选择项自动添加新的词、句至词库。
+     *        音节总数超过 DictItem::s_max_syllables 的句子无法保存，不会被添加，只计入 Engine::skipped_items()。
      * \throws std::exception 如果发生错误。
      */
     void finish_search(bool inc_freq = true, bool add_new_sentence = true);
 
+    /**
+     * \brief 等待之前 finish_search() 提交的学习结果应用完毕，见 Engine::flush()。
+     * \details 学习在后台线程中进行，结果在下一次开始输入时可见；需要立即可见时调用此函数。
+     * \throws std::exception 如果应用学习结果时发生错误。
+     */
+    void flush();
+
     /**
      * \brief 重置搜索状态，即清空 IME 的拼音、候选词、已选择项。
      */
@@ -189,25 +355,24 @@ public:
      */
     std::string_view unfixed_letters() const noexcept;
 
-private:
     /**
-     * \brief 真正的搜索实现函数。
-     * \details 根据给定的 TokenSpan 构造 Query 对象进行搜索，并将结果保存。
-     * \param tokens 要搜索的 TokenSpan。
-     * \return 搜索后，新的当前候选词的 const 引用。
+     * \brief 获取 IME 使用的 Engine。
      */
-    const Candidates& search_impl(PinYin::TokenSpan tokens);
+    const std::shared_ptr<Engine>& engine() const noexcept;
 
     /**
-     * \brief 将文本形式的 DictItem 转换为 DictItem 对象。
-     * \param line 一行文本形式的 DictItem 字符串，格式应该为"中文 频率/优先级 拼音"。
-     * \throws std::invalid_argument 如果 line 格式不符。
+     * \brief 获取 IME 的输入状态。
      */
-    DictItem line_to_item(std::string_view line);
-    PinYin m_pinyin;
-    BasicTrie<Dict> m_dict_trie;
-    Candidates m_candidates;
-    std::vector<Choice> m_choices;
+    Session& session() noexcept;
+private:
+    /**
+     * \brief 若正在记录按键轨迹，记录一个事件。
+     */
+    void record(KeystrokeTrace::Event event) noexcept;
+
+    std::shared_ptr<Engine> m_engine;
+    Session m_session;
+    std::unique_ptr<KeystrokeTrace> m_trace;
 };
 
 } // namespace pinyin_ime
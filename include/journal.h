@@ -0,0 +1,106 @@
+#ifndef PINYIN_IME_JOURNAL_H
+#define PINYIN_IME_JOURNAL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 只追加（append-only）的学习日志，记录 IME 学习产生的词库变化。
+ * \details 每次提交（commit()）只进行一次顺序写入和一次 fdatasync，代价与词库大小无关。
+ *          日志由文件头和若干记录组成，每条记录带有长度、校验和与递增的序号，
+ *          崩溃导致的不完整尾部记录会在打开日志时被截断。
+ *          记录是幂等的：SetFreq 记录保存的是 DictItem 学习后的频率而不是增量，
+ *          AddItem 记录仅在词库中没有相同 DictItem 时添加，因此重复回放已经合并进词库的记录不会改变结果，
+ *          压缩（见 IME::compact()）过程中任意时刻崩溃都不会造成重复学习。
+ *          所有接口都是线程安全的。
+ */
+class Journal {
+public:
+    enum class EventType : uint8_t {
+        SetFreq = 1, AddItem = 2
+    };
+
+    /**
+     * \brief 一条学习记录，DictItem 以中文和拼音字符串标识。
+     */
+    struct Event {
+        EventType m_type{ EventType::SetFreq };
+        std::string m_chinese;
+        std::string m_pinyin;
+        uint32_t m_freq{ 0 };
+        uint64_t m_seq{ 0 };
+    };
+
+    /**
+     * \brief 打开日志文件，不存在则创建，并截断不完整的尾部记录。
+     * \throws std::invalid_argument 如果文件不是日志文件。
+     *         std::runtime_error 如果打开、读取或写入文件发生错误。
+     */
+    explicit Journal(std::string_view file);
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal();
+
+    /**
+     * \brief 依次读取日志中的所有有效记录。
+     * \param f 对每条记录调用的函数。
+     * \throws std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    void replay(const std::function<void(const Event&)> &f) const;
+
+    /**
+     * \brief 将记录加入待提交缓冲区，为其分配序号。
+     * \return 记录的序号。
+     */
+    uint64_t append(Event event);
+
+    /**
+     * \brief 将缓冲区中的记录一次性写入文件并调用 fdatasync。
+     * \details 失败时截掉本次写入的内容并保留缓冲区，记录会在下次提交时重新写入；
+     *          如果截断也失败，日志进入损坏状态，之后的提交都会抛出异常，直到重新打开日志。
+     * \throws std::runtime_error 如果写入文件发生错误，或日志已处于损坏状态。
+     */
+    void commit();
+
+    /**
+     * \brief 获取最后分配的序号。
+     */
+    uint64_t last_seq() const noexcept;
+
+    /**
+     * \brief 丢弃序号不大于 seq 的记录，即它们已经被合并进词库文件。
+     * \details 以写临时文件再替换的方式重写日志，过程中的崩溃只会留下旧日志。
+     * \throws std::runtime_error 如果读写文件发生错误。
+     */
+    void discard_through(uint64_t seq);
+private:
+    static constexpr char s_magic[8]{ 'P', 'Y', 'I', 'M', 'E', 'J', 'N', 'L' };
+    static constexpr uint32_t s_version{ 1 };
+    static constexpr size_t s_header_size{ sizeof(s_magic) + sizeof(uint32_t) };
+
+    /**
+     * \brief 读取整个日志文件，返回有效记录及最后一条有效记录之后的文件偏移。
+     */
+    std::vector<Event> read_events(size_t &valid_size) const;
+    static void encode(const Event &event, std::string &out);
+    void open_file();
+    void close_file() noexcept;
+
+    std::string m_file;
+    int m_fd{ -1 };
+    std::string m_buffer;
+    uint64_t m_last_seq{ 0 };
+    bool m_broken{ false };
+    mutable std::mutex m_mutex;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_JOURNAL_H
@@ -0,0 +1,93 @@
+#ifndef PINYIN_IME_KEYSTROKE_TRACE_H
+#define PINYIN_IME_KEYSTROKE_TRACE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 按键轨迹：一次或多次输入过程中对 IME 的操作序列，用于回放并测量各操作的延迟。
+ * \details 轨迹为文本文件，每行一个事件：
+ *          push_back <letters>
+ *          backspace <count>
+ *          choose <index>
+ *          choose_sentence
+ *          finish_search <inc_freq> <add_new_sentence>  （取值为 0 或 1）
+ *          reset
+ *          空行与以 '#' 开头的行被忽略。
+ *          IME::search() 被记录为与其效果相同的 push_back、backspace 或 reset 事件（见 Session::search()）。
+ */
+class KeystrokeTrace {
+public:
+    enum class EventType : uint8_t {
+        PushBack, Backspace, Choose, ChooseSentence, FinishSearch, Reset
+    };
+    static constexpr size_t s_event_type_count{ 6 };
+
+    /**
+     * \brief 一个事件。m_value 对于 Backspace 为删除的字母数量，对于 Choose 为候选词索引，
+     *        对于 FinishSearch 为 s_inc_freq 与 s_add_new_sentence 的组合。
+     */
+    struct Event {
+        EventType m_type{ EventType::PushBack };
+        std::string m_letters;
+        size_t m_value{ 0 };
+    };
+    static constexpr size_t s_inc_freq{ 1 };
+    static constexpr size_t s_add_new_sentence{ 2 };
+
+    /**
+     * \brief 获取事件类型在轨迹文件中的名称。
+     */
+    static std::string_view type_name(EventType type) noexcept;
+
+    /**
+     * \brief 解析一行事件。
+     * \throws std::invalid_argument 如果格式不符。
+     */
+    static Event parse_line(std::string_view line);
+
+    /**
+     * \brief 将事件以一行文本写入 out，不含换行符。
+     */
+    static void write(std::ostream &out, const Event &event);
+
+    /**
+     * \brief 读取轨迹文件中的所有事件。
+     * \throws std::invalid_argument 如果文件内容格式不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     */
+    static std::vector<Event> read(std::string_view file);
+
+    /**
+     * \brief 创建（或清空）轨迹文件，开始记录。
+     * \throws std::runtime_error 如果打开文件发生错误。
+     */
+    explicit KeystrokeTrace(std::string_view file);
+
+    KeystrokeTrace(const KeystrokeTrace&) = delete;
+    KeystrokeTrace& operator=(const KeystrokeTrace&) = delete;
+
+    /**
+     * \brief 追加一个事件至缓冲区。
+     * \note 不抛出异常，写入错误在下一次 flush() 时报告。
+     */
+    void record(const Event &event) noexcept;
+
+    /**
+     * \brief 将缓冲的事件写入文件。
+     * \throws std::runtime_error 如果之前或本次写入文件发生错误。
+     */
+    void flush();
+private:
+    std::ofstream m_out;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_KEYSTROKE_TRACE_H
@@ -0,0 +1,41 @@
+#ifndef PINYIN_IME_MAPPED_FILE_H
+#define PINYIN_IME_MAPPED_FILE_H
+
+#include <string_view>
+#include <span>
+#include <vector>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 只读文件映射。
+ * \details 在支持 mmap 的平台上将整个文件以只读方式映射到内存，映射页由操作系统的页缓存管理，
+ *          多个进程映射同一文件时共享物理内存；在其它平台上退化为将文件完整读入内存。
+ *          映射在 MappedFile 析构时解除，通过 data() 获取的视图随之失效。
+ */
+class MappedFile {
+public:
+    /**
+     * \brief 映射文件。
+     * \param file 文件路径。
+     * \throws std::runtime_error 如果打开、读取或映射文件发生错误。
+     */
+    explicit MappedFile(std::string_view file);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /**
+     * \brief 获取文件内容的只读视图。
+     */
+    std::span<const char> data() const noexcept;
+private:
+    const char *m_data{ nullptr };
+    size_t m_size{ 0 };
+    bool m_mapped{ false };
+    std::vector<char> m_buffer;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_MAPPED_FILE_H
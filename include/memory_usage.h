@@ -0,0 +1,128 @@
+#ifndef PINYIN_IME_MEMORY_USAGE_H
+#define PINYIN_IME_MEMORY_USAGE_H
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 一个数据结构的内存占用。
+ * \details 字节数按元素大小与容器容量计算，不包含分配器自身的开销，哈希表按 libstdc++ 的节点布局估计。
+ */
+struct MemoryUsage {
+    // 节点数量：字典树为节点数组（NodeArray）数量，哈希表为节点数量，分块存储为块数量
+    size_t m_nodes{ 0 };
+    // 元素数量：Data 对象、DictItem、文本、音节等
+    size_t m_items{ 0 };
+    // 已使用的堆内存字节数
+    size_t m_used_bytes{ 0 };
+    // 已分配但未使用的堆内存字节数，如 vector 的空余容量、块尾部、字典树中的空节点
+    size_t m_unused_bytes{ 0 };
+    // 引用的外部只读内存（映射文件）字节数，不属于堆内存
+    size_t m_mapped_bytes{ 0 };
+
+    MemoryUsage& operator+=(const MemoryUsage &other) noexcept
+    {
+        m_nodes += other.m_nodes;
+        m_items += other.m_items;
+        m_used_bytes += other.m_used_bytes;
+        m_unused_bytes += other.m_unused_bytes;
+        m_mapped_bytes += other.m_mapped_bytes;
+        return *this;
+    }
+
+    /**
+     * \brief 统计 std::unordered_map 的内存占用，节点包含下一节点指针、元素与缓存的哈希值。
+     */
+    template <class Map>
+    static MemoryUsage hash_table(const Map &map) noexcept
+    {
+        constexpr size_t node_size{ sizeof(void*) + sizeof(typename Map::value_type) + sizeof(size_t) };
+        return {
+            map.size(), map.size(),
+            map.size() * node_size + map.bucket_count() * sizeof(void*),
+            0, 0
+        };
+    }
+};
+
+/**
+ * \brief Engine 的内存占用报告，按子系统与 acronym 分类，见 Engine::memory_usage()。
+ * \details 报告只遍历数据结构本身，不拷贝 DictItem，耗时与词典树中 Dict 的数量成正比，
+ *          可以在运行期间定期获取，用于观察学习导致的增长。
+ *          StringPool、SyllableTable 与音节树是进程范围的，同一进程中的所有 Engine 报告相同的值。
+ */
+struct MemoryReport {
+    enum class Subsystem : uint8_t {
+        // 系统词库树的节点数组与 Dict 对象
+        SystemTrie,
+        // 系统词库中 Dict 的 DictItem 数组
+        SystemDicts,
+        // 用户词库树的节点数组与 Dict 对象
+        UserTrie,
+        // 用户词库中 Dict 的 DictItem 数组
+        UserDicts,
+        // DictItem 的中文文本，见 StringPool
+        StringPool,
+        // 音节文本与索引，见 SyllableTable
+        SyllableTable,
+        // PinYin 使用的音节字典树
+        SyllableTrie,
+        // 语言模型，包括映射的模型文件与增量表
+        NGram
+    };
+    static constexpr size_t s_subsystem_count{ 8 };
+
+    /**
+     * \brief 一个 acronym 对应的 Dict。
+     */
+    struct Bucket {
+        std::string m_acronym;
+        // 是否为用户词库中的 Dict
+        bool m_user{ false };
+        size_t m_items{ 0 };
+        // DictItem 数组占用的字节数，包括空余容量与映射的内存
+        size_t m_bytes{ 0 };
+    };
+
+    std::array<MemoryUsage, s_subsystem_count> m_subsystems{};
+    // 用户词库中不存在于系统词库的词条数量，即学习或用户加入的词、句
+    size_t m_learned_items{ 0 };
+    // 按 m_bytes 从大到小排列的最大的 Dict
+    std::vector<Bucket> m_largest_buckets;
+
+    static std::string_view subsystem_name(Subsystem subsystem) noexcept;
+
+    /**
+     * \brief 获取子系统的内存占用。
+     */
+    const MemoryUsage& operator[](Subsystem subsystem) const noexcept
+    {
+        return m_subsystems[static_cast<size_t>(subsystem)];
+    }
+
+    MemoryUsage& operator[](Subsystem subsystem) noexcept
+    {
+        return m_subsystems[static_cast<size_t>(subsystem)];
+    }
+
+    /**
+     * \brief 汇总所有子系统的内存占用。
+     */
+    MemoryUsage total() const noexcept;
+
+    /**
+     * \brief 以文本表格的形式输出报告。
+     */
+    void write(std::ostream &out) const;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_MEMORY_USAGE_H
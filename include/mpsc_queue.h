@@ -0,0 +1,81 @@
+#ifndef PINYIN_IME_MPSC_QUEUE_H
+#define PINYIN_IME_MPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <utility>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 无锁的多生产者、单消费者队列。
+ * \details 生产者通过 CAS 将元素压入链表头部，不会相互阻塞；消费者通过一次原子交换
+ *          取走链表中的全部元素，再反转为先进先出的顺序。
+ *          消费者总是一次取走整条链表，因此不存在 ABA 问题。
+ */
+template <class T>
+class MpscQueue {
+public:
+    MpscQueue() = default;
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        delete_list(m_head.load(std::memory_order_acquire));
+    }
+
+    /**
+     * \brief 压入一个元素，可以被多个线程同时调用。
+     * \throws std::exception 如果发生错误。
+     */
+    void push(T value)
+    {
+        Node *node{ new Node{ std::move(value), m_head.load(std::memory_order_relaxed) } };
+        while (!m_head.compare_exchange_weak(node->m_next, node,
+                                             std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    /**
+     * \brief 按压入的顺序取走当前所有元素，只能由一个线程调用。
+     * \throws std::exception 如果发生错误。
+     */
+    std::vector<T> take_all()
+    {
+        Node *head{ m_head.exchange(nullptr, std::memory_order_acquire) };
+        std::vector<T> values;
+        for (Node *node{ head }; node; node = node->m_next)
+            values.push_back(std::move(node->m_value));
+        delete_list(head);
+        return { std::make_move_iterator(values.rbegin()), std::make_move_iterator(values.rend()) };
+    }
+
+    /**
+     * \brief 判断队列当前是否为空。
+     */
+    bool empty() const noexcept
+    {
+        return m_head.load(std::memory_order_acquire) == nullptr;
+    }
+private:
+    struct Node {
+        T m_value;
+        Node *m_next;
+    };
+
+    static void delete_list(Node *node) noexcept
+    {
+        while (node) {
+            Node *next{ node->m_next };
+            delete node;
+            node = next;
+        }
+    }
+
+    std::atomic<Node*> m_head{ nullptr };
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_MPSC_QUEUE_H
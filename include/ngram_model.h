@@ -0,0 +1,240 @@
+#ifndef PINYIN_IME_NGRAM_MODEL_H
+#define PINYIN_IME_NGRAM_MODEL_H
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <cstdint>
+#include "dict_item.h"
+#include "mapped_file.h"
+#include "memory_usage.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 词的一元、二元计数，用于生成 n-gram 模型文件（见 NGramModel::write()）。
+ * \details 词以中文文本区分，与拼音无关。
+ */
+class NGramCounts {
+public:
+    /**
+     * \brief 加入一个已分词的句子，句中每个词与相邻的下一个词组成一个二元组。
+     * \param words 句子中的词，空文本被忽略。
+     * \param count 该句子出现的次数。
+     * \throws std::exception 如果发生错误。
+     */
+    void add_sentence(std::span<const std::string_view> words, uint32_t count = 1);
+
+    /**
+     * \brief 获取词的数量。
+     */
+    size_t word_count() const noexcept;
+
+    /**
+     * \brief 获取不同二元组的数量。
+     */
+    size_t bigram_count() const noexcept;
+private:
+    uint32_t word_id(std::string_view word);
+
+    std::unordered_map<std::string, uint32_t> m_word_ids;
+    std::vector<std::string> m_words;
+    std::vector<uint64_t> m_unigrams;
+    // 键为 (前一个词 ID << 32 | 后一个词 ID)
+    std::unordered_map<uint64_t, uint64_t> m_bigrams;
+
+    friend class NGramModel;
+};
+
+/**
+ * \brief 紧凑的二元语言模型，为整句组合（见 SentenceComposer）提供上下文相关的代价。
+ * \details 模型由只读的基础模型与在线学习的增量表组成：
+ *          基础模型由 write() 根据 NGramCounts 生成，以映射文件的方式加载，不进行解析。
+ *          文件中的对数概率量化为 16 位整数（精度为 1 / s_quant_scale），每个词的后继词
+ *          按词 ID 排序存放在连续数组中，查询时二分查找；未出现的二元组回退到一元概率（绝对折扣插值）。
+ *          文件格式与版本号 s_version、字节序绑定，不符时拒绝加载。
+ *          增量表记录 observe() 观察到的二元组计数，以词中文在 StringPool 中的位置作为词 ID，
+ *          查询时与基础模型按增量计数插值，计数越多增量表的权重越大。
+ *          加载时将文件中每个词的中文加入 StringPool，并以其位置建立到文件词 ID 的索引，
+ *          因此查询 DictItem 只需计算哈希与一次二分查找。
+ * \note 线程安全，observe() 与查询可以在不同线程中同时进行。
+ */
+class NGramModel {
+public:
+    static constexpr uint32_t s_version{ 1 };
+    // 量化后的对数概率为 round(-log(p) * s_quant_scale)，上限为 UINT16_MAX
+    static constexpr double s_quant_scale{ 1024.0 };
+    // 模型中不存在的词的对数概率
+    static constexpr double s_unknown_log_prob{ -20.0 };
+
+    /**
+     * \brief 默认构造函数，基础模型为空。
+     */
+    NGramModel() = default;
+    NGramModel(const NGramModel&) = delete;
+    NGramModel& operator=(const NGramModel&) = delete;
+
+    /**
+     * \brief 映射并校验 n-gram 模型文件。
+     * \param file 模型文件路径。
+     * \throws std::invalid_argument 如果文件格式或版本不符。
+     *         std::runtime_error 如果读取文件发生错误。
+     *         std::exception 如果发生错误。
+     */
+    explicit NGramModel(std::string_view file);
+
+    /**
+     * \brief 判断文件是否为 n-gram 模型文件（仅检查文件头标识）。
+     */
+    static bool is_ngram_model(std::string_view file) noexcept;
+
+    /**
+     * \brief 根据计数估计概率并写入模型文件，先写入临时文件并落盘，再替换目标文件。
+     * \param counts 词的一元、二元计数。
+     * \param file 模型文件路径。
+     * \throws std::runtime_error 如果写入文件发生错误。
+     *         std::length_error 如果词或二元组数量超过文件格式上限。
+     *         std::exception 如果发生错误。
+     */
+    static void write(const NGramCounts &counts, std::string_view file);
+
+    /**
+     * \brief 获取 next 的一元对数概率。
+     */
+    double log_prob(const DictItem &next) const noexcept;
+
+    /**
+     * \brief 获取 prev 之后出现 next 的条件对数概率。
+     */
+    double log_prob(const DictItem &prev, const DictItem &next) const noexcept;
+
+    /**
+     * \brief 二元代价，即 log_prob(next) - log_prob(prev, next)，可用作 SentenceComposer::BigramCost。
+     * \details 整句组合的一元代价已经反映了 next 本身的频率，二元代价只需表示上下文带来的修正。
+     */
+    double bigram_cost(const DictItem &prev, const DictItem &next) const noexcept;
+
+    /**
+     * \brief 在增量表中记录一个依次选择的词序列。
+     * \throws std::exception 如果发生错误。
+     */
+    void observe(std::span<const DictItem> words);
+
+    /**
+     * \brief 以 StringPool 位置为键的词索引与增量表，见 remap_words()。
+     */
+    struct WordTables {
+        std::unordered_map<uint32_t, uint32_t> m_word_ids;
+        std::unordered_map<uint64_t, uint32_t> m_delta_bigrams;
+        std::unordered_map<uint32_t, uint32_t> m_delta_contexts;
+    };
+
+    /**
+     * \brief 将模型使用的所有词（基础模型与增量表）在 StringPool 中的偏移加入 offsets，
+     *        用于 StringPool::prepare_compact()。
+     * \throws std::exception 如果发生错误。
+     */
+    void collect_words(std::unordered_set<uint32_t> &offsets) const;
+
+    /**
+     * \brief 按字符串池压缩的映射（见 StringPool::Compaction::moved()）构造更新了偏移的词索引与增量表，
+     *        不在映射中的词保持不变，模型本身不变。
+     * \throws std::exception 如果发生错误。
+     */
+    WordTables remap_words(const std::unordered_map<uint32_t, StringPool::Ref> &moved) const;
+
+    /**
+     * \brief 以 remap_words() 的结果替换词索引与增量表，tables 得到原来的内容。
+     * \warning 调用期间不能有其它线程使用模型，且 remap_words() 之后增量表没有被修改。
+     */
+    void swap_words(WordTables &tables) noexcept;
+
+    /**
+     * \brief 获取基础模型中词的数量。
+     */
+    size_t word_count() const noexcept;
+
+    /**
+     * \brief 获取基础模型中二元组的数量。
+     */
+    size_t bigram_count() const noexcept;
+
+    /**
+     * \brief 获取增量表中二元组的数量。
+     */
+    size_t delta_bigram_count() const noexcept;
+
+    /**
+     * \brief 统计模型的内存占用：映射的模型文件计为映射内存，词索引与增量表按哈希表估计。
+     */
+    MemoryUsage memory_usage() const noexcept;
+private:
+    struct Section {
+        uint64_t m_offset;
+        uint64_t m_size;
+    };
+    struct Header {
+        char m_magic[8];
+        uint32_t m_version;
+        uint32_t m_byte_order;
+        Section m_words;
+        Section m_word_text;
+        Section m_unigrams;
+        Section m_successor_offsets;
+        Section m_successors;
+    };
+    struct TextEntry {
+        uint32_t m_offset;
+        uint32_t m_size;
+    };
+    struct Unigram {
+        uint16_t m_log_prob;
+        // 回退权重，即未出现的后继词分得的概率比例
+        uint16_t m_backoff;
+    };
+    struct Successor {
+        uint32_t m_word;
+        uint16_t m_log_prob;
+        uint16_t m_reserved;
+    };
+    static constexpr char s_magic[8]{ 'P', 'Y', 'I', 'M', 'E', 'N', 'G', 'M' };
+    static constexpr uint32_t s_byte_order{ 0x01020304 };
+    static constexpr uint32_t s_npos{ UINT32_MAX };
+    // 绝对折扣插值的折扣值
+    static constexpr double s_discount{ 0.5 };
+    // 增量表的插值权重为 c / (c + s_delta_weight)，c 为前一个词在增量表中作为上下文的次数
+    static constexpr double s_delta_weight{ 8.0 };
+
+    template <class T>
+    std::span<const T> section(const Section &s) const;
+
+    static uint16_t quantize(double log_prob) noexcept;
+    static double dequantize(uint16_t q) noexcept;
+
+    /**
+     * \brief 获取 item 在基础模型中的词 ID，不存在时返回 s_npos。
+     */
+    uint32_t word_id(const DictItem &item) const noexcept;
+
+    double base_log_prob(uint32_t prev, uint32_t next) const noexcept;
+
+    std::unique_ptr<MappedFile> m_file;
+    std::span<const Unigram> m_unigrams;
+    std::span<const uint32_t> m_successor_offsets;
+    std::span<const Successor> m_successors;
+    // StringPool 位置到基础模型词 ID 的索引
+    std::unordered_map<uint32_t, uint32_t> m_word_ids;
+    // 增量表，以 StringPool 位置为词 ID，键为 (前一个词 << 32 | 后一个词)
+    std::unordered_map<uint64_t, uint32_t> m_delta_bigrams;
+    std::unordered_map<uint32_t, uint32_t> m_delta_contexts;
+    mutable std::shared_mutex m_delta_mutex;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_NGRAM_MODEL_H
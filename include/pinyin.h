@@ -5,7 +5,9 @@
 #include <vector>
 #include <regex>
 #include <span>
+#include <memory_resource>
 #include <limits>
+#include <shared_mutex>
 #include "trie.h"
 
 namespace pinyin_ime {
@@ -53,6 +55,13 @@ public:
     using TokenSpan = std::span<const Token>;
 
     PinYin();
+
+    /**
+     * \brief 构造函数，分割 Token 时的临时对象从 scratch 分配。
+     * \param scratch 临时内存资源，如 Session 独占的内存池，需要在 PinYin 析构之后才销毁。
+     */
+    explicit PinYin(std::pmr::memory_resource *scratch);
+
     PinYin(std::string str);
     PinYin(const PinYin&) = delete;
     PinYin(PinYin&&) = delete;
@@ -182,6 +191,7 @@ public:
 
     /**
      * \brief 向 PinYin 类使用的音节字典树添加新音节，内部调用 BasicTrie<>::add_if_miss。
+     * \details 线程安全，可以与其它线程中 PinYin 对象的 Token 分割同时进行。
      * \throws std::exception 如果发生错误。
      */
     static void add_syllable(std::string_view syllable);
@@ -191,6 +201,11 @@ public:
      */
     static void remove_syllable(std::string_view syllable) noexcept;
 
+    /**
+     * \brief 统计音节字典树的内存占用，可以与音节的添加、删除同时进行。
+     */
+    static MemoryUsage syllable_trie_memory_usage();
+
     /**
      * \brief 拼音字符串中使用的分割符号
      */
@@ -203,17 +218,25 @@ private:
     TokenSpan update_tokens();
 
     using TokenVec = std::vector<Token>;
+    using ScratchTokenVec = std::pmr::vector<Token>;
     /**
      * \brief 辅助函数，获取当前状态所有合理的分割可能，供 update_tokens() 调用。
-     * \return 所有可能的分割方法（TokenVec 表示一个分割方案）列表。
+     * \param resource 结果与临时对象使用的内存资源。
+     * \return 所有可能的分割方法（ScratchTokenVec 表示一个分割方案）列表。
      */
-    std::vector<TokenVec> token_split_candidates() const;
+    std::pmr::vector<ScratchTokenVec> token_split_candidates(std::pmr::memory_resource *resource) const;
+
+    // 分割 Token 时一次性的小缓冲区大小，超出部分从 m_scratch 分配
+    static constexpr size_t s_split_buffer_size{ 1024 };
 
     TokenVec m_tokens;
     std::string m_pinyin;
     size_t m_fixed_tokens{ 0 },  m_fixed_letters{ 0 };
+    std::pmr::memory_resource *m_scratch{ std::pmr::get_default_resource() };
 
     static Trie s_syllable_trie;
+    // 分割 Token 时持有共享锁，添加、删除音节时持有独占锁
+    static std::shared_mutex s_syllable_mutex;
     static constexpr size_t s_capacity{ 128 };
 };
 
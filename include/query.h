@@ -1,40 +1,53 @@
 #ifndef PINYIN_IME_QUERY_H
 #define PINYIN_IME_QUERY_H
 
+#include <memory>
 #include "pinyin.h"
 #include "dict.h"
-#include "trie.h"
 
 namespace pinyin_ime {
 
 /**
- * \brief 负责从绑定的词典树 BasicTire<Dict> 中查询符合给定 PinYin::TokenSpan 的 DictItem。
+ * \brief 负责从绑定的系统词典与用户词典（均为 Dict）中查询符合给定 PinYin::TokenSpan 的 DictItem。
  * \note Query 只应在 IME 内部使用。
  * \details Query 对象供 IME 内部使用，其本身几乎不保存资源，而是保存对资源的引用，使用时需要谨慎：
- *              1. Query 对象以引用的形式绑定到 BasicTrie<Dict>，因此使用 Query 对象时必须
- *                 保证 BasicTrie<Dict> 的存在
+ *              1. Query 对象以指针的形式绑定到同一 acronym 的系统 Dict 与用户 Dict（可以为空），
+ *                 由 IME 在词典树中查找后传入，因此使用 Query 对象时必须保证 Dict 的存在；
+ *                 构造时可以传入 Dict 的所有者（如 Engine::Snapshot），Query 及其拷贝会一直持有它，
+ *                 使词库重新加载后仍在使用的 Query 继续引用旧的 Dict
  *              2. Query 对象查询所用的 PinYin::TokenSpan 来自于外部的 PinYin 对象，TokenSpan
  *                 的有效性需要外部保证，Query::tokens() 仅返回 Query 对象查询时保存的 TokenSpan。
- *              3. Query 对象在查询结束后，会记录找到的 Dict 对象的地址（Query::dict() 获取），
- *                 若该 Dict 对象不再存在，则 Query::dict() 返回的 Dict 对象地址不再有效。
- *              4. Query 对象在查询结束后，会保存 Dict::search() 返回的 ItemCRefVec
- *                 （一个vector，元素为reference_wrapper<const DictItem>），
- *                 若该 Dict 对象发生了修改，则 Query::items() 返回的查询结果不再有效。
+ *              3. Query 对象在查询结束后，以 DictSelection（Dict 中 DictItem 的索引集合）保存两层
+ *                 Dict::search() 的结果，以及用户词典结果在合并结果中的位置，访问时才通过索引得到 DictItem，
+ *                 若相应的 Dict 对象发生了修改，则查询结果不再有效。
+ *          合并时用户词典中的 DictItem 覆盖系统词典中的同一词条（见 DictItem::same_entry()），
+ *          合并结果保持 DictItem 的排序；若一层为完全匹配而另一层仅开头匹配，只保留完全匹配的结果。
+ *          查询结果占用的内存与结果中连续区间的数量（而不是 DictItem 的数量）成正比，见 DictSelection。
  */
 class Query {
 public:
     /**
-     * \brief 构造函数，仅绑定 BasicTrie<Dict>。
-     * \param dict_trie Query 对象绑定的 BasicTrie<Dict>。
+     * \brief 默认构造函数，不绑定 Dict。
      */
-    Query(BasicTrie<Dict> &dict_trie) noexcept;
+    Query() = default;
 
     /**
-     * \brief 构造函数，绑定 BasicTrie<Dict> 并立刻进行查询。
-     * \param dict_trie Query 对象绑定的 BasicTrie<Dict>。
+     * \brief 构造函数，仅绑定 Dict。
+     * \param system_dict Query 对象绑定的系统 Dict，可以为 nullptr。
+     * \param user_dict Query 对象绑定的用户 Dict，可以为 nullptr。
+     * \param owner Dict 的所有者，可以为空。
+     */
+    Query(const Dict *system_dict, const Dict *user_dict, std::shared_ptr<const void> owner = {}) noexcept;
+
+    /**
+     * \brief 构造函数，绑定 Dict 并立刻进行查询。
+     * \param system_dict Query 对象绑定的系统 Dict，可以为 nullptr。
+     * \param user_dict Query 对象绑定的用户 Dict，可以为 nullptr。
      * \param tokens 需要查询的 TokenSpan。
+     * \param owner Dict 的所有者，可以为空。
      */
-    Query(BasicTrie<Dict> &dict_trie, PinYin::TokenSpan tokens) noexcept;
+    Query(const Dict *system_dict, const Dict *user_dict, PinYin::TokenSpan tokens,
+          std::shared_ptr<const void> owner = {}) noexcept;
 
     /**
      * \brief 默认拷贝构造。
@@ -43,7 +56,7 @@ public:
 
     /**
      * \brief 移动构造。
-     * \details 移动后，other 依然绑定原 BasicTrie<Dict>，但是其它资源移动至此对象。
+     * \details 移动后，other 依然绑定原 Dict 并持有其所有者，但是其它资源移动至此对象。
      */
     Query(Query&& other) noexcept;
 
@@ -54,7 +67,7 @@ public:
 
     /**
      * \brief 移动赋值。
-     * \details 移动后，other 依然绑定原 BasicTrie<Dict>，但是其它资源移动至此对象。
+     * \details 移动后，other 依然绑定原 Dict 并持有其所有者，但是其它资源移动至此对象。
      */
     Query& operator=(Query &&other) noexcept;
 
@@ -62,22 +75,38 @@ public:
      * \brief 执行查询。
      * \param tokens 需要查询的 TokenSpan。
      * \return 查询成功返回 true，失败返回 false。
-     * \note 找到对应 Dict 对象即视为查询成功，匹配结果可以为空。
+     * \note 绑定了任一层 Dict 对象即视为查询成功，匹配结果可以为空。
      */
     bool exec(PinYin::TokenSpan tokens) noexcept;
 
     /**
-     * \brief 判断此对象是否已经执行过查询。
+     * \brief 以缩小上次查询结果的方式执行查询，不重新扫描 Dict。
+     * \details 要求 tokens 与上次查询的 TokenSpan 相比，仅最后一个 Token 在尾部增加了字符，
+     *          且上次查询的 Token 为 Initial 或 Extendible 类型。若上次的结果不是完整的开头匹配集合
+     *          （见 is_prefix_complete()），无法缩小，此时退化为 exec()。
      * \param tokens 需要查询的 TokenSpan。
      * \return 查询成功返回 true，失败返回 false。
-     * \note 找到对应 Dict 对象即视为查询成功，匹配结果可以为空。
      */
-    bool is_active() const noexcept;
+    bool narrow(PinYin::TokenSpan tokens) noexcept;
 
     /**
-     * \brief 返回此对象查询到的 Dict 对象地址。
+     * \brief 更新查询所用的 TokenSpan，不改变查询结果，要求 tokens 的内容与上次查询的 TokenSpan 相同。
      */
-    Dict* dict() const noexcept;
+    void rebind(PinYin::TokenSpan tokens) noexcept;
+
+    /**
+     * \brief 判断查询结果是否包含了所有与 TokenSpan 开头匹配的 DictItem，即结果不是完全匹配的结果，
+     *        此时在 Token 尾部增加字符后的查询结果是此结果的子集，见 narrow()。
+     */
+    bool is_prefix_complete() const noexcept;
+
+    /**
+     * \brief 判断此对象是否已经执行过查询。
+     * \param tokens 需要查询的 TokenSpan。
+     * \return 查询成功返回 true，失败返回 false。
+     * \note 找到对应 Dict 对象即视为查询成功，匹配结果可以为空。
+     */
+    bool is_active() const noexcept;
 
     /**
      * \brief 返回此对象查询所用的 TokenSpan。
@@ -85,9 +114,25 @@ public:
     PinYin::TokenSpan tokens() const noexcept;
 
     /**
-     * \brief 返回此对象查询结果的const引用。
+     * \brief 按合并结果的顺序对每个 DictItem 调用 f(const DictItem&)。
+     * \details 与逐个调用 operator[] 相比，不需要对每个元素查找位置。
      */
-    const Dict::ItemCRefVec& items() const noexcept;
+    template <class F>
+    void for_each(F &&f) const
+    {
+        size_t user_rank{ 0 };
+        size_t pos{ 0 };
+        auto flush_user = [&] {
+            for (; user_rank < m_user_positions.size() && m_user_positions[user_rank] == pos; ++user_rank, ++pos)
+                f((*m_user_dict)[m_user_items.index(user_rank)]);
+        };
+        flush_user();
+        m_system_items.for_each([&](size_t idx) {
+            f((*m_system_dict)[idx]);
+            ++pos;
+            flush_user();
+        });
+    }
 
     /**
      * \brief 返回此对象查询结果的 size()。
@@ -109,10 +154,21 @@ public:
      */
     void clear() noexcept;
 private:
-    std::reference_wrapper<BasicTrie<Dict>> m_dict_trie_ref;
-    Dict* m_dict{ nullptr };
+    /**
+     * \brief 应用两层结果的合并规则，并计算用户词典结果在合并结果中的位置。
+     * \param dedup 是否需要移除被用户词典覆盖的系统词典结果，筛选已合并的结果时不需要。
+     */
+    void merge_layers(bool system_full, bool user_full, bool dedup);
+
+    const Dict *m_system_dict{ nullptr };
+    const Dict *m_user_dict{ nullptr };
+    std::shared_ptr<const void> m_owner;
     PinYin::TokenSpan m_tokens;
-    Dict::ItemCRefVec m_items;
+    DictSelection m_system_items;
+    DictSelection m_user_items;
+    // 用户词典结果在合并结果中的位置，递增；用户词典结果通常很少
+    std::vector<uint32_t> m_user_positions;
+    bool m_prefix_complete{ false };
 };
 
 } // namespace pinyin_ime
@@ -0,0 +1,128 @@
+#ifndef PINYIN_IME_SENTENCE_COMPOSER_H
+#define PINYIN_IME_SENTENCE_COMPOSER_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "trie.h"
+#include "dict.h"
+#include "pinyin.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 整句组合器，在词网（word lattice）上搜索代价最小的整句转换结果。
+ * \details 词网的节点为 Token 之间的位置，边为从某个位置开始、覆盖若干个 Token 的词（DictItem），
+ *          由在两层词典树中的查询得到（规则同 Query）。每条边的代价为一元代价
+ *          s_word_cost - log(1 + freq)，可选的二元代价（BigramCost）作用于相邻两个词。
+ *          未设置二元代价时进行 Viterbi 搜索，设置后进行宽度为 beam_width 的束搜索。
+ *          没有任何词能够覆盖的 Token 以原拼音字母作为一段输出，代价为 s_unknown_cost。
+ *          词网按 Token 内容缓存：再次组合时，与上次的 Token 相比内容未改变的部分所对应的边
+ *          直接沿用，只查询新增或改变的部分，因此逐键输入时每次只需少量查询。
+ *          构建词网时先查询所有单个 Token 的边（保证存在整句结果），再按长度从短到长查询更长的边，
+ *          超出时间预算时停止查询更长的边，结果标记为 m_truncated，剩余的边在下次组合时继续查询。
+ * \note 组合器引用词典树中的 DictItem，词典树被修改后需要调用 reset()。
+ */
+class SentenceComposer {
+public:
+    using BigramCost = std::function<double(const DictItem &prev, const DictItem &next)>;
+
+    /**
+     * \brief 整句中的一段，m_item 为 nullptr 时表示没有词能够覆盖该段 Token。
+     */
+    struct Segment {
+        PinYin::TokenSpan m_tokens;
+        const DictItem *m_item{ nullptr };
+    };
+
+    /**
+     * \brief 整句组合结果。
+     */
+    struct Sentence {
+        std::string m_chinese;
+        std::vector<Segment> m_segments;
+        double m_cost{ 0 };
+        // 超出时间预算，部分较长的边未加入词网
+        bool m_truncated{ false };
+    };
+
+    // 一元代价的常数项，约为系统词库总频率的自然对数
+    static constexpr double s_word_cost{ 25.0 };
+    static constexpr double s_unknown_cost{ 2 * s_word_cost };
+    static constexpr size_t s_default_beam_width{ 8 };
+    static constexpr std::chrono::microseconds s_default_budget{ 2000 };
+
+    /**
+     * \brief 构造函数，绑定系统词典树与用户词典树。
+     */
+    SentenceComposer(const BasicTrie<Dict> &system_trie, const BasicTrie<Dict> &user_trie) noexcept;
+
+    /**
+     * \brief 设置二元代价函数，并清除缓存的词网。
+     * \param cost 二元代价函数，为空时只使用一元代价。
+     * \param beam_width 束搜索的宽度，即每个位置保留的部分路径数量，最小为 1。
+     */
+    void set_bigram_cost(BigramCost cost, size_t beam_width = s_default_beam_width);
+
+    /**
+     * \brief 组合整句。
+     * \param tokens 需要转换的 TokenSpan。
+     * \param budget 构建词网的时间预算，单个 Token 的边不受预算限制。
+     * \return 代价最小的整句，tokens 为空时返回空的 Sentence。
+     * \throws std::exception 如果发生错误。
+     */
+    Sentence compose(PinYin::TokenSpan tokens, std::chrono::microseconds budget = s_default_budget);
+
+    /**
+     * \brief 绑定新的系统词典树与用户词典树，并清除缓存的词网。
+     */
+    void rebind(const BasicTrie<Dict> &system_trie, const BasicTrie<Dict> &user_trie) noexcept;
+
+    /**
+     * \brief 清除缓存的词网。
+     */
+    void reset() noexcept;
+private:
+    struct Edge {
+        size_t m_length;
+        const DictItem *m_item;
+        double m_cost;
+    };
+
+    /**
+     * \brief 从某个位置开始的所有边，长度不超过 m_built_length 的边已经查询完毕。
+     */
+    struct Column {
+        std::vector<Edge> m_edges;
+        size_t m_built_length{ 0 };
+    };
+
+    /**
+     * \brief 将 tokens 与缓存的 Token 比较，丢弃覆盖了已改变 Token 的边，并缓存新的 Token。
+     */
+    void update_tokens(PinYin::TokenSpan tokens);
+
+    /**
+     * \brief 查询从 pos 开始、长度为 length 的边并加入词网。
+     */
+    void build_edges(PinYin::TokenSpan tokens, size_t pos, size_t length);
+
+    /**
+     * \brief 在已构建的词网上搜索代价最小的整句。
+     */
+    Sentence search(PinYin::TokenSpan tokens) const;
+
+    std::reference_wrapper<const BasicTrie<Dict>> m_system_trie_ref;
+    std::reference_wrapper<const BasicTrie<Dict>> m_user_trie_ref;
+    BigramCost m_bigram_cost;
+    size_t m_beam_width{ 1 };
+    std::vector<Column> m_columns;
+    // 上次组合的 Token，视图指向 m_letters
+    std::string m_letters;
+    std::vector<PinYin::Token> m_tokens;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_SENTENCE_COMPOSER_H
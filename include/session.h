@@ -0,0 +1,154 @@
+#ifndef PINYIN_IME_SESSION_H
+#define PINYIN_IME_SESSION_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include "engine.h"
+#include "pinyin.h"
+#include "candidates.h"
+#include "candidate_stream.h"
+#include "sentence_composer.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 一个用户的输入状态，包括拼音、候选词与已选择项，词库数据由共享的 Engine 提供。
+ * \details Session 只保存输入状态，构造开销很小，可以为每个用户创建一个并在结束后复用。
+ *          Session 在一次输入过程中持有 Engine 的同一个快照，Candidates、Choice 等引用的 Dict
+ *          在此期间始终有效；空闲时（拼音为空）开始新的输入或调用 reset_search() 时
+ *          才切换到 Engine 最新发布的快照。Candidates 中的 Query 与 candidate_stream() 返回的
+ *          CandidateStream 同样持有创建时的快照，词库重新加载后，在它们释放前旧快照不会被销毁。
+ *          接口含义与 IME 的同名接口相同。
+ * \note 单个 Session 不是线程安全的，不同的 Session 可以在不同线程中同时使用。
+ */
+class Session {
+public:
+    /**
+     * \brief 表明一次选择，存有该选择对应的拼音 Token 以及所选 DictItem 的拷贝。
+     */
+    class Choice {
+    public:
+        PinYin::TokenSpan tokens() const noexcept;
+        std::string_view chinese() const noexcept;
+        const DictItem& item() const noexcept;
+    private:
+        Choice(PinYin::TokenSpan tokens, const DictItem &item) noexcept;
+        PinYin::TokenSpan m_tokens;
+        DictItem m_item;
+
+        friend class Session;
+    };
+
+    /**
+     * \brief 构造函数。
+     * \param engine 共享的 Engine，不可为空。
+     * \throws std::invalid_argument 如果 engine 为空。
+     */
+    explicit Session(std::shared_ptr<Engine> engine);
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    /**
+     * \brief 获取 Session 使用的 Engine。
+     */
+    const std::shared_ptr<Engine>& engine() const noexcept;
+
+    const Candidates& candidates() const noexcept;
+    const Candidates& search(std::string_view pinyin);
+    const Candidates& choose(size_t idx);
+    const Candidates& choose(const CandidateStream::Entry &entry);
+    const Candidates& choose(const SentenceComposer::Sentence &sentence);
+    CandidateStream candidate_stream(CandidateStream::Scorer scorer = {}) const;
+    SentenceComposer::Sentence compose_sentence(std::chrono::microseconds budget = SentenceComposer::s_default_budget);
+
+    /**
+     * \brief 设置整句组合使用的二元代价函数，为空时使用 Engine 的语言模型（若已加载）。
+     */
+    void set_bigram_cost(SentenceComposer::BigramCost cost, size_t beam_width = SentenceComposer::s_default_beam_width);
+
+    const Candidates& push_back(std::string_view pinyin);
+
+    /**
+     * \brief 退格，删除拼音尾部未固定的 count 个字符。
+     * \details 已选择项及其固定的拼音不受影响，count 超过未固定字符的数量时只删除全部未固定字符，
+     *          没有未固定字符时不做任何修改，只返回当前的候选词。
+     * \throws std::exception 如果发生错误。
+     */
+    const Candidates& backspace(size_t count = 1);
+
+    /**
+     * \brief 结束搜索，由 Engine 学习已选择项后重置搜索状态。
+     * \details 已选择项的音节总数超过 DictItem::s_max_syllables 时，不会作为新句子添加，
+     *          只计入 Engine::skipped_items()，频率仍会增加。
+     * \throws std::exception 如果发生错误。
+     */
+    void finish_search(bool inc_freq = true, bool add_new_sentence = true);
+
+    /**
+     * \brief 重置搜索状态，并切换到 Engine 最新发布的快照（已固定快照时切换到固定的快照）。
+     */
+    void reset_search() noexcept;
+
+    /**
+     * \brief 固定 Session 使用的快照并重置搜索状态。
+     * \details 固定后 reset_search() 不再切换到 Engine 最新发布的快照，用于让一批输入使用同一个快照，
+     *          见 BatchConverter。snapshot 为空时取消固定，切换到 Engine 最新发布的快照。
+     */
+    void pin_snapshot(std::shared_ptr<const Engine::Snapshot> snapshot) noexcept;
+
+    const std::vector<Choice>& choices() const noexcept;
+    PinYin::TokenSpan tokens() const noexcept;
+    PinYin::TokenSpan fixed_tokens() const noexcept;
+    PinYin::TokenSpan unfixed_tokens() const noexcept;
+    std::string_view pinyin() const noexcept;
+    std::string_view fixed_letters() const noexcept;
+    std::string_view unfixed_letters() const noexcept;
+private:
+    /**
+     * \brief 切换到固定的快照或 Engine 最新发布的快照，快照改变时重新绑定整句组合器。
+     */
+    void refresh_snapshot() noexcept;
+
+    /**
+     * \brief 根据 m_bigram_cost 或快照中的语言模型设置整句组合器的二元代价。
+     */
+    void bind_bigram_cost();
+
+    /**
+     * \brief 选择 tokens 开头的 Token 对应的候选词 item，固定对应的 Token 并重新搜索。
+     * \throws std::logic_error 如果 Token 无法固定。
+     *         std::exception 如果发生错误。
+     */
+    const Candidates& choose_impl(PinYin::TokenSpan tokens, const DictItem &item);
+
+    /**
+     * \brief 真正的搜索实现函数，见 IME 中的说明。
+     */
+    const Candidates& search_impl(PinYin::TokenSpan tokens);
+
+    std::shared_ptr<Engine> m_engine;
+    std::shared_ptr<const Engine::Snapshot> m_snapshot;
+    // pin_snapshot() 固定的快照，为空时跟随 Engine
+    std::shared_ptr<const Engine::Snapshot> m_pinned_snapshot;
+    // 按键处理中的临时内存：Token 分割方案、前缀 Dict 列表等只在一次按键中使用的对象从中分配。
+    // 为 Session 独占，分配时不需要加锁，多个 Session 不会争用全局分配器；
+    // 释放的块留在池中供之后的按键复用，reset_search() 时整体归还
+    std::pmr::unsynchronized_pool_resource m_scratch;
+    PinYin m_pinyin;
+    Candidates m_candidates;
+    std::vector<Choice> m_choices;
+    // 上次搜索的拼音字符串拷贝及 Token，Token 视图指向该拷贝，用于与新的 Token 比较
+    std::string m_searched_letters;
+    std::vector<PinYin::Token> m_searched_tokens;
+    SentenceComposer m_composer;
+    SentenceComposer::BigramCost m_bigram_cost;
+    size_t m_beam_width{ SentenceComposer::s_default_beam_width };
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_SESSION_H
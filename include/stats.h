@@ -0,0 +1,136 @@
+#ifndef PINYIN_IME_STATS_H
+#define PINYIN_IME_STATS_H
+
+#include <array>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace pinyin_ime {
+
+/**
+ * \brief 各处理阶段的计数器与计时器，用于定位一次慢按键的耗时花在哪个阶段。
+ * \details 统计是进程范围的，同一进程中的所有 Engine、Session 共用一份计数。
+ *          计数器为 relaxed 原子变量，按线程分片存放在不同的缓存行中，多个线程同时计数时不会争用。
+ *          计时在 x86 上读取 TSC（时间戳计数器），其它平台使用 std::chrono::steady_clock，
+ *          单位为 tick，与秒的换算见 Snapshot::m_ticks_per_second。
+ *          阶段可以嵌套（如 DictSearch 发生在 CandidatesAssembly 中），各阶段的耗时与分配次数包含嵌套的阶段。
+ *          库本身不替换全局 operator new，需要统计分配次数时，由应用程序在替换的 operator new 中
+ *          调用 note_allocation()，示例见 common/alloc_counter.cpp。
+ * \note 仅在定义了 PINYIN_IME_STATS 时（CMake 选项 PINYIN_IME_STATS）启用，否则所有计数操作为空操作，
+ *       snapshot() 返回全零。
+ */
+class Stats {
+public:
+    enum class Stage : uint8_t {
+        // PinYin 切分 Token
+        Tokenize,
+        // 在词典树中查找 acronym 前缀对应的 Dict
+        AcronymLookup,
+        // 在 Dict 中匹配 Token
+        DictSearch,
+        // Session 根据查找结果组装候选词
+        CandidatesAssembly,
+        // 整句组合
+        SentenceCompose
+    };
+    static constexpr size_t s_stage_count{ 5 };
+
+    enum class Counter : uint8_t {
+        // Dict 匹配时检查的 DictItem 数量
+        ItemsScanned,
+        // Dict 匹配成功的 DictItem 数量
+        ItemsMatched,
+        // 词典树与音节树查找经过的节点数量
+        TrieNodesVisited,
+        // note_allocation() 报告的分配次数
+        Allocations
+    };
+    static constexpr size_t s_counter_count{ 4 };
+
+#ifdef PINYIN_IME_STATS
+    static constexpr bool s_enabled{ true };
+#else
+    static constexpr bool s_enabled{ false };
+#endif
+
+    struct StageStats {
+        uint64_t m_calls{ 0 };
+        uint64_t m_ticks{ 0 };
+        uint64_t m_allocations{ 0 };
+    };
+
+    /**
+     * \brief 某一时刻所有计数的汇总。
+     */
+    struct Snapshot {
+        std::array<StageStats, s_stage_count> m_stages{};
+        std::array<uint64_t, s_counter_count> m_counters{};
+        double m_ticks_per_second{ 0 };
+    };
+
+    /**
+     * \brief 在作用域内统计一个阶段的调用次数、耗时与分配次数。
+     */
+    class ScopedStage {
+    public:
+        explicit ScopedStage([[maybe_unused]] Stage stage) noexcept
+#ifdef PINYIN_IME_STATS
+            : m_stage{ stage }, m_start_allocations{ thread_allocations() }, m_start{ ticks() }
+#endif
+        {}
+
+        ScopedStage(const ScopedStage&) = delete;
+        ScopedStage& operator=(const ScopedStage&) = delete;
+
+        ~ScopedStage()
+        {
+#ifdef PINYIN_IME_STATS
+            finish_stage(m_stage, ticks() - m_start, thread_allocations() - m_start_allocations);
+#endif
+        }
+#ifdef PINYIN_IME_STATS
+    private:
+        Stage m_stage;
+        uint64_t m_start_allocations;
+        uint64_t m_start;
+#endif
+    };
+
+    static std::string_view stage_name(Stage stage) noexcept;
+    static std::string_view counter_name(Counter counter) noexcept;
+
+    /**
+     * \brief 增加计数器的值。
+     */
+    static void add([[maybe_unused]] Counter counter, [[maybe_unused]] uint64_t value = 1) noexcept
+    {
+#ifdef PINYIN_IME_STATS
+        add_slot(static_cast<size_t>(counter), value);
+#endif
+    }
+
+    /**
+     * \brief 报告一次内存分配，由应用程序替换的全局 operator new 调用。
+     */
+    static void note_allocation() noexcept;
+
+    /**
+     * \brief 汇总所有线程的计数。
+     */
+    static Snapshot snapshot() noexcept;
+
+    /**
+     * \brief 将所有计数清零。与计数同时进行时，清零期间的部分计数可能保留。
+     */
+    static void reset() noexcept;
+private:
+    static uint64_t ticks() noexcept;
+    static uint64_t thread_allocations() noexcept;
+    static void add_slot(size_t slot, uint64_t value) noexcept;
+    static void finish_stage(Stage stage, uint64_t ticks, uint64_t allocations) noexcept;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_STATS_H
@@ -0,0 +1,148 @@
+#ifndef PINYIN_IME_STRING_POOL_H
+#define PINYIN_IME_STRING_POOL_H
+
+#include <string_view>
+#include <span>
+#include <vector>
+#include <memory>
+#include <array>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include "memory_usage.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 字符串池，以只追加（append-only）的方式集中存放所有 DictItem 的中文文本。
+ * \details 相同的文本只会存放一次（interning），比如多音字 "行"（xing/hang）的多个 DictItem
+ *          共享同一段文本，DictItem 只需保存文本在池中的偏移和长度（见 StringPool::Ref）。
+ *          池由固定大小的块组成，已加入的文本不会被移动，view() 返回的视图在压缩（commit_compact()）之前始终有效。
+ *          池只追加：重新加载词库或语言模型时，已有的文本直接复用，只有新出现的文本加入池中，
+ *          不再使用的文本仍然保留，池的大小即进程中出现过的不同文本的总长度。
+ *          长期运行并反复加载内容变化的词库时，可以在没有其它使用者时压缩池回收
+ *          （见 Engine::compact_strings()）。
+ *          所有接口都是线程安全的，view() 不加锁。
+ */
+class StringPool {
+public:
+    /**
+     * \brief 文本在池中的位置，由 32 位偏移和 32 位长度组成。
+     */
+    struct Ref {
+        uint32_t m_offset{ 0 };
+        uint32_t m_size{ 0 };
+        bool operator==(const Ref&) const noexcept = default;
+    };
+
+    /**
+     * \brief 单个块的大小，也是单个文本允许的最大长度。
+     */
+    static constexpr size_t s_block_size{ 64 * 1024 };
+
+    /**
+     * \brief 将文本加入池中，若池中已有相同文本，直接返回其位置。
+     * \return 文本在池中的位置，空文本返回默认构造的 Ref。
+     * \throws std::length_error 若文本长度超过 s_block_size 或池已满。
+     *         std::exception 如果发生错误。
+     */
+    static Ref intern(std::string_view str);
+
+    /**
+     * \brief 批量将文本加入池中，只加锁一次，结果依次写入 refs。
+     * \throws std::logic_error 若 refs 的大小与 strs 不同。
+     *         std::length_error 若文本长度超过 s_block_size 或池已满。
+     *         std::exception 如果发生错误。
+     */
+    static void intern(std::span<const std::string_view> strs, std::span<Ref> refs);
+
+    /**
+     * \brief 获取位置对应的文本视图。
+     */
+    static std::string_view view(Ref ref) noexcept;
+
+    /**
+     * \brief 获取池中已存放文本的总字节数（包含块尾部未使用的空间）。
+     */
+    static size_t size() noexcept;
+
+    /**
+     * \brief 统计池的内存占用：节点为块，元素为文本；当前块尾部与哈希表的空槽计为未使用，
+     *        挂载的外部内存按块计为映射内存。
+     */
+    static MemoryUsage memory_usage() noexcept;
+
+    /**
+     * \brief 将外部只读内存（如映射的编译词库文件）作为池的起始部分，不进行拷贝。
+     * \details base 需要按照池的块布局组织，即任何文本都不跨越 s_block_size 边界，
+     *          base 中文本的 Ref 与池中的 Ref 相同。之后加入的文本存放在新的块中。
+     *          refs 为 base 中所有文本的位置，仅在之后首次调用 intern() 时用于建立索引。
+     * \param base 外部只读内存。
+     * \param refs base 中所有文本的位置。
+     * \param owner base 的所有者，池会一直持有它，保证 base 有效。
+     * \return 池为空时挂载成功返回 true，否则无效果并返回 false。
+     */
+    static bool attach(std::span<const char> base, std::span<const Ref> refs,
+                       std::shared_ptr<const void> owner);
+
+    /**
+     * \brief 压缩的准备结果，由 prepare_compact() 构造，commit_compact() 使之生效。
+     */
+    class Compaction {
+    public:
+        /**
+         * \brief 被移动的文本的原偏移到新位置的映射，不在其中的 Ref 保持不变。
+         */
+        const std::unordered_map<uint32_t, Ref>& moved() const noexcept;
+    private:
+        friend class StringPool;
+        std::vector<std::unique_ptr<char[]>> m_blocks;
+        size_t m_base_blocks{ 0 };
+        size_t m_block_used{ 0 };
+        std::vector<Ref> m_index;
+        size_t m_index_count{ 0 };
+        std::unordered_map<uint32_t, Ref> m_moved;
+        // 准备时池中的文本数量，用于检查准备之后池没有改变
+        size_t m_prepared_count{ 0 };
+    };
+
+    /**
+     * \brief 准备压缩池，只保留仍在使用的文本，池本身不变。
+     * \details 偏移在 live 中的文本依次拷贝到新的块中，并为其建立新的索引；挂载的外部内存中的文本位置不变，
+     *          外部内存中没有文本仍在使用时，提交后一并释放。所有分配都在此完成，
+     *          调用者可以先按 Compaction::moved() 准备好更新后的数据，再以不抛出异常的 commit_compact() 提交。
+     * \param live 仍在使用的文本的偏移（Ref::m_offset）。
+     * \throws std::exception 如果发生错误，此时池不变。
+     */
+    static Compaction prepare_compact(const std::unordered_set<uint32_t> &live);
+
+    /**
+     * \brief 提交 prepare_compact() 准备的压缩，原来的块全部释放。
+     * \warning 除 Compaction::moved() 中的映射外，之前的 Ref 与 view() 返回的视图全部失效。
+     *          调用者需要保证从准备到提交之后没有其它线程使用池，且所有仍在使用的 Ref 都在 live 中并按映射更新。
+     */
+    static void commit_compact(Compaction &compaction) noexcept;
+private:
+    static constexpr size_t s_max_blocks{ (size_t{ 1 } << 32) / s_block_size };
+
+    static Ref intern_locked(std::string_view str);
+    static void grow_index();
+    static void index_ref(Ref ref);
+
+    // 块指针数组大小固定，加入新块不会影响已有块的访问
+    static std::array<const char*, s_max_blocks> s_blocks;
+    static std::vector<std::unique_ptr<char[]>> s_owned_blocks;
+    static std::shared_ptr<const void> s_base_owner;
+    static std::span<const Ref> s_pending_refs;
+    static size_t s_block_count;
+    static size_t s_block_used;
+    // 开放寻址哈希表，空槽的 m_size 为 0
+    static std::vector<Ref> s_index;
+    static size_t s_index_count;
+    static std::mutex s_mutex;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_STRING_POOL_H
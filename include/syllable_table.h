@@ -0,0 +1,76 @@
+#ifndef PINYIN_IME_SYLLABLE_TABLE_H
+#define PINYIN_IME_SYLLABLE_TABLE_H
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include <limits>
+#include <cstdint>
+#include "memory_usage.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 音节表，为每个出现过的音节（syllable）分配一个 16 位 ID。
+ * \details DictItem 不再直接保存拼音字符串，而是保存音节 ID 列表，需要文本时再通过
+ *          SyllableTable 还原，从而使 DictItem 足够紧凑且可以被平凡地移动。
+ *          音节一旦加入就不会被移除，其 ID 与 syllable() 返回的视图在程序运行期间始终有效。
+ *          重新加载词库或语言模型时已有的音节直接复用，音节表只随新出现的不同音节增长，
+ *          正常的词库只包含有限的拼音音节（默认词库约 400 个），因此音节表不做压缩；
+ *          ID 用尽时 intern() 抛出 std::length_error。
+ *          所有接口都是线程安全的，syllable() 不加锁。
+ */
+class SyllableTable {
+public:
+    using Id = uint16_t;
+    static constexpr Id s_invalid_id{ std::numeric_limits<Id>::max() };
+
+    /**
+     * \brief 获取音节对应的 ID，若音节不存在则先加入音节表。
+     * \param syllable 音节字符串，不可为空。
+     * \return 音节对应的 ID。
+     * \throws std::logic_error 若 syllable 为空。
+     *         std::length_error 若音节表已满。
+     *         std::exception 如果发生错误。
+     */
+    static Id intern(std::string_view syllable);
+
+    /**
+     * \brief 查找音节对应的 ID。
+     * \return 音节对应的 ID，若音节不存在返回 s_invalid_id。
+     */
+    static Id find(std::string_view syllable) noexcept;
+
+    /**
+     * \brief 获取 ID 对应的音节字符串视图。
+     * \return 音节字符串视图，若 ID 无效返回空视图。
+     */
+    static std::string_view syllable(Id id) noexcept;
+
+    /**
+     * \brief 获取音节表中的音节数量。
+     */
+    static size_t size() noexcept;
+
+    /**
+     * \brief 统计音节表的内存占用：节点为已分配的块，块中尚未使用的音节位置计为未使用。
+     */
+    static MemoryUsage memory_usage() noexcept;
+private:
+    static constexpr size_t s_chunk_size{ 256 };
+    static constexpr size_t s_max_chunks{ (size_t{ s_invalid_id } + s_chunk_size - 1) / s_chunk_size };
+
+    // 音节按固定大小的块存放，块指针数组大小固定，加入新音节不会移动已有音节
+    static std::array<std::unique_ptr<std::string[]>, s_max_chunks> s_chunks;
+    static std::atomic<size_t> s_size;
+    static std::unordered_map<std::string_view, Id> s_ids;
+    static std::shared_mutex s_mutex;
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_SYLLABLE_TABLE_H
@@ -0,0 +1,80 @@
+#ifndef PINYIN_IME_TEXT_DICT_PARSER_H
+#define PINYIN_IME_TEXT_DICT_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include "dict_item.h"
+
+namespace pinyin_ime {
+
+/**
+ * \brief 文本词库解析器。
+ * \details 文本词库每一行包含一个 DictItem，格式为"中文 频率/优先级 拼音"。
+ *          拼音的音节数量超过 DictItem::s_max_syllables 的行无法表示为 DictItem，解析时跳过并计数，
+ *          不影响其余行的加载。
+ *          parse() 将整个词库按行边界切分为多个分块，由多个线程并行解析，解析过程中不为
+ *          每一行单独分配内存；解析结果按 acronym 分区，各分区再并行构造 DictItem 并排序，
+ *          最终得到按 acronym 分组且组内已排序的 DictItem 列表。
+ */
+class TextDictParser {
+public:
+    // parse() 的 head_size 取此值时保留全部 DictItem
+    static constexpr size_t s_all{ std::numeric_limits<size_t>::max() };
+
+    /**
+     * \brief 一行文本解析得到的字段，视图指向原始文本。
+     */
+    struct Line {
+        std::string_view m_chinese;
+        std::string_view m_pinyin;
+        uint32_t m_freq{ 0 };
+    };
+
+    /**
+     * \brief acronym 相同且已排序的一组 DictItem。
+     */
+    struct Bucket {
+        std::string m_acronym;
+        std::vector<DictItem> m_items;
+    };
+
+    /**
+     * \brief parse() 的结果。
+     */
+    struct Result {
+        // 按 acronym 分组的 DictItem 列表，分组之间没有特定顺序
+        std::vector<Bucket> m_buckets;
+        // 因音节数量超过 DictItem::s_max_syllables 而跳过的行数
+        size_t m_skipped{ 0 };
+    };
+
+    /**
+     * \brief 解析一行文本形式的 DictItem。
+     * \param line 一行文本形式的 DictItem 字符串，格式应该为"中文 频率/优先级 拼音"。
+     * \throws std::invalid_argument 如果 line 格式不符。
+     */
+    static Line parse_line(std::string_view line);
+
+    /**
+     * \brief 并行解析整个文本词库，文本开头的 UTF-8 BOM 会被忽略。
+     * \param text 文本词库内容。
+     * \param thread_count 使用的线程数量，为 0 时使用硬件支持的并发线程数量。
+     * \param head_size 每个 acronym 最多保留的 DictItem 数量，只保留频率最高者，
+     *        其余行仍会被校验格式，但不构造 DictItem。默认全部保留。
+     * \return 按 acronym 分组的 DictItem 列表及跳过的行数。
+     * \throws std::invalid_argument 如果文本内容格式不符。
+     *         std::exception 如果发生错误。
+     */
+    static Result parse(std::span<const char> text, size_t thread_count = 0, size_t head_size = s_all);
+private:
+    // 小于此大小的文本不再继续切分
+    static constexpr size_t s_min_chunk_size{ 64 * 1024 };
+};
+
+} // namespace pinyin_ime
+
+#endif // PINYIN_IME_TEXT_DICT_PARSER_H
@@ -3,20 +3,77 @@
 
 #include <string>
 #include <stack>
+#include <vector>
 #include <memory>
+#include <memory_resource>
+#include <atomic>
 #include <cassert>
 #include <utility>
 #include <stdexcept>
+#include "stats.h"
+#include "memory_usage.h"
 
 namespace pinyin_ime {
 
 /**
  * \brief 字典树（Trie）模板类，每个存在于树中的字符串都支持
  *        且必须绑定一个允许默认构造的类对象（即模板参数 Data）。
+ * \details 节点数组带有原子引用计数，多个 BasicTrie 可以共享节点（见 BasicTrie(const BasicTrie&, ShareTag)），
+ *          修改时只复制从根到被修改位置路径上的节点数组（path copying），未共享的 BasicTrie 不受影响。
  */
 template <class Data>
 class BasicTrie {
 public:
+    /**
+     * \brief 共享构造的标记类型，见 BasicTrie(const BasicTrie&, ShareTag)。
+     */
+    struct ShareTag {};
+    static constexpr ShareTag s_share{};
+
+    /**
+     * \brief 默认构造函数，节点与 Data 对象从默认内存资源（std::pmr::get_default_resource()）分配。
+     */
+    BasicTrie() = default;
+
+    /**
+     * \brief 构造函数，节点与 Data 对象从给定的内存资源分配，如单调内存池（std::pmr::monotonic_buffer_resource）。
+     * \param resource 内存资源，需要在 BasicTrie 析构之后才销毁。
+     */
+    explicit BasicTrie(std::pmr::memory_resource *resource) noexcept
+        : m_alloc{ resource }
+    {}
+
+    /**
+     * \brief 构造与 other 共享全部节点的 BasicTrie，不拷贝任何节点与 Data 对象，代价为常数。
+     * \details 之后通过 add_if_miss()、add()、add_or_assign()、remove() 修改任一方时，
+     *          只复制路径上仍被共享的节点数组及其中的 Data 对象，其余节点继续共享，双方互不影响。
+     *          共享的节点在最后一个引用它的 BasicTrie 析构时释放，各方可以在不同线程中析构。
+     * \warning 双方使用同一内存资源，该资源需要在所有共享方析构之后才销毁，因此不适用于随 BasicTrie 一起销毁的单调内存池。
+     *          共享期间不能通过 data() 或迭代器得到的引用修改 Data 对象，它们可能被其它 BasicTrie 共享。
+     */
+    BasicTrie(const BasicTrie &other, ShareTag) noexcept
+        : m_alloc{ other.m_alloc }, m_root_arr{ other.m_root_arr }
+    {
+        if (m_root_arr)
+            m_root_arr->m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    BasicTrie(const BasicTrie&) = delete;
+    BasicTrie& operator=(const BasicTrie&) = delete;
+
+    ~BasicTrie()
+    {
+        delete_array(m_root_arr);
+    }
+
+    /**
+     * \brief 获取分配节点与 Data 对象所用的内存资源。
+     */
+    std::pmr::memory_resource* resource() const noexcept
+    {
+        return m_alloc.resource();
+    }
+
     /**
      * \brief 字符串匹配结果，说明一个字符串在 BasicTrie 中匹配的程度。
      * \details Miss：字符串完全不在 BasicTrie 中。
@@ -42,27 +99,11 @@ public:
     template <class... Args>
     Data& add_if_miss(std::string_view str, Args&&... args)
     {
-        size_t str_size{ str.size() };
-        if (str_size == 0)
+        if (str.empty())
             throw std::logic_error{ "String is empty" };
-        if (!m_root_arr)
-            m_root_arr.reset(new NodeArray{});
-        NodeArray *arr{ m_root_arr.get() };
-        Node *node{ nullptr };
-        for (size_t i{ 0 }; i < str_size; ++i) {
-            node = &(arr->m_arr[std::abs(str[i] - NodeArray::s_base) % NodeArray::s_size]);
-            if (i == str_size - 1) {
-                if (node->m_data)
-                    break;
-                node->m_data.reset(new Data{ std::forward<Args>(args)... });
-                break;
-            } else {
-                if (!node->m_child_arr)
-                    node->m_child_arr.reset(new NodeArray{});
-                arr = node->m_child_arr.get();
-            }
-        }
-        assert(node);
+        Node *node{ unique_path(str) };
+        if (!node->m_data)
+            node->m_data = new_data(std::forward<Args>(args)...);
         return *(node->m_data);
     }
 
@@ -101,37 +142,39 @@ public:
     /**
      * \brief 从 BasicTrie 移除字符串。
      * \param str 要移除的字符串。
+     * \throws std::exception 如果复制共享的节点数组时发生错误，不与其它 BasicTrie 共享节点时不会抛出异常。
      */
-    void remove(std::string_view str) noexcept
+    void remove(std::string_view str)
     {
-        if (str.empty() || !m_root_arr)
+        if (!contains(str))
             return;
+        unique_path(str);
         NodeArray *parent{ nullptr };
-        NodeArray *arr{ m_root_arr.get() };
+        NodeArray *arr{ m_root_arr };
         size_t str_size{ str.size() };
         for (size_t i{ 0 }; i < str_size; ++i) {
             auto &node{ arr->m_arr[std::abs(str[i] - NodeArray::s_base) % NodeArray::s_size] };
             if (i == str_size - 1) {
                 if (!node.m_data)
                     return;
-                node.m_data.reset();
+                delete_data(node.m_data);
                 for (auto &n : arr->m_arr) {
                     if (n.m_child_arr || n.m_data)
                         return;
                 }
                 if (parent) {
                     for (auto &n : parent->m_arr) {
-                        if (n.m_child_arr.get() == arr)
-                            n.m_child_arr.reset();
+                        if (n.m_child_arr == arr)
+                            delete_array(n.m_child_arr);
                     }
                 } else {
-                    m_root_arr.reset();
+                    delete_array(m_root_arr);
                 }
             } else {
                 if (!node.m_child_arr)
                     return;
                 parent = arr;
-                arr = node.m_child_arr.get();
+                arr = node.m_child_arr;
             }
         }
     }
@@ -143,11 +186,12 @@ public:
     {
         if (str.empty() || !m_root_arr)
             return MatchResult::Miss;
-        NodeArray *arr{ m_root_arr.get() };
+        NodeArray *arr{ m_root_arr };
         size_t str_size{ str.size() };
         for (size_t i{ 0 }; i < str_size; ++i) {
             auto &node{ arr->m_arr[std::abs(str[i] - NodeArray::s_base) % NodeArray::s_size] };
             if (i == str_size - 1) {
+                Stats::add(Stats::Counter::TrieNodesVisited, str_size);
                 if (node.m_data) {
                     if (node.m_child_arr)
                         return MatchResult::Extendible;
@@ -160,9 +204,11 @@ public:
                         return MatchResult::Miss;
                 }
             } else {
-                if (!node.m_child_arr)
+                if (!node.m_child_arr) {
+                    Stats::add(Stats::Counter::TrieNodesVisited, i + 1);
                     return MatchResult::Miss;
-                arr = node.m_child_arr.get();
+                }
+                arr = node.m_child_arr;
             }
         }
         return MatchResult::Miss; // should not reach here
@@ -190,7 +236,7 @@ public:
     {
         if (str.empty() || !m_root_arr)
             throw std::logic_error{ "String invalid" };
-        NodeArray *arr{ m_root_arr.get() };
+        NodeArray *arr{ m_root_arr };
         size_t str_size{ str.size() };
         for (size_t i{ 0 }; i < str_size; ++i) {
             auto &node{ arr->m_arr[std::abs(str[i] - NodeArray::s_base) % NodeArray::s_size] };
@@ -201,12 +247,71 @@ public:
             } else {
                 if (!node.m_child_arr)
                     throw std::logic_error{ "String invalid" };
-                arr = node.m_child_arr.get();
+                arr = node.m_child_arr;
             }
         }
         throw std::logic_error{ "String invalid" }; // should not reach here
     }
 
+    /**
+     * \brief 公共前缀搜索：在一次自根向下的遍历中找出 str 所有存在于 BasicTrie 中的前缀。
+     * \param str 查询的字符串。
+     * \param f 按前缀长度从小到大，对每个存在的前缀调用 f(size_t prefix_size, Data &data)。
+     */
+    template <class F>
+    void common_prefix_search(std::string_view str, F &&f) const
+    {
+        NodeArray *arr{ m_root_arr };
+        size_t i{ 0 };
+        for (; arr && i < str.size(); ++i) {
+            auto &node{ arr->m_arr[std::abs(str[i] - NodeArray::s_base) % NodeArray::s_size] };
+            if (node.m_data)
+                f(i + 1, *(node.m_data));
+            arr = node.m_child_arr;
+        }
+        Stats::add(Stats::Counter::TrieNodesVisited, i);
+    }
+
+    /**
+     * \brief 统计 BasicTrie 的内存占用：节点数组与 Data 对象本身的大小，
+     *        节点数组中既没有子节点也没有 Data 的节点计为未使用的空间。
+     * \param f 对每个 Data 对象调用 f(const Data &data)，用于统计 Data 自身持有的内存。
+     */
+    template <class F>
+    MemoryUsage memory_usage(F &&f) const
+    {
+        MemoryUsage usage;
+        std::vector<const NodeArray*> arrs;
+        if (m_root_arr)
+            arrs.push_back(m_root_arr);
+        while (!arrs.empty()) {
+            auto arr{ arrs.back() };
+            arrs.pop_back();
+            ++usage.m_nodes;
+            for (auto &node : arr->m_arr) {
+                if (node.m_child_arr)
+                    arrs.push_back(node.m_child_arr);
+                if (node.m_data) {
+                    ++usage.m_items;
+                    f(static_cast<const Data&>(*node.m_data));
+                }
+                if (!node.m_child_arr && !node.m_data)
+                    usage.m_unused_bytes += sizeof(Node);
+            }
+        }
+        usage.m_used_bytes = usage.m_nodes * sizeof(NodeArray) - usage.m_unused_bytes
+                           + usage.m_items * sizeof(Data);
+        return usage;
+    }
+
+    /**
+     * \brief 统计 BasicTrie 的内存占用，不包括 Data 自身持有的内存。
+     */
+    MemoryUsage memory_usage() const
+    {
+        return memory_usage([](const Data&) {});
+    }
+
     /**
      * \brief 判断 BasicTrie 是否为空。
      */
@@ -217,13 +322,15 @@ public:
 
     struct NodeArray;
     struct Node {
-        std::unique_ptr<NodeArray> m_child_arr;
-        std::unique_ptr<Data> m_data;
+        NodeArray *m_child_arr{ nullptr };
+        Data *m_data{ nullptr };
     };
     struct NodeArray {
         static constexpr char s_base{ 'a' };
         static constexpr size_t s_size{ 26 };
         Node m_arr[s_size];
+        // 引用此节点数组的父节点或 BasicTrie 根的数量，大于 1 时被多个 BasicTrie 共享
+        std::atomic<size_t> m_refs{ 1 };
     };
 
     /**
@@ -243,7 +350,7 @@ public:
         {
             if (!m_arr)
                 throw std::logic_error{ "Iterator invalid" };
-            return m_arr->m_arr[m_idx].m_data.get();
+            return m_arr->m_arr[m_idx].m_data;
         }
 
         std::string string() const
@@ -271,7 +378,7 @@ public:
 
                 auto &node{ m_arr->m_arr[m_idx] };
                 if (node.m_child_arr)
-                    m_stack.push({ node.m_child_arr.get(), 0, m_prefix + static_cast<char>(m_idx + NodeArray::s_base) });
+                    m_stack.push({ node.m_child_arr, 0, m_prefix + static_cast<char>(m_idx + NodeArray::s_base) });
 
                 if (node.m_data)
                     break;
@@ -317,13 +424,13 @@ public:
         if (!m_root_arr)
             return iter;
         if (m_root_arr->m_arr[0].m_data) {
-            iter.m_arr = m_root_arr.get();
-            iter.m_stack.push({ m_root_arr.get(), 1, "" });
+            iter.m_arr = m_root_arr;
+            iter.m_stack.push({ m_root_arr, 1, "" });
             if (m_root_arr->m_arr[0].m_child_arr) {
-                iter.m_stack.push({ m_root_arr->m_arr[0].m_child_arr.get(), 0, "a" });
+                iter.m_stack.push({ m_root_arr->m_arr[0].m_child_arr, 0, "a" });
             }
         } else {
-            iter.m_stack.push({ m_root_arr.get(), 0, "" });
+            iter.m_stack.push({ m_root_arr, 0, "" });
             ++iter;
         }
         return iter;
@@ -353,30 +460,114 @@ private:
     template <class... Args>
     Data& add_or_assign(std::string_view str, bool assign, Args&&... args)
     {
-        size_t str_size{ str.size() };
-        if (str_size == 0)
+        if (str.empty())
             throw std::logic_error{ "String is empty" };
-        if (!m_root_arr)
-            m_root_arr.reset(new NodeArray{});
-        NodeArray *arr{ m_root_arr.get() };
+        Node *node{ unique_path(str) };
+        if (node->m_data && !assign)
+            throw std::logic_error{ "String exist" };
+        auto data{ new_data(std::forward<Args>(args)...) };
+        delete_data(node->m_data);
+        node->m_data = data;
+        return *(node->m_data);
+    }
+
+    /**
+     * \brief 沿 str 自根向下，创建缺失的节点数组，并复制仍被其它 BasicTrie 共享的节点数组，
+     *        使路径上的节点数组都只属于此 BasicTrie。
+     * \return str 最后一个字符对应的节点。
+     * \throws std::exception 如果发生错误。
+     */
+    Node* unique_path(std::string_view str)
+    {
+        assert(!str.empty());
+        NodeArray **arr{ &m_root_arr };
         Node *node{ nullptr };
-        for (size_t i{ 0 }; i < str_size; ++i) {
-            node = &(arr->m_table[std::abs(str[i] - NodeArray::s_base) % NodeArray::s_size]);
-            if (i == str_size - 1) {
-                if (node->m_data && !assign)
-                    throw std::logic_error{ "String exist" };
-                node->m_data.reset(new Data{ std::forward<Args>(args)... });
-                break;
-            } else {
-                if (!node->m_child_arr)
-                    node->m_child_arr.reset(new NodeArray{});
-                arr = node->m_child_arr.get();
+        for (char ch : str) {
+            if (!*arr)
+                *arr = new_array();
+            else if ((*arr)->m_refs.load(std::memory_order_acquire) != 1)
+                *arr = copy_array(*arr);
+            node = &((*arr)->m_arr[std::abs(ch - NodeArray::s_base) % NodeArray::s_size]);
+            arr = &node->m_child_arr;
+        }
+        return node;
+    }
+
+    /**
+     * \brief 复制共享的节点数组：子节点数组增加引用计数，Data 对象逐个拷贝，然后释放对原数组的引用。
+     * \return 复制得到的节点数组，只属于此 BasicTrie。
+     * \throws std::exception 如果发生错误，此时 arr 不变。
+     */
+    NodeArray* copy_array(NodeArray *arr)
+    {
+        NodeArray *copy{ new_array() };
+        try {
+            for (size_t i{ 0 }; i < NodeArray::s_size; ++i) {
+                auto &node{ arr->m_arr[i] };
+                if (node.m_child_arr) {
+                    node.m_child_arr->m_refs.fetch_add(1, std::memory_order_relaxed);
+                    copy->m_arr[i].m_child_arr = node.m_child_arr;
+                }
+                if (node.m_data)
+                    copy->m_arr[i].m_data = new_data(std::as_const(*node.m_data));
             }
+        } catch (...) {
+            delete_array(copy);
+            throw;
         }
-        assert(node);
-        return *(node->m_data);
+        delete_array(arr);
+        return copy;
     }
-    std::unique_ptr<NodeArray> m_root_arr;
+
+    /**
+     * \brief 从内存资源分配并构造一个空的节点数组。
+     * \throws std::exception 如果发生错误。
+     */
+    NodeArray* new_array()
+    {
+        return m_alloc.template new_object<NodeArray>();
+    }
+
+    /**
+     * \brief 从内存资源分配并以 Args 构造 Data 对象。若 Data 使用 std::pmr 分配器，
+     *        以 uses-allocator 方式构造，使 Data 内部的容器使用同一内存资源。
+     * \throws std::exception 如果发生错误。
+     */
+    template <class... Args>
+    Data* new_data(Args&&... args)
+    {
+        return m_alloc.template new_object<Data>(std::forward<Args>(args)...);
+    }
+
+    /**
+     * \brief 析构并释放 Data 对象，将指针置空。
+     */
+    void delete_data(Data *&data) noexcept
+    {
+        if (data)
+            m_alloc.delete_object(data);
+        data = nullptr;
+    }
+
+    /**
+     * \brief 释放对节点数组的引用，将指针置空；最后一个引用释放时，递归析构并释放节点数组及其所有子节点、Data 对象。
+     */
+    void delete_array(NodeArray *&arr) noexcept
+    {
+        if (!arr)
+            return;
+        if (arr->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            for (auto &node : arr->m_arr) {
+                delete_array(node.m_child_arr);
+                delete_data(node.m_data);
+            }
+            m_alloc.delete_object(arr);
+        }
+        arr = nullptr;
+    }
+
+    std::pmr::polymorphic_allocator<> m_alloc;
+    NodeArray *m_root_arr{ nullptr };
 };
 
 using Trie = BasicTrie<bool>;
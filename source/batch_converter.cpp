@@ -0,0 +1,175 @@
+#include "batch_converter.h"
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace pinyin_ime {
+
+namespace {
+
+/**
+ * \brief 工作线程尚未处理的输入下标范围 [m_begin, m_end)。
+ */
+struct Range {
+    std::mutex m_mutex;
+    size_t m_begin{ 0 };
+    size_t m_end{ 0 };
+};
+
+/**
+ * \brief 从 range 的开头取出至多 grain 个下标。
+ * \return 取出的下标范围，range 为空时返回空范围。
+ */
+std::pair<size_t, size_t> take_front(Range &range, size_t grain)
+{
+    std::lock_guard lock{ range.m_mutex };
+    size_t begin{ range.m_begin };
+    range.m_begin = std::min(range.m_end, begin + grain);
+    return { begin, range.m_begin };
+}
+
+/**
+ * \brief 从剩余最多的其它范围的末尾窃取一半，放入 own。
+ * \return 是否窃取成功，所有范围均为空时返回 false。
+ */
+bool steal(std::vector<Range> &ranges, size_t own)
+{
+    for (;;) {
+        size_t victim{ own };
+        size_t max_remaining{ 0 };
+        for (size_t i{ 0 }; i < ranges.size(); ++i) {
+            if (i == own)
+                continue;
+            std::lock_guard lock{ ranges[i].m_mutex };
+            size_t remaining{ ranges[i].m_end - ranges[i].m_begin };
+            if (remaining > max_remaining) {
+                max_remaining = remaining;
+                victim = i;
+            }
+        }
+        if (victim == own)
+            return false;
+
+        size_t begin, end;
+        {
+            std::lock_guard lock{ ranges[victim].m_mutex };
+            auto &range{ ranges[victim] };
+            // 查看与窃取之间 victim 可能已处理完，重新选择
+            if (range.m_begin == range.m_end)
+                continue;
+            end = range.m_end;
+            begin = range.m_begin + (range.m_end - range.m_begin) / 2;
+            range.m_end = begin;
+        }
+        std::lock_guard lock{ ranges[own].m_mutex };
+        ranges[own].m_begin = begin;
+        ranges[own].m_end = end;
+        return true;
+    }
+}
+
+/**
+ * \brief 使用 thread_count 个线程以工作窃取的方式并行执行 f(worker, i)，i 取遍 [0, count)，
+ *        worker 为执行调用的工作线程编号。
+ *        任一调用抛出异常时，在所有线程结束后重新抛出首个异常。
+ */
+template <class F>
+void parallel_for_stealing(size_t count, size_t thread_count, size_t grain, F f)
+{
+    thread_count = std::max<size_t>(1, std::min(thread_count, (count + grain - 1) / grain));
+    std::vector<Range> ranges(thread_count);
+    for (size_t w{ 0 }; w < thread_count; ++w) {
+        ranges[w].m_begin = count * w / thread_count;
+        ranges[w].m_end = count * (w + 1) / thread_count;
+    }
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&](size_t w) {
+        try {
+            do {
+                for (auto [begin, end]{ take_front(ranges[w], grain) }; begin != end;
+                     std::tie(begin, end) = take_front(ranges[w], grain)) {
+                    for (size_t i{ begin }; i < end; ++i)
+                        f(w, i);
+                }
+            } while (steal(ranges, w));
+        } catch (...) {
+            {
+                std::lock_guard lock{ error_mutex };
+                if (!error)
+                    error = std::current_exception();
+            }
+            // 清空所有范围，其它线程处理完手中的输入后退出
+            for (auto &range : ranges) {
+                std::lock_guard lock{ range.m_mutex };
+                range.m_begin = range.m_end;
+            }
+        }
+    };
+    {
+        std::vector<std::jthread> threads;
+        for (size_t w{ 1 }; w < thread_count; ++w)
+            threads.emplace_back(worker, w);
+        worker(0);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace
+
+BatchConverter::BatchConverter(std::shared_ptr<Engine> engine, size_t thread_count)
+    : m_engine{ engine ? std::move(engine) : throw std::invalid_argument{ "Engine is null" } }
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    m_sessions.reserve(thread_count);
+    for (size_t i{ 0 }; i < thread_count; ++i)
+        m_sessions.push_back(std::make_unique<Session>(m_engine));
+}
+
+std::vector<std::vector<std::string>> BatchConverter::convert(std::span<const std::string_view> pinyins, size_t top_n)
+{
+    std::vector<std::vector<std::string>> results(pinyins.size());
+    if (top_n == 0)
+        return results;
+    // 所有 Session 固定使用同一个最新的快照，convert_one() 中的 reset_search() 不会切换快照，
+    // 即使转换期间 Engine 发布了新的快照，一次 convert() 的结果也来自同一个词库
+    auto snapshot{ m_engine->snapshot() };
+    for (auto &session : m_sessions)
+        session->pin_snapshot(snapshot);
+    parallel_for_stealing(pinyins.size(), m_sessions.size(), s_grain, [&](size_t w, size_t i) {
+        results[i] = convert_one(*m_sessions[w], pinyins[i], top_n);
+    });
+    return results;
+}
+
+size_t BatchConverter::thread_count() const noexcept
+{
+    return m_sessions.size();
+}
+
+std::vector<std::string> BatchConverter::convert_one(Session &session, std::string_view pinyin, size_t top_n)
+{
+    std::vector<std::string> result;
+    auto &candidates{ session.search(pinyin) };
+    auto tokens{ session.unfixed_tokens() };
+    using TT = PinYin::TokenType;
+    if (tokens.empty() || std::ranges::any_of(tokens, [](auto &token) { return token.m_type == TT::Invalid; }))
+        return result;
+    result.push_back(session.compose_sentence(s_compose_budget).m_chinese);
+    // 候选词按覆盖的 Token 数量从多到少排列，覆盖全部 Token 的候选词在最前面
+    for (auto &item : candidates) {
+        if (result.size() >= top_n || item.syllable_count() != tokens.size())
+            break;
+        if (std::find(result.begin(), result.end(), item.chinese()) == result.end())
+            result.emplace_back(item.chinese());
+    }
+    return result;
+}
+
+} // namespace pinyin_ime
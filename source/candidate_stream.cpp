@@ -0,0 +1,94 @@
+#include "candidate_stream.h"
+#include <algorithm>
+#include <cmath>
+
+namespace pinyin_ime {
+
+double CandidateStream::default_score(const DictItem &item, size_t token_count) noexcept
+{
+    return std::log1p(static_cast<double>(item.freq())) + s_token_weight * static_cast<double>(token_count);
+}
+
+CandidateStream::CandidateStream(Scorer scorer)
+    : m_scorer{ scorer ? std::move(scorer) : Scorer{ default_score } }
+{}
+
+void CandidateStream::add_source(const Dict *system_dict, const Dict *user_dict, PinYin::TokenSpan tokens,
+                                 std::shared_ptr<const void> owner)
+{
+    // Dict 中的 DictItem 按频率从高到低排列，首个元素的评分即为该数据源的评分上界
+    double bound{ -HUGE_VAL };
+    bool has_item{ false };
+    for (auto dict : { system_dict, user_dict }) {
+        if (!dict || dict->size() == 0)
+            continue;
+        bound = std::max(bound, m_scorer((*dict)[0], tokens.size()));
+        has_item = true;
+    }
+    m_sources.push_back({ system_dict, user_dict, tokens, std::move(owner), Query{}, false });
+    if (has_item)
+        push({ bound, m_sources.size() - 1, 0 });
+}
+
+size_t CandidateStream::fetch(size_t count)
+{
+    size_t produced{ 0 };
+    while (produced < count && !m_heap.empty()) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), heap_less);
+        HeapItem top{ m_heap.back() };
+        m_heap.pop_back();
+        auto &source{ m_sources[top.m_source] };
+        if (!source.m_executed) {
+            // 上界到达堆顶，执行查询并以首个结果的真实评分重新加入
+            source.m_query = Query{ source.m_system_dict, source.m_user_dict, source.m_tokens, source.m_owner };
+            source.m_executed = true;
+            ++m_executed_count;
+            if (!source.m_query.empty())
+                push({ m_scorer(source.m_query[0], source.m_tokens.size()), top.m_source, 0 });
+            continue;
+        }
+        m_entries.push_back({ source.m_query[top.m_pos], source.m_tokens, top.m_score });
+        ++produced;
+        size_t next{ top.m_pos + 1 };
+        if (next < source.m_query.size())
+            push({ m_scorer(source.m_query[next], source.m_tokens.size()), top.m_source, next });
+    }
+    return produced;
+}
+
+bool CandidateStream::exhausted() const noexcept
+{
+    return m_heap.empty();
+}
+
+size_t CandidateStream::size() const noexcept
+{
+    return m_entries.size();
+}
+
+const CandidateStream::Entry& CandidateStream::operator[](size_t idx) const noexcept
+{
+    return m_entries[idx];
+}
+
+size_t CandidateStream::executed_query_count() const noexcept
+{
+    return m_executed_count;
+}
+
+bool CandidateStream::heap_less(const HeapItem &lhs, const HeapItem &rhs) noexcept
+{
+    if (lhs.m_score != rhs.m_score)
+        return lhs.m_score < rhs.m_score;
+    if (lhs.m_source != rhs.m_source)
+        return lhs.m_source > rhs.m_source;
+    return lhs.m_pos > rhs.m_pos;
+}
+
+void CandidateStream::push(HeapItem item)
+{
+    m_heap.push_back(item);
+    std::push_heap(m_heap.begin(), m_heap.end(), heap_less);
+}
+
+} // namespace pinyin_ime
@@ -1,33 +1,36 @@
 #include "candidates.h"
+#include <algorithm>
 
 namespace pinyin_ime {
 
 Candidates::Candidates()
-    : m_queries{ std::make_shared<std::vector<Query>>() }
+    : m_queries{ std::make_shared<std::vector<Query>>() },
+      m_offsets{ std::make_shared<std::vector<size_t>>(1, 0) }
 {}
 
 void Candidates::push_back(Query query)
 {
+    size_t total{ m_offsets->back() + query.size() };
+    m_offsets->reserve(m_offsets->size() + 1);
     m_queries->emplace_back(std::move(query));
+    m_offsets->push_back(total);
 }
 
 size_t Candidates::size() const noexcept
 {
-    size_t s{ 0 };
-    for (auto &query : *m_queries) {
-        s += query.size();
-    }
-    return s;
+    return m_offsets->back();
 }
 
 bool Candidates::empty() const noexcept
 {
-    if (m_queries->empty())
-        return true;
-    for (auto &query : *m_queries)
-        if (!query.empty())
-            return false;
-    return true;
+    return size() == 0;
+}
+
+size_t Candidates::query_position(size_t idx) const noexcept
+{
+    // 第一个大于 idx 的偏移之前的 Query 即为所在 Query，结果为空的 Query 偏移与下一个相同，不会被选中
+    auto iter{ std::upper_bound(m_offsets->begin(), m_offsets->end(), idx) };
+    return static_cast<size_t>(iter - m_offsets->begin()) - 1;
 }
 
 std::pair<Candidates::QueryRef, size_t> Candidates::to_query_and_index(const Candidates::Iterator& it)
@@ -44,34 +47,32 @@ std::pair<Candidates::QueryRef, size_t> Candidates::to_query_and_index(const Can
 std::pair<Candidates::QueryRef, size_t> Candidates::to_query_and_index(size_t idx)
 {
     using std::string_literals::operator""s;
-    for (auto &query : *m_queries) {
-        auto query_size{ query.size() };
-        if (idx >= query_size) {
-            idx = idx - query_size;
-            continue;
-        }
-        return { query, idx };
+    if (idx >= size()) {
+        throw std::out_of_range{ "Index "s + std::to_string(idx)
+            + " >= size "s + std::to_string(size()) };
     }
-    throw std::out_of_range{ "Index "s + std::to_string(idx)
-        + " >= size "s + std::to_string(size()) };
+    auto pos{ query_position(idx) };
+    return { (*m_queries)[pos], idx - (*m_offsets)[pos] };
 }
 
 const DictItem& Candidates::operator[](size_t idx) const noexcept
 {
-    for (auto &query : *m_queries) {
-        auto query_size{ query.size() };
-        if (idx >= query_size) {
-            idx = idx - query_size;
-            continue;
-        }
-        return query[idx];
-    }
-    return (*m_queries)[0][0]; // noexcept, but undefined behaviour
+    auto pos{ query_position(idx) }; // idx 超出范围时为未定义行为
+    return (*m_queries)[pos][idx - (*m_offsets)[pos]];
 }
 
 void Candidates::clear() noexcept
 {
     m_queries->clear();
+    m_offsets->resize(1);
+}
+
+std::vector<Query> Candidates::take() noexcept
+{
+    std::vector<Query> queries;
+    queries.swap(*m_queries);
+    m_offsets->resize(1);
+    return queries;
 }
 
 Candidates::Iterator Candidates::begin() const noexcept
@@ -0,0 +1,269 @@
+#include "compiled_dict.h"
+#include "file_sync.h"
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+
+namespace pinyin_ime {
+
+namespace {
+
+constexpr size_t s_alignment{ 8 };
+
+size_t align_up(size_t n) noexcept
+{
+    return (n + s_alignment - 1) / s_alignment * s_alignment;
+}
+
+} // namespace
+
+template <class T>
+std::span<const T> CompiledDict::section(const Section &s) const
+{
+    auto data{ m_file->data() };
+    if (s.m_offset % alignof(T) != 0 || s.m_size % sizeof(T) != 0
+        || s.m_offset > data.size() || s.m_size > data.size() - s.m_offset)
+        throw std::invalid_argument{ "Compiled dict section corrupted" };
+    return {
+        reinterpret_cast<const T*>(data.data() + s.m_offset),
+        static_cast<size_t>(s.m_size / sizeof(T))
+    };
+}
+
+CompiledDict::CompiledDict(std::string_view file)
+    : m_file{ std::make_unique<MappedFile>(file) }
+{
+    auto data{ m_file->data() };
+    if (data.size() < sizeof(Header))
+        throw std::invalid_argument{ "Compiled dict file too small" };
+    Header header;
+    std::memcpy(&header, data.data(), sizeof(Header));
+    if (std::memcmp(header.m_magic, s_magic, sizeof(s_magic)) != 0)
+        throw std::invalid_argument{ "Not a compiled dict file" };
+    if (header.m_version != s_version)
+        throw std::invalid_argument{ "Compiled dict version mismatch" };
+    if (header.m_byte_order != s_byte_order
+        || header.m_item_size != sizeof(DictItem)
+        || header.m_max_syllables != DictItem::s_max_syllables
+        || header.m_block_size != StringPool::s_block_size)
+        throw std::invalid_argument{ "Compiled dict layout mismatch" };
+
+    m_syllables = section<TextEntry>(header.m_syllables);
+    m_syllable_text = section<char>(header.m_syllable_text);
+    m_strings = section<char>(header.m_strings);
+    m_string_refs = section<StringPool::Ref>(header.m_string_refs);
+    m_items = section<DictItem>(header.m_items);
+    m_acronyms = section<AcronymEntry>(header.m_acronyms);
+    m_acronym_text = section<char>(header.m_acronym_text);
+
+    // DictItem 可能不经拷贝直接用于查询（见 Engine），加载时校验所有记录，
+    // 保证之后访问音节与文本不会越界
+    for (auto &e : m_syllables) {
+        if (e.m_size == 0 || e.m_offset > m_syllable_text.size()
+            || e.m_size > m_syllable_text.size() - e.m_offset)
+            throw std::invalid_argument{ "Compiled dict syllable table corrupted" };
+    }
+    if (m_syllables.size() > SyllableTable::s_invalid_id)
+        throw std::invalid_argument{ "Compiled dict syllable table corrupted" };
+    for (auto &ref : m_string_refs) {
+        if (!valid_ref(ref))
+            throw std::invalid_argument{ "Compiled dict string pool corrupted" };
+    }
+    for (auto &e : m_acronyms) {
+        if (e.m_text_size == 0 || e.m_text_offset > m_acronym_text.size()
+            || e.m_text_size > m_acronym_text.size() - e.m_text_offset
+            || e.m_item_begin > m_items.size()
+            || e.m_item_count > m_items.size() - e.m_item_begin)
+            throw std::invalid_argument{ "Compiled dict acronym index corrupted" };
+        std::string_view acronym{ m_acronym_text.data() + e.m_text_offset, e.m_text_size };
+        for (auto &item : m_items.subspan(e.m_item_begin, e.m_item_count)) {
+            if (!valid_item(item, acronym))
+                throw std::invalid_argument{ "Compiled dict item corrupted" };
+        }
+    }
+}
+
+bool CompiledDict::valid_ref(StringPool::Ref ref) const noexcept
+{
+    return ref.m_offset <= m_strings.size() && ref.m_size <= m_strings.size() - ref.m_offset
+        && ref.m_offset % StringPool::s_block_size + ref.m_size <= StringPool::s_block_size;
+}
+
+bool CompiledDict::valid_item(const DictItem &item, std::string_view acronym) const noexcept
+{
+    // 先检查音节数量，再访问音节 ID
+    if (item.syllable_count() > DictItem::s_max_syllables || item.syllable_count() != acronym.size())
+        return false;
+    auto ids{ item.syllable_ids() };
+    for (size_t i{ 0 }; i < ids.size(); ++i) {
+        if (ids[i] >= m_syllables.size() || m_syllable_text[m_syllables[ids[i]].m_offset] != acronym[i])
+            return false;
+    }
+    return valid_ref(item.chinese_ref());
+}
+
+bool CompiledDict::is_compiled(std::string_view file) noexcept
+{
+    std::ifstream in{ std::string{ file }, std::ios::binary };
+    char magic[sizeof(s_magic)]{};
+    if (!in.read(magic, sizeof(magic)))
+        return false;
+    return std::memcmp(magic, s_magic, sizeof(s_magic)) == 0;
+}
+
+void CompiledDict::write(std::span<const Dict> dicts, std::string_view file)
+{
+    using std::operator""s;
+
+    std::vector<TextEntry> syllables;
+    std::string syllable_text;
+    for (size_t id{ 0 }; id < SyllableTable::size(); ++id) {
+        auto s{ SyllableTable::syllable(static_cast<SyllableTable::Id>(id)) };
+        syllables.push_back({ static_cast<uint32_t>(syllable_text.size()), static_cast<uint32_t>(s.size()) });
+        syllable_text += s;
+    }
+
+    // 重新排布字符串池，只保留词典用到的文本，并保证文本不跨越块边界
+    std::vector<char> strings;
+    std::vector<StringPool::Ref> string_refs;
+    std::unordered_map<uint32_t, StringPool::Ref> rebased;
+    std::vector<DictItem> items;
+    std::vector<AcronymEntry> acronyms;
+    std::string acronym_text;
+    for (auto &dict : dicts) {
+        if (dict.size() == 0)
+            continue;
+        auto acronym{ dict.acronym() };
+        acronyms.push_back({
+            static_cast<uint32_t>(acronym_text.size()), static_cast<uint32_t>(acronym.size()),
+            static_cast<uint32_t>(items.size()), static_cast<uint32_t>(dict.size())
+        });
+        acronym_text += acronym;
+        for (auto &item : dict) {
+            auto ref{ item.chinese_ref() };
+            StringPool::Ref new_ref;
+            if (ref.m_size != 0) {
+                auto [iter, inserted] = rebased.try_emplace(ref.m_offset);
+                if (inserted) {
+                    size_t used{ strings.size() % StringPool::s_block_size };
+                    if (used + ref.m_size > StringPool::s_block_size)
+                        strings.resize(strings.size() + StringPool::s_block_size - used, '\0');
+                    iter->second = { static_cast<uint32_t>(strings.size()), ref.m_size };
+                    auto text{ item.chinese() };
+                    strings.insert(strings.end(), text.begin(), text.end());
+                    string_refs.push_back(iter->second);
+                }
+                new_ref = iter->second;
+            }
+            items.emplace_back(new_ref, item.syllable_ids(), item.freq());
+        }
+    }
+
+    Header header{};
+    std::memcpy(header.m_magic, s_magic, sizeof(s_magic));
+    header.m_version = s_version;
+    header.m_byte_order = s_byte_order;
+    header.m_item_size = sizeof(DictItem);
+    header.m_max_syllables = DictItem::s_max_syllables;
+    header.m_block_size = StringPool::s_block_size;
+    size_t offset{ align_up(sizeof(Header)) };
+    auto place = [&offset](Section &s, size_t size) {
+        s.m_offset = offset;
+        s.m_size = size;
+        offset = align_up(offset + size);
+    };
+    place(header.m_syllables, syllables.size() * sizeof(TextEntry));
+    place(header.m_syllable_text, syllable_text.size());
+    place(header.m_strings, strings.size());
+    place(header.m_string_refs, string_refs.size() * sizeof(StringPool::Ref));
+    place(header.m_items, items.size() * sizeof(DictItem));
+    place(header.m_acronyms, acronyms.size() * sizeof(AcronymEntry));
+    place(header.m_acronym_text, acronym_text.size());
+
+    // 先写入临时文件再替换，已映射旧文件的进程不受影响
+    std::string tmp_file{ std::string{ file } + ".tmp" };
+    {
+        std::ofstream out{ tmp_file, std::ios::binary | std::ios::trunc };
+        if (!out)
+            throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
+        size_t written{ 0 };
+        auto put = [&out, &written](const Section &s, const void *data) {
+            static const char zeros[s_alignment]{};
+            out.write(zeros, static_cast<std::streamsize>(s.m_offset - written));
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(s.m_size));
+            written = s.m_offset + s.m_size;
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        written = sizeof(Header);
+        put(header.m_syllables, syllables.data());
+        put(header.m_syllable_text, syllable_text.data());
+        put(header.m_strings, strings.data());
+        put(header.m_string_refs, string_refs.data());
+        put(header.m_items, items.data());
+        put(header.m_acronyms, acronyms.data());
+        put(header.m_acronym_text, acronym_text.data());
+        out.flush();
+        if (!out)
+            throw std::runtime_error{ "Write file failed: "s + std::error_code(errno, std::generic_category()).message() };
+    }
+    FileSync::sync_file(tmp_file);
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, std::string{ file }, ec);
+    if (ec)
+        throw std::runtime_error{ "Rename file failed: "s + ec.message() };
+    FileSync::sync_parent_dir(file);
+}
+
+size_t CompiledDict::syllable_count() const noexcept
+{
+    return m_syllables.size();
+}
+
+std::string_view CompiledDict::syllable(size_t id) const noexcept
+{
+    if (id >= m_syllables.size())
+        return {};
+    return { m_syllable_text.data() + m_syllables[id].m_offset, m_syllables[id].m_size };
+}
+
+std::span<const char> CompiledDict::strings() const noexcept
+{
+    return m_strings;
+}
+
+std::span<const StringPool::Ref> CompiledDict::string_refs() const noexcept
+{
+    return m_string_refs;
+}
+
+std::string_view CompiledDict::string(StringPool::Ref ref) const noexcept
+{
+    if (ref.m_size == 0 || ref.m_offset > m_strings.size()
+        || ref.m_size > m_strings.size() - ref.m_offset)
+        return {};
+    return { m_strings.data() + ref.m_offset, ref.m_size };
+}
+
+size_t CompiledDict::acronym_count() const noexcept
+{
+    return m_acronyms.size();
+}
+
+std::string_view CompiledDict::acronym(size_t i) const noexcept
+{
+    if (i >= m_acronyms.size())
+        return {};
+    return { m_acronym_text.data() + m_acronyms[i].m_text_offset, m_acronyms[i].m_text_size };
+}
+
+std::span<const DictItem> CompiledDict::items(size_t i) const noexcept
+{
+    if (i >= m_acronyms.size())
+        return {};
+    return m_items.subspan(m_acronyms[i].m_item_begin, m_acronyms[i].m_item_count);
+}
+
+} // namespace pinyin_ime
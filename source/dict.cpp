@@ -1,9 +1,41 @@
 #include "dict.h"
+#include "stats.h"
+#include <algorithm>
+#include <ranges>
 
 namespace pinyin_ime {
 
+Dict::Dict(const allocator_type &alloc) noexcept
+    : m_items{ alloc }, m_index{ alloc }
+{}
+
+Dict::Dict(const Dict &other, const allocator_type &alloc)
+    : m_items{ other.m_items, alloc },
+      m_index{ other.m_index, alloc },
+      m_shared_items{ other.m_shared_items },
+      m_shared_owner{ other.m_shared_owner },
+      m_shared_heap{ other.m_shared_heap },
+      m_acronym{ other.m_acronym }
+{}
+
+Dict::Dict(Dict &&other, const allocator_type &alloc)
+    : m_items{ std::move(other.m_items), alloc },
+      m_index{ std::move(other.m_index), alloc },
+      m_shared_items{ other.m_shared_items },
+      m_shared_owner{ std::move(other.m_shared_owner) },
+      m_shared_heap{ other.m_shared_heap },
+      m_acronym{ std::move(other.m_acronym) }
+{}
+
+Dict::allocator_type Dict::get_allocator() const noexcept
+{
+    return m_items.get_allocator();
+}
+
 bool Dict::add(DictItem item)
 {
+    detach();
+    m_index.clear();
     std::string item_acronym{ item.acronym() };
     if (m_items.empty()) {
         m_acronym = item_acronym;
@@ -30,92 +62,438 @@ bool Dict::add(DictItem item)
     return true;
 }
 
+void Dict::merge(std::span<const DictItem> items)
+{
+    if (items.empty())
+        return;
+    detach(items.size());
+    m_index.clear();
+    std::string acronym{ m_items.empty() ? items.front().acronym() : m_acronym };
+    for (auto &item : items) {
+        if (item.acronym() != acronym) {
+            using std::string_literals::operator""s;
+            throw std::logic_error{
+                "Item acronym do not match, dict acronym: "s
+                +  acronym + ", item acronym: " + item.acronym()
+            };
+        }
+    }
+    m_acronym = std::move(acronym);
+    // 按确切的数量扩容一次。Dict 位于单调内存池（见 Engine::make_trie()）中时，
+    // 扩容留下的旧数组直到整个词库树释放才归还，按倍数增长会浪费近一倍的内存
+    m_items.reserve(m_items.size() + items.size());
+    m_items.insert(m_items.end(), items.begin(), items.end());
+    sort();
+}
+
 std::string_view Dict::acronym() const noexcept
 {
     return m_acronym;
 }
 
+void Dict::share(std::span<const DictItem> items, std::shared_ptr<const void> owner)
+{
+    m_acronym = items.empty() ? std::string{} : items.front().acronym();
+    m_items.clear();
+    m_items.shrink_to_fit();
+    m_index.clear();
+    m_shared_items = items;
+    m_shared_owner = std::move(owner);
+    m_shared_heap = false;
+}
+
+void Dict::freeze()
+{
+    if (m_shared_owner)
+        return;
+    auto items{ std::make_shared<const std::vector<DictItem>>(m_items.begin(), m_items.end()) };
+    m_items.clear();
+    m_items.shrink_to_fit();
+    m_shared_items = *items;
+    m_shared_owner = std::move(items);
+    m_shared_heap = true;
+}
+
+bool Dict::is_shared() const noexcept
+{
+    return static_cast<bool>(m_shared_owner);
+}
+
+void Dict::remap_chinese(const std::function<StringPool::Ref(StringPool::Ref)> &remap)
+{
+    if (std::ranges::all_of(items(), [&](const DictItem &item) { return remap(item.chinese_ref()) == item.chinese_ref(); }))
+        return;
+    detach();
+    for (auto &item : m_items)
+        item = DictItem{ remap(item.chinese_ref()), item.syllable_ids(), item.freq() };
+}
+
+MemoryUsage Dict::memory_usage() const noexcept
+{
+    MemoryUsage usage;
+    usage.m_items = size();
+    usage.m_used_bytes = m_items.size() * sizeof(DictItem);
+    if (m_shared_heap)
+        usage.m_used_bytes += m_shared_items.size_bytes();
+    else if (is_shared())
+        usage.m_mapped_bytes = m_shared_items.size_bytes();
+    usage.m_unused_bytes = (m_items.capacity() - m_items.size()) * sizeof(DictItem);
+    usage.m_used_bytes += m_index.size() * sizeof(uint32_t);
+    usage.m_unused_bytes += (m_index.capacity() - m_index.size()) * sizeof(uint32_t);
+    // 超出短字符串优化容量的 acronym 才分配堆内存
+    if (m_acronym.capacity() > std::string{}.capacity()) {
+        usage.m_used_bytes += m_acronym.size() + 1;
+        usage.m_unused_bytes += m_acronym.capacity() - m_acronym.size();
+    }
+    return usage;
+}
+
+std::span<const DictItem> Dict::items() const noexcept
+{
+    if (m_shared_owner)
+        return m_shared_items;
+    return m_items;
+}
+
+void Dict::detach(size_t extra)
+{
+    if (!m_shared_owner)
+        return;
+    m_items.reserve(m_shared_items.size() + extra);
+    m_items.assign(m_shared_items.begin(), m_shared_items.end());
+    m_shared_items = {};
+    m_shared_owner.reset();
+    m_shared_heap = false;
+}
+
 void Dict::sort()
 {
     std::sort(m_items.begin(), m_items.end());
 }
 
-std::vector<DictItem>::const_iterator Dict::begin() const noexcept
+Dict::const_iterator Dict::begin() const noexcept
 {
-    return m_items.begin();
+    return items().begin();
 }
 
-std::vector<DictItem>::const_iterator Dict::end() const noexcept
+Dict::const_iterator Dict::end() const noexcept
 {
-    return m_items.end();
+    return items().end();
 }
 
 size_t Dict::size() const noexcept
 {
-    return m_items.size();
+    return items().size();
 }
 
 const DictItem& Dict::operator[](size_t i) const noexcept
 {
-    return m_items[i];
+    return items()[i];
 }
 
 const DictItem& Dict::at(size_t i) const
 {
-    return m_items.at(i);
+    auto items{ this->items() };
+    if (i >= items.size())
+        throw std::out_of_range{ "Dict item index out of range" };
+    return items[i];
 }
 
 Dict::ItemCRefVec Dict::search(PinYin::TokenSpan tokens) const
 {
-    enum class MatchResult {
-        Fail, Partial, Full
-    };
-    using MR = MatchResult;
-    using TT = PinYin::TokenType;
+    bool full_match{ false };
+    return search(tokens, full_match);
+}
 
-    Dict::ItemCRefVec result;
-    Dict::ItemCRefVec ext_result;
-    if (m_items.empty())
-        return {};
-    if (tokens.size() != m_items[0].syllables().size())
-        return {};
-    for (auto &item : m_items) {
+namespace {
+
+enum class MatchResult {
+    Fail, Partial, Full
+};
+
+/**
+ * \brief 按 Dict::search() 的规则匹配单个 DictItem。
+ */
+class TokenMatcher {
+public:
+    /**
+     * \brief 记录 tokens 并查找完全匹配所需的音节 ID。
+     * \return 若某个需要完全匹配的 Token 不在音节表中（不可能匹配任何 DictItem），返回 false。
+     */
+    bool init(PinYin::TokenSpan tokens) noexcept
+    {
+        m_tokens = tokens;
+        // 完全匹配的 Token 只需比较音节 ID
+        for (size_t i{ 0 }; i < tokens.size() && i < DictItem::s_max_syllables; ++i) {
+            if (tokens[i].m_type == TT::Initial || tokens[i].m_type == TT::Extendible)
+                continue;
+            m_token_ids[i] = SyllableTable::find(tokens[i].m_token);
+            if (m_token_ids[i] == SyllableTable::s_invalid_id)
+                return false;
+        }
+        return true;
+    }
+
+    MatchResult match(const DictItem &item) const noexcept
+    {
+        if (m_tokens.size() != item.syllable_count())
+            return MR::Fail;
         MR match{ MR::Full };
-        auto &syllables{ item.syllables() };
-        for (size_t i{ 0 }; match != MR::Fail && i < tokens.size(); ++i) {
-            switch (tokens[i].m_type) {
+        auto ids{ item.syllable_ids() };
+        for (size_t i{ 0 }; match != MR::Fail && i < m_tokens.size(); ++i) {
+            switch (m_tokens[i].m_type) {
             case TT::Initial:
-            case TT::Extendible:
-                if (!syllables[i].starts_with(tokens[i].m_token)) {
+            case TT::Extendible: {
+                auto syllable{ SyllableTable::syllable(ids[i]) };
+                if (!syllable.starts_with(m_tokens[i].m_token)) {
                     match = MR::Fail;
                     break;
                 } else if (match == MR::Full
-                           && syllables[i].size() != tokens[i].m_token.size()) {
+                           && syllable.size() != m_tokens[i].m_token.size()) {
                     match = MR::Partial;
                 }
+            }
                 break;
             default:
-                if (syllables[i] != tokens[i].m_token)
+                if (ids[i] != m_token_ids[i])
                     match = MR::Fail;
                 break;
             }
         }
-        if (match == MR::Full) {
+        return match;
+    }
+private:
+    using MR = MatchResult;
+    using TT = PinYin::TokenType;
+
+    PinYin::TokenSpan m_tokens;
+    DictItem::SyllableId m_token_ids[DictItem::s_max_syllables];
+};
+
+/**
+ * \brief Dict::search() 与 Dict::filter() 的共同实现，items 的元素可以转换为 const DictItem&。
+ */
+template <class Items>
+Dict::ItemCRefVec match_items(const Items &items, PinYin::TokenSpan tokens, bool &full_match)
+{
+    Stats::ScopedStage stage{ Stats::Stage::DictSearch };
+    Dict::ItemCRefVec result;
+    Dict::ItemCRefVec ext_result;
+    full_match = false;
+    TokenMatcher matcher;
+    if (std::ranges::empty(items) || !matcher.init(tokens))
+        return {};
+    size_t scanned{ 0 };
+    for (const DictItem &item : items) {
+        ++scanned;
+        auto match{ matcher.match(item) };
+        if (match == MatchResult::Full) {
             result.emplace_back(item);
-        } else if (match == MR::Partial) {
+        } else if (match == MatchResult::Partial) {
             ext_result.emplace_back(item);
         }
     }
+    Stats::add(Stats::Counter::ItemsScanned, scanned);
+    Stats::add(Stats::Counter::ItemsMatched, result.empty() ? ext_result.size() : result.size());
     if (result.empty()) {
         return ext_result;
     }
+    full_match = true;
+    return result;
+}
+
+/**
+ * \brief 以与 match_items() 相同的规则，将匹配的 DictItem 的索引写入 result。
+ * \details for_each_index(f) 按递增顺序对每个待检查的索引调用 f。
+ *          找到第一个完全匹配之前记录开头匹配的索引，找到之后清除它们，只记录完全匹配的索引，
+ *          因此只需要一个结果集合。
+ */
+template <class ForEachIndex>
+void select_items(std::span<const DictItem> items, ForEachIndex &&for_each_index, PinYin::TokenSpan tokens,
+                  DictSelection &result, bool &full_match)
+{
+    result.reset(items.size());
+    full_match = false;
+    TokenMatcher matcher;
+    if (items.empty() || !matcher.init(tokens))
+        return;
+    size_t scanned{ 0 };
+    for_each_index([&](size_t idx) {
+        ++scanned;
+        auto match{ matcher.match(items[idx]) };
+        if (match == MatchResult::Full) {
+            if (!full_match) {
+                result.clear();
+                full_match = true;
+            }
+            result.push_back(idx);
+        } else if (match == MatchResult::Partial && !full_match) {
+            result.push_back(idx);
+        }
+    });
+    Stats::add(Stats::Counter::ItemsScanned, scanned);
+    Stats::add(Stats::Counter::ItemsMatched, result.size());
+}
+
+// 音节索引中的范围不超过 Dict 大小的 1 / s_index_scan_ratio 时才使用索引，否则直接扫描
+constexpr size_t s_index_scan_ratio{ 2 };
+
+// 从音节索引中取出的候选，以位图记录后按递增顺序检查，每个线程重复使用
+thread_local std::vector<uint64_t> s_index_candidates;
+// 建立音节索引时使用的排序键与音节分组，每个线程重复使用
+thread_local std::vector<uint64_t> s_index_keys;
+thread_local std::vector<std::pair<std::string_view, size_t>> s_index_groups;
+
+/**
+ * \brief 返回按递增顺序遍历位图中每个索引的 for_each_index，见 select_items()。
+ */
+auto bitmap_indexes(const std::vector<uint64_t> &bitmap)
+{
+    return [&bitmap](auto &&f) {
+        for (size_t word{ 0 }; word < bitmap.size(); ++word) {
+            for (auto bits{ bitmap[word] }; bits; bits &= bits - 1)
+                f(word * 64 + static_cast<size_t>(std::countr_zero(bits)));
+        }
+    };
+}
+
+} // namespace
+
+Dict::ItemCRefVec Dict::search(PinYin::TokenSpan tokens, bool &full_match) const
+{
+    full_match = false;
+    auto items{ this->items() };
+    // Dict 中所有 DictItem 的音节数量相同
+    if (items.empty() || tokens.size() != items[0].syllable_count())
+        return {};
+    auto &candidates{ s_index_candidates };
+    if (!index_candidates(tokens, candidates))
+        return match_items(items, tokens, full_match);
+    DictSelection selection;
+    {
+        Stats::ScopedStage stage{ Stats::Stage::DictSearch };
+        select_items(items, bitmap_indexes(candidates), tokens, selection, full_match);
+    }
+    ItemCRefVec result;
+    result.reserve(selection.size());
+    selection.for_each([&](size_t idx) { result.emplace_back(items[idx]); });
     return result;
 }
 
+Dict::ItemCRefVec Dict::filter(const ItemCRefVec &items, PinYin::TokenSpan tokens, bool &full_match)
+{
+    return match_items(items, tokens, full_match);
+}
+
+void Dict::search(PinYin::TokenSpan tokens, DictSelection &result, bool &full_match) const
+{
+    Stats::ScopedStage stage{ Stats::Stage::DictSearch };
+    auto items{ this->items() };
+    if (items.empty() || tokens.size() != items[0].syllable_count()) {
+        result.reset(items.size());
+        full_match = false;
+        return;
+    }
+    auto &candidates{ s_index_candidates };
+    if (index_candidates(tokens, candidates)) {
+        select_items(items, bitmap_indexes(candidates), tokens, result, full_match);
+        return;
+    }
+    select_items(items, [&items](auto &&f) {
+        for (size_t idx{ 0 }; idx < items.size(); ++idx)
+            f(idx);
+    }, tokens, result, full_match);
+}
+
+void Dict::filter(const DictSelection &selection, PinYin::TokenSpan tokens,
+                  DictSelection &result, bool &full_match) const
+{
+    Stats::ScopedStage stage{ Stats::Stage::DictSearch };
+    select_items(items(), [&selection](auto &&f) { selection.for_each(f); }, tokens, result, full_match);
+}
+
+void Dict::build_index()
+{
+    auto items{ this->items() };
+    m_index.clear();
+    if (items.size() < s_index_min_items)
+        return;
+    auto count{ items[0].syllable_count() };
+    m_index.resize(items.size() * count);
+    // 先按（音节 ID，DictItem 索引）排序，再按音节文本排列各音节的分组，避免逐个比较音节文本
+    auto &keys{ s_index_keys };
+    auto &groups{ s_index_groups };
+    keys.resize(items.size());
+    auto out{ m_index.begin() };
+    for (size_t pos{ 0 }; pos < count; ++pos) {
+        for (size_t i{ 0 }; i < items.size(); ++i)
+            keys[i] = uint64_t{ items[i].syllable_ids()[pos] } << 32 | i;
+        std::ranges::sort(keys);
+        groups.clear();
+        for (size_t i{ 0 }; i < keys.size(); ++i) {
+            if (i == 0 || keys[i] >> 32 != keys[i - 1] >> 32)
+                groups.emplace_back(SyllableTable::syllable(static_cast<SyllableTable::Id>(keys[i] >> 32)), i);
+        }
+        std::ranges::sort(groups);
+        for (auto &[syllable, begin] : groups) {
+            for (auto i{ begin }; i < keys.size() && keys[i] >> 32 == keys[begin] >> 32; ++i)
+                *out++ = static_cast<uint32_t>(keys[i]);
+        }
+    }
+}
+
+bool Dict::has_index() const noexcept
+{
+    return !m_index.empty();
+}
+
+bool Dict::index_candidates(PinYin::TokenSpan tokens, std::vector<uint64_t> &candidates) const
+{
+    if (m_index.empty())
+        return false;
+    auto items{ this->items() };
+    // 选择候选最少的音节位置，如 "zhongh" 的第一个音节、"zhg" 的 "zh"；
+    // 单个字母的声母匹配 Dict 中的所有 DictItem，不需要查找
+    std::span<const uint32_t> best{ m_index.data(), items.size() };
+    for (size_t pos{ 0 }; pos < tokens.size() && !best.empty(); ++pos) {
+        auto &token{ tokens[pos] };
+        if (token.m_type == PinYin::TokenType::Initial && token.m_token.size() == 1)
+            continue;
+        auto range{ index_range(pos, token) };
+        if (range.size() < best.size())
+            best = range;
+    }
+    if (best.size() * s_index_scan_ratio > items.size())
+        return false;
+    candidates.assign((items.size() + 63) / 64, 0);
+    for (auto idx : best)
+        candidates[idx / 64] |= uint64_t{ 1 } << (idx % 64);
+    return true;
+}
+
+std::span<const uint32_t> Dict::index_range(size_t pos, const PinYin::Token &token) const noexcept
+{
+    using TT = PinYin::TokenType;
+    auto items{ this->items() };
+    std::span<const uint32_t> index{ m_index.data() + pos * items.size(), items.size() };
+    auto syllable = [&items, pos](uint32_t idx) {
+        return SyllableTable::syllable(items[idx].syllable_ids()[pos]);
+    };
+    bool prefix{ token.m_type == TT::Initial || token.m_type == TT::Extendible };
+    auto first{ std::ranges::partition_point(index, [&](uint32_t idx) {
+        return syllable(idx) < token.m_token;
+    }) };
+    auto last{ std::partition_point(first, index.end(), [&](uint32_t idx) {
+        auto text{ syllable(idx) };
+        return prefix ? text.starts_with(token.m_token) : text == token.m_token;
+    }) };
+    return { first, last };
+}
+
 Dict::ItemCRefVec Dict::search(std::string_view pinyin) const
 {
     Dict::ItemCRefVec results;
-    for (auto& item : m_items) {
+    for (auto& item : items()) {
         if (item.pinyin() == pinyin) {
             results.push_back(item);
         }
@@ -126,7 +504,7 @@ Dict::ItemCRefVec Dict::search(std::string_view pinyin) const
 Dict::ItemCRefVec Dict::search(const std::regex &pattern) const
 {
     Dict::ItemCRefVec results;
-    for (auto& item : m_items) {
+    for (auto& item : items()) {
         if (std::regex_match(std::string{ item.pinyin() }, pattern)) {
             results.push_back(item);
         }
@@ -136,6 +514,8 @@ Dict::ItemCRefVec Dict::search(const std::regex &pattern) const
 
 void Dict::auto_inc_freq(std::span<size_t> item_indexes)
 {
+    detach();
+    m_index.clear();
     auto size{ m_items.size() };
     for (auto idx : item_indexes) {
         if (idx >= size)
@@ -145,11 +525,37 @@ void Dict::auto_inc_freq(std::span<size_t> item_indexes)
     sort();
 }
 
+void Dict::set_freq(std::span<const std::pair<size_t, uint32_t>> freqs)
+{
+    if (freqs.empty())
+        return;
+    detach();
+    m_index.clear();
+    auto size{ m_items.size() };
+    for (auto &[idx, freq] : freqs) {
+        if (idx >= size)
+            continue;
+        m_items[idx].set_freq(freq);
+    }
+    sort();
+}
+
+size_t Dict::find(const DictItem &item) const noexcept
+{
+    auto items{ this->items() };
+    for (size_t i{ 0 }; i < items.size(); ++i) {
+        if (items[i].same_entry(item))
+            return i;
+    }
+    return s_npos;
+}
+
 size_t Dict::item_index(const DictItem &item) const noexcept
 {
     auto p{ &item };
-    auto data{ m_items.data() };
-    if (p < data || p >= data + m_items.size()) {
+    auto items{ this->items() };
+    auto data{ items.data() };
+    if (p < data || p >= data + items.size()) {
         return s_npos;
     }
     return static_cast<size_t>(p - data);
@@ -157,7 +563,7 @@ size_t Dict::item_index(const DictItem &item) const noexcept
 
 uint32_t Dict::suggest_inc_freq(size_t idx) const noexcept
 {
-    if (idx >= m_items.size())
+    if (idx >= size())
         return 0;
     return 1; // TODO
 }
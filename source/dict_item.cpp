@@ -1,90 +1,106 @@
 #include "dict_item.h"
 #include "pinyin.h"
-#include <ranges>
+#include <algorithm>
+#include <stdexcept>
 
 namespace pinyin_ime {
 
-DictItem::DictItem(std::string chinese, std::string pinyin, uint32_t freq)
-    : m_chinese{ std::move(chinese) }, m_pinyin{ std::move(pinyin) }, m_freq{ freq }
+DictItem::DictItem(std::string_view chinese, std::string_view pinyin, uint32_t freq)
+    : m_chinese{ StringPool::intern(chinese) }, m_freq{ freq }
 {
-    build_syllables_view();
+    parse_pinyin(pinyin);
 }
 
-DictItem::DictItem(const DictItem &other)
-    : m_chinese{ other.m_chinese }, m_pinyin{ other.m_pinyin }, m_freq{ other.m_freq }
+DictItem::DictItem(StringPool::Ref chinese, std::span<const SyllableId> syllables, uint32_t freq)
+    : m_chinese{ chinese }, m_freq{ freq }
 {
-    m_syllables.reserve(other.m_syllables.size());
-    auto p = other.m_pinyin.data();
-    for (auto &s : other.m_syllables) {
-        auto offset{ s.data() - p };
-        m_syllables.push_back(std::string_view{ m_pinyin.data() + offset, s.size() });
-    }
-}
-
-DictItem::DictItem(DictItem &&other)
-    : m_chinese{ std::move(other.m_chinese) },
-      m_pinyin{ std::move(other.m_pinyin) }, m_freq{ other.m_freq }
-{
-    other.m_syllables.clear();
-    build_syllables_view();
+    if (syllables.size() > s_max_syllables)
+        throw std::length_error{ "Too many syllables in pinyin" };
+    std::copy(syllables.begin(), syllables.end(), m_syllables);
+    m_syllable_count = static_cast<uint8_t>(syllables.size());
 }
 
-DictItem& DictItem::operator=(const DictItem &other)
+size_t DictItem::count_syllables(std::string_view pinyin) noexcept
 {
-    m_chinese = other.m_chinese;
-    m_pinyin = other.m_pinyin;
-    m_freq = other.m_freq;
-    for (auto &s : other.m_syllables) {
-        auto offset{ s.data() - other.m_pinyin.data() };
-        m_syllables.push_back(std::string_view{ m_pinyin.data() + offset, s.size() });
+    size_t count{ 0 };
+    for (size_t pos{ 0 }; pos < pinyin.size(); ++pos) {
+        if (pinyin[pos] != PinYin::s_delim && (pos == 0 || pinyin[pos - 1] == PinYin::s_delim))
+            ++count;
     }
-    return *this;
+    return count;
 }
 
-DictItem& DictItem::operator=(DictItem &&other)
+std::string_view DictItem::chinese() const noexcept
 {
-    m_chinese = std::move(other.m_chinese);
-    m_pinyin = std::move(other.m_pinyin);
-    m_freq = other.m_freq;
-    other.m_syllables.clear();
-    build_syllables_view();
-    return *this;
+    return StringPool::view(m_chinese);
 }
 
-std::string_view DictItem::chinese() const noexcept
+void DictItem::set_chinese(std::string_view chinese)
 {
-    return m_chinese;
+    m_chinese = StringPool::intern(chinese);
 }
 
-void DictItem::set_chinese(std::string chinese) noexcept
+StringPool::Ref DictItem::chinese_ref() const noexcept
 {
-    m_chinese = std::move(chinese);
+    return m_chinese;
 }
 
-std::string_view DictItem::pinyin() const noexcept
+std::string DictItem::pinyin() const
 {
-    return m_pinyin;
+    std::string str;
+    for (size_t i{ 0 }; i < m_syllable_count; ++i) {
+        if (i != 0)
+            str.push_back(PinYin::s_delim);
+        str += SyllableTable::syllable(m_syllables[i]);
+    }
+    return str;
 }
 
-void DictItem::set_pinyin(std::string pinyin)
+void DictItem::set_pinyin(std::string_view pinyin)
 {
-    m_pinyin = std::move(pinyin);
-    build_syllables_view();
+    parse_pinyin(pinyin);
 }
 
 std::string DictItem::acronym() const
 {
     std::string str;
-    str.reserve(m_syllables.size());
-    for (auto &s : m_syllables) {
-        str.push_back(s.front());
+    str.reserve(m_syllable_count);
+    for (size_t i{ 0 }; i < m_syllable_count; ++i) {
+        str.push_back(syllable(i).front());
     }
     return str;
 }
 
-const std::vector<std::string_view>& DictItem::syllables() const noexcept
+size_t DictItem::syllable_count() const noexcept
+{
+    return m_syllable_count;
+}
+
+std::string_view DictItem::syllable(size_t i) const noexcept
+{
+    return SyllableTable::syllable(m_syllables[i]);
+}
+
+std::span<const DictItem::SyllableId> DictItem::syllable_ids() const noexcept
+{
+    return { m_syllables, m_syllable_count };
+}
+
+bool DictItem::same_entry(const DictItem &other) const noexcept
+{
+    return m_chinese == other.m_chinese
+        && std::ranges::equal(syllable_ids(), other.syllable_ids());
+}
+
+bool DictItem::same_acronym(const DictItem &other) const noexcept
 {
-    return m_syllables;
+    if (m_syllable_count != other.m_syllable_count)
+        return false;
+    for (size_t i{ 0 }; i < m_syllable_count; ++i) {
+        if (m_syllables[i] != other.m_syllables[i] && syllable(i).front() != other.syllable(i).front())
+            return false;
+    }
+    return true;
 }
 
 uint32_t DictItem::freq() const noexcept
@@ -97,31 +113,36 @@ void DictItem::set_freq(uint32_t freq) noexcept
     m_freq = freq;
 }
 
-void DictItem::build_syllables_view()
+void DictItem::parse_pinyin(std::string_view pinyin)
 {
-    if (!m_syllables.empty())
-        m_syllables.clear();
-    auto syllables = m_pinyin
-        | std::views::split(PinYin::s_delim)
-        | std::views::transform([](auto &&rng) -> std::string_view {
-            return std::string_view(std::addressof(*rng.begin()), std::ranges::distance(rng));
-        });
-    for (auto &&s : syllables) {
-        if (!s.empty())
-            m_syllables.push_back(std::move(s));
+    SyllableId ids[s_max_syllables];
+    size_t count{ 0 };
+    while (!pinyin.empty()) {
+        auto pos{ pinyin.find(PinYin::s_delim) };
+        auto s{ pinyin.substr(0, pos) };
+        pinyin.remove_prefix(pos == std::string_view::npos ? pinyin.size() : pos + 1);
+        if (s.empty())
+            continue;
+        if (count == s_max_syllables)
+            throw std::length_error{ "Too many syllables in pinyin" };
+        ids[count++] = SyllableTable::intern(s);
     }
+    std::copy_n(ids, count, m_syllables);
+    m_syllable_count = static_cast<uint8_t>(count);
 }
 
 std::strong_ordering DictItem::operator<=>(const DictItem &other) const noexcept
 {
     // 1. 比较音节首字母缩略词，若不同（不属于同一个 Dict），缩略词排前者优先级高
     {
-        auto this_acronym = acronym();
-        auto other_acronym = other.acronym();
-        if (this_acronym != other_acronym)
-        {
-            return this_acronym <=> other_acronym;
+        size_t count{ std::min(m_syllable_count, other.m_syllable_count) };
+        for (size_t i{ 0 }; i < count; ++i) {
+            auto r = syllable(i).front() <=> other.syllable(i).front();
+            if (r != std::strong_ordering::equal)
+                return r;
         }
+        if (m_syllable_count != other.m_syllable_count)
+            return m_syllable_count <=> other.m_syllable_count;
     }
 
     // 2. 比较频率，若不同，频率高者优先级高
@@ -133,17 +154,19 @@ std::strong_ordering DictItem::operator<=>(const DictItem &other) const noexcept
             return std::strong_ordering::greater;
     }
 
-    // 3. 逐音节比较字典序
-    for (size_t i{ 0 }; i < m_syllables.size(); ++i) {
-        auto r = m_syllables[i] <=> other.m_syllables[i];
+    // 3. 逐音节比较字典序（音节数量相同时等价于按“字典序”比较 pinyin）
+    for (size_t i{ 0 }; i < m_syllable_count; ++i) {
+        if (m_syllables[i] == other.m_syllables[i])
+            continue;
+        auto r = syllable(i) <=> other.syllable(i);
         if (r != std::strong_ordering::equal)
             return r;
     }
 
-    // 4. 按“字典序”比较 pinyin 和 chinese
-    if (auto r = m_pinyin <=> other.m_pinyin; r != std::strong_ordering::equal)
-        return r;
-    return m_chinese <=> other.m_chinese;
+    // 4. 按“字典序”比较 chinese
+    if (m_chinese == other.m_chinese)
+        return std::strong_ordering::equal;
+    return chinese() <=> other.chinese();
 }
 
-} // namespace pinyin_ime
\ No newline at end of file
+} // namespace pinyin_ime
@@ -0,0 +1,102 @@
+#include "dict_selection.h"
+#include <algorithm>
+#include <cassert>
+
+namespace pinyin_ime {
+
+namespace {
+
+size_t word_count(size_t dict_size) noexcept
+{
+    return (dict_size + 63) / 64;
+}
+
+/**
+ * \brief 返回 bits 中第 rank 个（从 0 开始）为 1 的位的位置。
+ */
+size_t select_bit(uint64_t bits, size_t rank) noexcept
+{
+    for (; rank > 0; --rank)
+        bits &= bits - 1;
+    return static_cast<size_t>(std::countr_zero(bits));
+}
+
+} // namespace
+
+void DictSelection::reset(size_t dict_size) noexcept
+{
+    m_dict_size = dict_size;
+    clear();
+}
+
+void DictSelection::clear() noexcept
+{
+    m_runs.clear();
+    m_bits.clear();
+    m_word_ranks.clear();
+    m_size = 0;
+    m_word_end = 0;
+    m_bitmap = false;
+}
+
+void DictSelection::push_back(size_t idx)
+{
+    assert(idx < m_dict_size);
+    if (m_bitmap) {
+        set_bit(idx);
+        return;
+    }
+    assert(m_runs.empty() || idx >= m_runs.back().m_end);
+    if (!m_runs.empty() && m_runs.back().m_end == idx) {
+        ++m_runs.back().m_end;
+    } else {
+        // 区间列表占用的内存超过位图（每字 8 字节的位与 4 字节的计数）时改用位图
+        if (m_runs.size() >= word_count(m_dict_size)) {
+            to_bitmap();
+            set_bit(idx);
+            return;
+        }
+        auto end{ static_cast<uint32_t>(idx) };
+        m_runs.push_back({ end, end + 1, static_cast<uint32_t>(m_size) });
+    }
+    ++m_size;
+}
+
+size_t DictSelection::index(size_t rank) const noexcept
+{
+    assert(rank < m_size);
+    if (!m_bitmap) {
+        auto run{ std::ranges::upper_bound(m_runs, rank, {}, &Run::m_rank) - 1 };
+        return run->m_begin + (rank - run->m_rank);
+    }
+    auto first{ m_word_ranks.begin() };
+    auto word{ static_cast<size_t>(std::upper_bound(first, first + m_word_end, rank) - first) - 1 };
+    return word * 64 + select_bit(m_bits[word], rank - m_word_ranks[word]);
+}
+
+void DictSelection::to_bitmap()
+{
+    m_bits.assign(word_count(m_dict_size), 0);
+    m_word_ranks.assign(m_bits.size(), 0);
+    m_bitmap = true;
+    m_size = 0;
+    m_word_end = 0;
+    for (auto &run : m_runs) {
+        for (size_t idx{ run.m_begin }; idx < run.m_end; ++idx)
+            set_bit(idx);
+    }
+    m_runs.clear();
+}
+
+void DictSelection::set_bit(size_t idx) noexcept
+{
+    auto word{ idx / 64 };
+    assert(word + 1 >= m_word_end);
+    // 第一次写入此字时，此字之前的索引数量即当前的数量
+    for (; m_word_end <= word; ++m_word_end)
+        m_word_ranks[m_word_end] = static_cast<uint32_t>(m_size);
+    m_bits[word] |= uint64_t{ 1 } << (idx % 64);
+    ++m_size;
+}
+
+} // namespace pinyin_ime
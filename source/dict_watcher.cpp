@@ -0,0 +1,115 @@
+#include "dict_watcher.h"
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#ifdef __linux__
+#  include <unistd.h>
+#  include <poll.h>
+#  include <sys/inotify.h>
+#  include <sys/eventfd.h>
+#endif
+
+namespace pinyin_ime {
+
+namespace {
+
+std::runtime_error io_error(const char *what, int err)
+{
+    using std::operator""s;
+    return std::runtime_error{ what + ": "s + std::error_code(err, std::generic_category()).message() };
+}
+
+} // namespace
+
+DictWatcher::DictWatcher(std::shared_ptr<Engine> engine, std::string_view dict_file, ErrorHandler on_error)
+    : m_engine{ engine ? std::move(engine) : throw std::invalid_argument{ "Engine is null" } },
+      m_dict_file{ dict_file },
+      m_on_error{ std::move(on_error) }
+{
+#ifdef __linux__
+    std::filesystem::path path{ m_dict_file };
+    m_file_name = path.filename().string();
+    auto dir{ path.parent_path() };
+    if (dir.empty())
+        dir = ".";
+    try {
+        m_inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotify_fd < 0)
+            throw io_error("Create inotify failed", errno);
+        // 替换文件时通常先写入临时文件再重命名，因此同时关注写入完成与移入
+        if (::inotify_add_watch(m_inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+            throw io_error("Watch directory failed", errno);
+        m_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_stop_fd < 0)
+            throw io_error("Create eventfd failed", errno);
+        m_thread = std::thread{ [this] { watch_loop(); } };
+    } catch (...) {
+        for (int fd : { m_inotify_fd, m_stop_fd })
+            if (fd >= 0)
+                ::close(fd);
+        throw;
+    }
+#else
+    throw std::runtime_error{ "Watching dict file is not supported on this platform" };
+#endif
+}
+
+DictWatcher::~DictWatcher()
+{
+#ifdef __linux__
+    uint64_t one{ 1 };
+    [[maybe_unused]] auto n{ ::write(m_stop_fd, &one, sizeof(one)) };
+    m_thread.join();
+    ::close(m_inotify_fd);
+    ::close(m_stop_fd);
+#endif
+}
+
+size_t DictWatcher::reload_count() const noexcept
+{
+    return m_reload_count.load(std::memory_order_relaxed);
+}
+
+void DictWatcher::watch_loop() noexcept
+{
+#ifdef __linux__
+    bool pending{ false };
+    for (;;) {
+        pollfd fds[2]{ { m_inotify_fd, POLLIN, 0 }, { m_stop_fd, POLLIN, 0 } };
+        int timeout{ pending ? static_cast<int>(s_settle_time.count()) : -1 };
+        int n{ ::poll(fds, 2, timeout) };
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 || fds[1].revents)
+            return;
+        if (n == 0) {
+            // 超时时间内没有新的修改，文件已经稳定
+            pending = false;
+            try {
+                m_engine->reload(m_dict_file);
+                m_reload_count.fetch_add(1, std::memory_order_relaxed);
+            } catch (...) {
+                try {
+                    if (m_on_error)
+                        m_on_error(std::current_exception());
+                } catch (...) {}
+            }
+            continue;
+        }
+        alignas(inotify_event) char buffer[4096];
+        ssize_t size;
+        while ((size = ::read(m_inotify_fd, buffer, sizeof(buffer))) > 0) {
+            for (char *p{ buffer }; p < buffer + size;) {
+                auto event{ reinterpret_cast<const inotify_event*>(p) };
+                // 事件队列溢出时无法确定文件是否被修改，按修改处理
+                if ((event->mask & IN_Q_OVERFLOW) || (event->len && m_file_name == event->name))
+                    pending = true;
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+#endif
+}
+
+} // namespace pinyin_ime
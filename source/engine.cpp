@@ -0,0 +1,833 @@
+#include "engine.h"
+#include "stats.h"
+#include "compiled_dict.h"
+#include "text_dict_parser.h"
+#include "file_sync.h"
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <tuple>
+#include <unordered_set>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+
+namespace pinyin_ime {
+
+std::pmr::vector<Engine::PrefixDicts> Engine::Snapshot::prefix_dicts(PinYin::TokenSpan tokens,
+                                                                 std::pmr::memory_resource *resource) const
+{
+    Stats::ScopedStage stage{ Stats::Stage::AcronymLookup };
+    // 每个 Token 贡献 acronym 的一个字母，token_counts[k] 为 acronym 前 k + 1 个字母对应的 Token 数量
+    std::pmr::string acronym{ resource };
+    std::pmr::vector<size_t> token_counts{ resource };
+    acronym.reserve(tokens.size());
+    token_counts.reserve(tokens.size());
+    for (size_t i{ 0 }; i < tokens.size(); ++i) {
+        if (tokens[i].m_token.empty())
+            continue;
+        acronym.push_back(tokens[i].m_token.front());
+        token_counts.push_back(i + 1);
+    }
+
+    // 两层词典树各进行一次公共前缀搜索，找出 acronym 所有前缀对应的 Dict
+    std::pmr::vector<std::pair<const Dict*, const Dict*>> dicts(acronym.size(), resource);
+    m_system_trie->common_prefix_search(acronym, [&dicts](size_t size, const Dict &dict) {
+        dicts[size - 1].first = &dict;
+    });
+    m_user_trie->common_prefix_search(acronym, [&dicts](size_t size, const Dict &dict) {
+        dicts[size - 1].second = &dict;
+    });
+
+    std::pmr::vector<PrefixDicts> result{ resource };
+    for (size_t k{ dicts.size() }; k-- > 0;) {
+        if (dicts[k].first || dicts[k].second)
+            result.push_back({ token_counts[k], dicts[k].first, dicts[k].second });
+    }
+    return result;
+}
+
+bool Engine::Snapshot::contains_entry(const DictItem &item) const
+{
+    auto acronym{ item.acronym() };
+    if (m_system_trie->contains(acronym) && m_system_trie->data(acronym).find(item) != Dict::s_npos)
+        return true;
+    return m_user_trie->contains(acronym) && m_user_trie->data(acronym).find(item) != Dict::s_npos;
+}
+
+std::atomic<size_t> Engine::s_instance_count{ 0 };
+
+Engine::Engine()
+    : m_snapshot{ std::make_shared<const Snapshot>(Snapshot{
+        std::make_shared<const BasicTrie<Dict>>(), std::make_shared<const BasicTrie<Dict>>(), nullptr
+      }) },
+      m_learner{ [this] { learn_loop(); } }
+{
+    s_instance_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+Engine::Engine(std::string_view dict_file)
+    : Engine{}
+{
+    load(dict_file);
+}
+
+Engine::~Engine()
+{
+    {
+        std::lock_guard lock{ m_load_mutex };
+        if (m_loading.valid())
+            m_loading.wait();
+    }
+    m_learn_stopping.store(true, std::memory_order_release);
+    m_learn_signal.fetch_add(1, std::memory_order_release);
+    m_learn_signal.notify_one();
+    m_learner.join();
+    try {
+        wait_compaction();
+    } catch (...) {}
+    s_instance_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<const Engine::Snapshot> Engine::snapshot() const noexcept
+{
+    std::lock_guard lock{ m_snapshot_mutex };
+    return m_snapshot;
+}
+
+Stats::Snapshot Engine::stats() noexcept
+{
+    return Stats::snapshot();
+}
+
+void Engine::reset_stats() noexcept
+{
+    Stats::reset();
+}
+
+MemoryReport Engine::memory_usage(size_t top_buckets) const
+{
+    using SS = MemoryReport::Subsystem;
+    auto current{ snapshot() };
+    MemoryReport report;
+    // 以最小堆保留 DictItem 数组最大的 top_buckets 个 Dict
+    using Entry = std::tuple<size_t, const Dict*, bool>;
+    std::vector<Entry> heap;
+    auto note_bucket = [&](const Dict &dict, const MemoryUsage &usage, bool user) {
+        if (top_buckets == 0)
+            return;
+        Entry entry{ usage.m_used_bytes + usage.m_unused_bytes + usage.m_mapped_bytes, &dict, user };
+        if (heap.size() == top_buckets) {
+            if (std::get<0>(entry) <= std::get<0>(heap.front()))
+                return;
+            std::ranges::pop_heap(heap, std::greater{});
+            heap.pop_back();
+        }
+        heap.push_back(entry);
+        std::ranges::push_heap(heap, std::greater{});
+    };
+
+    auto &system_trie{ *current->m_system_trie };
+    // 同一 Dict 中词条的缩写相同，按中文散列，以 same_entry() 判断是否为同一词条
+    auto entry_hash = [](const DictItem *item) noexcept { return std::hash<std::string_view>{}(item->chinese()); };
+    auto entry_equal = [](const DictItem *a, const DictItem *b) noexcept { return a->same_entry(*b); };
+    std::unordered_set<const DictItem*, decltype(entry_hash), decltype(entry_equal)> user_entries;
+    report[SS::SystemTrie] = system_trie.memory_usage([&](const Dict &dict) {
+        auto usage{ dict.memory_usage() };
+        report[SS::SystemDicts] += usage;
+        note_bucket(dict, usage, false);
+    });
+    report[SS::UserTrie] = current->m_user_trie->memory_usage([&](const Dict &dict) {
+        auto usage{ dict.memory_usage() };
+        report[SS::UserDicts] += usage;
+        note_bucket(dict, usage, true);
+        report.m_learned_items += dict.size();
+        auto acronym{ dict.acronym() };
+        if (dict.size() == 0 || !system_trie.contains(acronym))
+            return;
+        // 以用户 Dict 的词条建立散列集合，扫描一遍系统 Dict 即可减去两者共有的词条，
+        // 避免对每个用户词条线性查找系统 Dict
+        user_entries.clear();
+        for (auto &item : dict)
+            user_entries.insert(&item);
+        for (auto &item : system_trie.data(acronym))
+            report.m_learned_items -= user_entries.erase(&item);
+    });
+    report[SS::StringPool] = StringPool::memory_usage();
+    report[SS::SyllableTable] = SyllableTable::memory_usage();
+    report[SS::SyllableTrie] = PinYin::syllable_trie_memory_usage();
+    if (current->m_ngram)
+        report[SS::NGram] = current->m_ngram->memory_usage();
+
+    std::ranges::sort_heap(heap, std::greater{});
+    for (auto &[bytes, dict, user] : heap)
+        report.m_largest_buckets.push_back({ std::string{ dict->acronym() }, user, dict->size(), bytes });
+    return report;
+}
+
+void Engine::publish(std::shared_ptr<const BasicTrie<Dict>> system_trie,
+                     std::shared_ptr<const BasicTrie<Dict>> user_trie,
+                     std::shared_ptr<NGramModel> ngram)
+{
+    auto snapshot{ std::make_shared<const Snapshot>(Snapshot{
+        std::move(system_trie), std::move(user_trie), std::move(ngram)
+    }) };
+    // 旧快照在锁外释放，若这是最后一个引用，销毁词库树不阻塞读取
+    std::lock_guard lock{ m_snapshot_mutex };
+    m_snapshot.swap(snapshot);
+}
+
+void Engine::load(std::string_view dict_file)
+{
+    // 系统词库树只由加载修改，持有 m_load_mutex 即可在锁外构造新的词库树，不阻塞学习
+    std::lock_guard lock{ m_load_mutex };
+    if (m_loading.valid())
+        m_loading.wait();
+    auto current{ snapshot() };
+    load_full(dict_file, current->m_system_trie.get());
+}
+
+void Engine::reload(std::string_view dict_file)
+{
+    std::lock_guard lock{ m_load_mutex };
+    if (m_loading.valid())
+        m_loading.wait();
+    load_full(dict_file, nullptr);
+}
+
+void Engine::load_async(std::string_view dict_file, size_t head_size)
+{
+    start_loading([this, file = std::string{ dict_file }, head_size] {
+        load_progressively(file, head_size);
+    });
+}
+
+void Engine::reload_async(std::string_view dict_file)
+{
+    start_loading([this, file = std::string{ dict_file }] {
+        try {
+            load_full(file, nullptr);
+        } catch (...) {
+            m_load_stage.store(LoadStage::Failed, std::memory_order_release);
+            throw;
+        }
+    });
+}
+
+void Engine::start_loading(std::function<void()> task)
+{
+    std::lock_guard lock{ m_load_mutex };
+    if (m_loading.valid())
+        m_loading.wait();
+    auto stage{ m_load_stage.exchange(LoadStage::Loading) };
+    m_loaded_items.store(0, std::memory_order_relaxed);
+    m_total_items.store(0, std::memory_order_relaxed);
+    try {
+        m_loading = std::async(std::launch::async, std::move(task));
+    } catch (...) {
+        m_load_stage.store(stage);
+        throw;
+    }
+}
+
+void Engine::load_full(std::string_view dict_file, const BasicTrie<Dict> *base)
+{
+    auto system_trie{ base ? clone(*base, true) : make_trie(true) };
+    ItemCount count;
+    if (CompiledDict::is_compiled(dict_file))
+        count = load_compiled(open_compiled(dict_file), *system_trie, TextDictParser::s_all);
+    else
+        count = load_text(dict_file, *system_trie, TextDictParser::s_all);
+    build_indexes(*system_trie);
+    publish_system(std::move(system_trie));
+    m_skipped_items.fetch_add(count.m_skipped, std::memory_order_relaxed);
+    m_total_items.store(count.m_total, std::memory_order_relaxed);
+    m_loaded_items.store(count.m_loaded, std::memory_order_relaxed);
+    m_load_stage.store(LoadStage::Complete, std::memory_order_release);
+}
+
+size_t Engine::skipped_items() const noexcept
+{
+    return m_skipped_items.load(std::memory_order_relaxed);
+}
+
+Engine::LoadProgress Engine::load_progress() const noexcept
+{
+    auto stage{ m_load_stage.load(std::memory_order_acquire) };
+    return {
+        stage,
+        m_loaded_items.load(std::memory_order_relaxed),
+        m_total_items.load(std::memory_order_relaxed)
+    };
+}
+
+void Engine::wait_load() const
+{
+    std::lock_guard lock{ m_load_mutex };
+    if (m_loading.valid())
+        m_loading.get();
+}
+
+void Engine::load_progressively(const std::string &dict_file, size_t head_size)
+{
+    try {
+        // 两个阶段都在加载前的系统词库树上构造，第二阶段的结果替换第一阶段
+        auto base{ snapshot()->m_system_trie };
+        std::optional<CompiledSource> compiled;
+        if (CompiledDict::is_compiled(dict_file))
+            compiled = open_compiled(dict_file);
+        auto load_into{ [&](BasicTrie<Dict> &dict_trie, size_t limit) {
+            return compiled ? load_compiled(*compiled, dict_trie, limit)
+                            : load_text(dict_file, dict_trie, limit);
+        } };
+
+        auto head{ clone(*base, true) };
+        auto count{ load_into(*head, head_size) };
+        build_indexes(*head);
+        publish_system(std::move(head));
+        m_total_items.store(count.m_total, std::memory_order_relaxed);
+        m_loaded_items.store(count.m_loaded, std::memory_order_relaxed);
+        m_load_stage.store(LoadStage::Partial, std::memory_order_release);
+
+        auto full{ clone(*base, true) };
+        count = load_into(*full, TextDictParser::s_all);
+        build_indexes(*full);
+        publish_system(std::move(full));
+        // 第一阶段跳过的行在第二阶段同样被跳过，只计数一次
+        m_skipped_items.fetch_add(count.m_skipped, std::memory_order_relaxed);
+        m_loaded_items.store(count.m_loaded, std::memory_order_relaxed);
+        m_load_stage.store(LoadStage::Complete, std::memory_order_release);
+    } catch (...) {
+        m_load_stage.store(LoadStage::Failed, std::memory_order_release);
+        throw;
+    }
+}
+
+void Engine::publish_system(std::shared_ptr<const BasicTrie<Dict>> system_trie)
+{
+    std::lock_guard lock{ m_write_mutex };
+    auto current{ snapshot() };
+    publish(std::move(system_trie), current->m_user_trie, current->m_ngram);
+    m_strings_replaced.store(true, std::memory_order_relaxed);
+}
+
+bool Engine::compact_strings()
+{
+    std::lock_guard load_lock{ m_load_mutex };
+    if (m_loading.valid())
+        m_loading.wait();
+    if (!m_strings_replaced.load(std::memory_order_relaxed))
+        return false;
+    std::lock_guard write_lock{ m_write_mutex };
+    // 后台压缩学习日志时直接读取用户词库树，不持有快照；其错误仍由 wait_compaction() 抛出
+    if (m_compaction.valid())
+        m_compaction.wait();
+    // 持有 m_snapshot_mutex 直到发布新的快照，期间没有人可以获取快照
+    std::lock_guard snapshot_lock{ m_snapshot_mutex };
+    if (s_instance_count.load(std::memory_order_relaxed) != 1 || m_snapshot.use_count() != 1
+        || m_learn_applied.load(std::memory_order_acquire) != m_learn_pushed.load(std::memory_order_acquire))
+        return false;
+
+    auto &current{ *m_snapshot };
+    std::unordered_set<uint32_t> live;
+    auto collect{ [&](const BasicTrie<Dict> &dict_trie) {
+        auto end_iter{ dict_trie.end() };
+        for (auto dict_it{ dict_trie.begin() }; dict_it != end_iter; ++dict_it) {
+            for (auto &item : *dict_it)
+                live.insert(item.chinese_ref().m_offset);
+        }
+    } };
+    collect(*current.m_system_trie);
+    collect(*current.m_user_trie);
+    if (current.m_ngram)
+        current.m_ngram->collect_words(live);
+    // 所有可能失败的步骤都在提交压缩之前完成：准备压缩，在词库树的拷贝上更新位置，构造语言模型的新表；
+    // 任一步骤失败时字符串池、当前快照与语言模型都不变
+    auto compaction{ StringPool::prepare_compact(live) };
+    auto &moved{ compaction.moved() };
+    auto remap{ [&](StringPool::Ref ref) {
+        auto it{ moved.find(ref.m_offset) };
+        return it == moved.end() ? ref : it->second;
+    } };
+    auto system_trie{ clone(*current.m_system_trie, true) };
+    auto user_trie{ clone(*current.m_user_trie) };
+    for (auto &dict_trie : { system_trie.get(), user_trie.get() }) {
+        auto end_iter{ dict_trie->end() };
+        for (auto dict_it{ dict_trie->begin() }; dict_it != end_iter; ++dict_it)
+            dict_it->remap_chinese(remap);
+    }
+    freeze_dicts(*user_trie);
+    NGramModel::WordTables word_tables;
+    if (current.m_ngram)
+        word_tables = current.m_ngram->remap_words(moved);
+    auto snapshot{ std::make_shared<Snapshot>(
+        Snapshot{ std::move(system_trie), std::move(user_trie), current.m_ngram }) };
+
+    // 之后只有不抛出异常的替换
+    StringPool::commit_compact(compaction);
+    if (current.m_ngram)
+        current.m_ngram->swap_words(word_tables);
+    m_snapshot = std::move(snapshot);
+    m_strings_replaced.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+void Engine::load_user(std::string_view dict_file)
+{
+    std::lock_guard lock{ m_write_mutex };
+    auto current{ snapshot() };
+    auto user_trie{ clone(*current->m_user_trie) };
+    auto count{ load_text(dict_file, *user_trie, TextDictParser::s_all) };
+    freeze_dicts(*user_trie);
+    publish(current->m_system_trie, std::move(user_trie), current->m_ngram);
+    m_skipped_items.fetch_add(count.m_skipped, std::memory_order_relaxed);
+}
+
+Engine::ItemCount Engine::load_text(std::string_view dict_file, BasicTrie<Dict> &dict_trie, size_t head_size)
+{
+    MappedFile file{ dict_file };
+    auto text{ file.data() };
+    ItemCount count{ 0, 0, 0 };
+    // 文本词库每行一个 DictItem，不允许空行
+    count.m_total = static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+    if (!text.empty() && text.back() != '\n')
+        ++count.m_total;
+
+    auto parsed{ TextDictParser::parse(text, 0, head_size) };
+    count.m_skipped = parsed.m_skipped;
+    std::vector<bool> syllable_used(SyllableTable::size());
+    for (auto &bucket : parsed.m_buckets) {
+        for (auto &item : bucket.m_items) {
+            for (auto id : item.syllable_ids())
+                syllable_used[id] = true;
+        }
+        count.m_loaded += bucket.m_items.size();
+        dict_trie.add_if_miss(bucket.m_acronym).merge(bucket.m_items);
+    }
+    for (size_t id{ 0 }; id < syllable_used.size(); ++id) {
+        if (syllable_used[id])
+            PinYin::add_syllable(SyllableTable::syllable(static_cast<SyllableTable::Id>(id)));
+    }
+    return count;
+}
+
+Engine::CompiledSource Engine::open_compiled(std::string_view dict_file)
+{
+    CompiledSource source{ std::make_shared<const CompiledDict>(dict_file), {}, false };
+    auto &compiled{ source.m_dict };
+
+    auto &ids{ source.m_syllable_ids };
+    ids.resize(compiled->syllable_count());
+    bool same_ids{ true };
+    for (size_t i{ 0 }; i < ids.size(); ++i) {
+        auto s{ compiled->syllable(i) };
+        ids[i] = SyllableTable::intern(s);
+        PinYin::add_syllable(s);
+        same_ids = same_ids && ids[i] == i;
+    }
+    // 音节 ID 与文件一致且字符串池可以挂载文件内容时，DictItem 可以直接使用映射的文件内容
+    source.m_zero_copy = same_ids
+        && StringPool::attach(compiled->strings(), compiled->string_refs(), compiled);
+    return source;
+}
+
+Engine::ItemCount Engine::load_compiled(const CompiledSource &source, BasicTrie<Dict> &dict_trie, size_t head_size)
+{
+    auto &compiled{ source.m_dict };
+    auto &ids{ source.m_syllable_ids };
+    ItemCount count{ 0, 0, 0 };
+    // 转换音节 ID 后的 DictItem，在各 acronym 间复用
+    std::vector<DictItem> bucket;
+    for (size_t i{ 0 }; i < compiled->acronym_count(); ++i) {
+        // 每个 acronym 的 DictItem 已按频率从高到低排序
+        auto items{ compiled->items(i) };
+        count.m_total += items.size();
+        items = items.first(std::min(items.size(), head_size));
+        count.m_loaded += items.size();
+        Dict &dict{ dict_trie.add_if_miss(compiled->acronym(i)) };
+        if (source.m_zero_copy && dict.size() == 0) {
+            dict.share(items, compiled);
+            continue;
+        }
+        // 整个 acronym 的 DictItem 一次合并到 Dict，避免逐个添加时在词库树的单调内存池中反复扩容
+        if (source.m_zero_copy) {
+            dict.merge(items);
+            continue;
+        }
+        bucket.clear();
+        for (auto &item : items) {
+            DictItem::SyllableId syllables[DictItem::s_max_syllables];
+            auto item_ids{ item.syllable_ids() };
+            for (size_t j{ 0 }; j < item_ids.size(); ++j) {
+                if (item_ids[j] >= ids.size())
+                    throw std::invalid_argument{ "Compiled dict item corrupted" };
+                syllables[j] = ids[item_ids[j]];
+            }
+            bucket.push_back(DictItem{
+                StringPool::intern(compiled->string(item.chinese_ref())),
+                std::span{ syllables, item_ids.size() },
+                item.freq()
+            });
+        }
+        dict.merge(bucket);
+    }
+    return count;
+}
+
+void Engine::save(std::string_view dict_file) const
+{
+    wait_load();
+    flush();
+    write_text(merged_dicts(*snapshot()), dict_file);
+}
+
+void Engine::save_compiled(std::string_view dict_file) const
+{
+    wait_load();
+    flush();
+    CompiledDict::write(merged_dicts(*snapshot()), dict_file);
+}
+
+void Engine::save_user(std::string_view dict_file) const
+{
+    flush();
+    write_text(dicts(*snapshot()->m_user_trie), dict_file);
+}
+
+std::vector<Dict> Engine::dicts(const BasicTrie<Dict> &dict_trie)
+{
+    std::vector<Dict> dicts;
+    auto end_iter{ dict_trie.end() };
+    for (auto dict_it{ dict_trie.begin() }; dict_it != end_iter; ++dict_it)
+        dicts.push_back(*dict_it);
+    return dicts;
+}
+
+void Engine::build_indexes(BasicTrie<Dict> &dict_trie)
+{
+    auto end_iter{ dict_trie.end() };
+    for (auto dict_it{ dict_trie.begin() }; dict_it != end_iter; ++dict_it) {
+        if (!dict_it->has_index())
+            dict_it->build_index();
+    }
+}
+
+std::shared_ptr<BasicTrie<Dict>> Engine::make_trie(bool arena)
+{
+    if (!arena)
+        return std::make_shared<BasicTrie<Dict>>();
+    // 词库树先于内存池析构
+    struct ArenaTrie {
+        std::pmr::monotonic_buffer_resource m_arena;
+        BasicTrie<Dict> m_trie{ &m_arena };
+    };
+    auto holder{ std::make_shared<ArenaTrie>() };
+    return { holder, &holder->m_trie };
+}
+
+std::shared_ptr<BasicTrie<Dict>> Engine::clone(const BasicTrie<Dict> &dict_trie, bool arena)
+{
+    auto result{ make_trie(arena) };
+    auto end_iter{ dict_trie.end() };
+    for (auto dict_it{ dict_trie.begin() }; dict_it != end_iter; ++dict_it)
+        result->add_if_miss(dict_it.string()) = *dict_it;
+    return result;
+}
+
+std::shared_ptr<BasicTrie<Dict>> Engine::share(const BasicTrie<Dict> &dict_trie)
+{
+    return std::make_shared<BasicTrie<Dict>>(dict_trie, BasicTrie<Dict>::s_share);
+}
+
+void Engine::freeze_dicts(BasicTrie<Dict> &dict_trie)
+{
+    auto end_iter{ dict_trie.end() };
+    for (auto dict_it{ dict_trie.begin() }; dict_it != end_iter; ++dict_it)
+        dict_it->freeze();
+}
+
+std::vector<Dict> Engine::merged_dicts(const Snapshot &snapshot)
+{
+    auto &system_trie{ *snapshot.m_system_trie };
+    auto &user_trie{ *snapshot.m_user_trie };
+    std::vector<Dict> dicts;
+    auto end_iter{ system_trie.end() };
+    for (auto dict_it{ system_trie.begin() }; dict_it != end_iter; ++dict_it) {
+        dicts.push_back(*dict_it);
+        auto acronym{ dict_it.string() };
+        if (!user_trie.contains(acronym))
+            continue;
+        Dict &dict{ dicts.back() };
+        std::vector<std::pair<size_t, uint32_t>> freqs;
+        std::vector<DictItem> new_items;
+        for (auto &item : user_trie.data(acronym)) {
+            if (auto idx{ dict.find(item) }; idx != Dict::s_npos)
+                freqs.emplace_back(idx, item.freq());
+            else
+                new_items.push_back(item);
+        }
+        dict.set_freq(freqs);
+        dict.merge(new_items);
+    }
+    auto user_end_iter{ user_trie.end() };
+    for (auto dict_it{ user_trie.begin() }; dict_it != user_end_iter; ++dict_it) {
+        if (!system_trie.contains(dict_it.string()))
+            dicts.push_back(*dict_it);
+    }
+    return dicts;
+}
+
+void Engine::write_text(std::span<const Dict> dicts, std::string_view dict_file)
+{
+    using std::operator""s;
+
+    std::string tmp_file{ std::string{ dict_file } + ".tmp" };
+    {
+        std::ofstream file{ tmp_file, std::ios::binary | std::ios::trunc };
+        if (!file)
+            throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
+        for (auto &dict : dicts) {
+            for (auto &item : dict) {
+                file << item.chinese() << ' ';
+                file << item.freq() << ' ';
+                file << item.pinyin() << '\n';
+            }
+        }
+        file.flush();
+        if (!file)
+            throw std::runtime_error{ "Write file failed: "s + std::error_code(errno, std::generic_category()).message() };
+    }
+    FileSync::sync_file(tmp_file);
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, std::string{ dict_file }, ec);
+    if (ec)
+        throw std::runtime_error{ "Rename file failed: "s + ec.message() };
+    // compact() 在此之后截断日志，替换必须先于截断持久化
+    FileSync::sync_parent_dir(dict_file);
+}
+
+void Engine::open_journal(std::string_view journal_file)
+{
+    close_journal();
+    std::lock_guard lock{ m_write_mutex };
+    auto journal{ std::make_shared<Journal>(journal_file) };
+    auto current{ snapshot() };
+    auto user_trie{ clone(*current->m_user_trie) };
+    Snapshot view{ current->m_system_trie, user_trie, nullptr };
+
+    // 记录只作用于用户词库；SetFreq 记录在用户词库中更新或添加词条，
+    // AddItem 记录仅在两层词库中都不存在该词条时添加
+    journal->replay([&](const Journal::Event &event) {
+        // 旧版本可能记录过超过音节数量上限的句子
+        if (DictItem::count_syllables(event.m_pinyin) > DictItem::s_max_syllables) {
+            m_skipped_items.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        DictItem item{ event.m_chinese, event.m_pinyin, event.m_freq };
+        for (size_t i{ 0 }; i < item.syllable_count(); ++i)
+            PinYin::add_syllable(item.syllable(i));
+        if (event.m_type == Journal::EventType::AddItem && view.contains_entry(item))
+            return;
+        Dict &dict{ user_trie->add_if_miss(item.acronym()) };
+        if (auto idx{ dict.find(item) }; idx != Dict::s_npos) {
+            std::pair<size_t, uint32_t> freq{ idx, event.m_freq };
+            dict.set_freq({ &freq, 1 });
+        } else {
+            dict.add(item);
+        }
+    });
+    freeze_dicts(*user_trie);
+    publish(current->m_system_trie, std::move(user_trie), current->m_ngram);
+    m_journal = std::move(journal);
+}
+
+void Engine::close_journal()
+{
+    flush();
+    std::lock_guard lock{ m_write_mutex };
+    if (m_compaction.valid())
+        m_compaction.get();
+    m_journal.reset();
+}
+
+void Engine::compact(std::string_view dict_file)
+{
+    flush();
+    std::lock_guard lock{ m_write_mutex };
+    if (m_compaction.valid())
+        m_compaction.get();
+    uint64_t seq{ m_journal ? m_journal->last_seq() : 0 };
+    m_compaction = std::async(std::launch::async,
+        [user_trie = snapshot()->m_user_trie, file = std::string{ dict_file }, journal = m_journal, seq]() {
+            write_text(dicts(*user_trie), file);
+            if (journal)
+                journal->discard_through(seq);
+        });
+}
+
+void Engine::wait_compaction()
+{
+    std::lock_guard lock{ m_write_mutex };
+    if (m_compaction.valid())
+        m_compaction.get();
+}
+
+void Engine::add_item_from_line(std::string_view line)
+{
+    auto fields{ TextDictParser::parse_line(line) };
+    DictItem item{ fields.m_chinese, fields.m_pinyin, fields.m_freq };
+    std::string acronym;
+    for (size_t i{ 0 }; i < item.syllable_count(); ++i) {
+        auto s{ item.syllable(i) };
+        PinYin::add_syllable(s);
+        acronym.push_back(s.front());
+    }
+    std::lock_guard lock{ m_write_mutex };
+    auto current{ snapshot() };
+    auto user_trie{ share(*current->m_user_trie) };
+    Dict &dict{ user_trie->add_if_miss(acronym) };
+    dict.add(std::move(item));
+    dict.freeze();
+    publish(current->m_system_trie, std::move(user_trie), current->m_ngram);
+}
+
+void Engine::load_ngram(std::string_view ngram_file)
+{
+    auto ngram{ std::make_shared<NGramModel>(ngram_file) };
+    std::lock_guard lock{ m_write_mutex };
+    auto current{ snapshot() };
+    publish(current->m_system_trie, current->m_user_trie, std::move(ngram));
+    m_strings_replaced.store(true, std::memory_order_relaxed);
+}
+
+void Engine::learn(std::span<const DictItem> items, bool inc_freq, bool add_new_sentence)
+{
+    if (items.empty() || !(inc_freq || add_new_sentence))
+        return;
+    m_learn_queue.push({ { items.begin(), items.end() }, inc_freq, add_new_sentence });
+    m_learn_pushed.fetch_add(1, std::memory_order_release);
+    m_learn_signal.fetch_add(1, std::memory_order_release);
+    m_learn_signal.notify_one();
+}
+
+void Engine::flush() const
+{
+    uint64_t target{ m_learn_pushed.load(std::memory_order_acquire) };
+    uint64_t applied{ m_learn_applied.load(std::memory_order_acquire) };
+    while (applied < target) {
+        m_learn_applied.wait(applied, std::memory_order_acquire);
+        applied = m_learn_applied.load(std::memory_order_acquire);
+    }
+    std::exception_ptr error;
+    {
+        std::lock_guard lock{ m_learn_error_mutex };
+        std::swap(error, m_learn_error);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void Engine::learn_loop() noexcept
+{
+    for (;;) {
+        uint64_t signal{ m_learn_signal.load(std::memory_order_acquire) };
+        std::vector<LearnEvent> events;
+        try {
+            events = m_learn_queue.take_all();
+            if (!events.empty())
+                apply_learn_events(events);
+        } catch (...) {
+            std::lock_guard lock{ m_learn_error_mutex };
+            if (!m_learn_error)
+                m_learn_error = std::current_exception();
+        }
+        if (!events.empty()) {
+            m_learn_applied.fetch_add(events.size(), std::memory_order_release);
+            m_learn_applied.notify_all();
+            continue;
+        }
+        if (m_learn_stopping.load(std::memory_order_acquire))
+            return;
+        m_learn_signal.wait(signal, std::memory_order_acquire);
+    }
+}
+
+void Engine::apply_learn_events(std::span<const LearnEvent> events)
+{
+    std::lock_guard lock{ m_write_mutex };
+    auto current{ snapshot() };
+    auto user_trie{ share(*current->m_user_trie) };
+    Snapshot view{ current->m_system_trie, user_trie, nullptr };
+    // 学习结果只写入用户词库，用户词库中没有的词条先从选择项拷贝；
+    // 同一批事件中需要增加频率的词条按 Dict 汇总，每个 Dict 最后只排序一次
+    std::map<Dict*, std::vector<const DictItem*>> map;
+    // 被修改的 Dict，发布前重新冻结，见 share()
+    std::vector<Dict*> touched;
+    for (auto &event : events) {
+        auto &items{ event.m_items };
+        if (event.m_inc_freq) {
+            for (auto &item : items) {
+                Dict &dict{ user_trie->add_if_miss(item.acronym()) };
+                if (dict.find(item) == Dict::s_npos)
+                    dict.add(item);
+                map[&dict].push_back(&item);
+                touched.push_back(&dict);
+            }
+        }
+        size_t syllable_count{ 0 };
+        for (auto &item : items)
+            syllable_count += item.syllable_count();
+        // 超过 DictItem 音节数量上限的句子无法作为新词条保存，只计数
+        if (event.m_add_new_sentence && syllable_count > DictItem::s_max_syllables) {
+            m_skipped_items.fetch_add(1, std::memory_order_relaxed);
+        } else if (event.m_add_new_sentence) {
+            std::string chinese;
+            std::string pinyin;
+            for (size_t i{ 0 }; i < items.size(); ++i) {
+                chinese += items[i].chinese();
+                pinyin += items[i].pinyin();
+                if (i != items.size() - 1)
+                    pinyin.push_back(PinYin::s_delim);
+            }
+            DictItem new_item{ chinese, pinyin, 1 };
+            // 已存在的词、句不重复添加
+            if (!view.contains_entry(new_item)) {
+                Dict &dict{ user_trie->add_if_miss(new_item.acronym()) };
+                dict.add(new_item);
+                touched.push_back(&dict);
+                if (m_journal)
+                    m_journal->append({ Journal::EventType::AddItem, std::move(chinese), std::move(pinyin), 1 });
+            }
+        }
+        if (current->m_ngram && items.size() > 1)
+            current->m_ngram->observe(items);
+    }
+    for (auto &[dict, dict_items] : map) {
+        std::vector<size_t> indexes;
+        for (auto item : dict_items)
+            indexes.push_back(dict->find(*item));
+        dict->auto_inc_freq(indexes);
+        if (!m_journal)
+            continue;
+        // 同一词条在批次中出现多次时只记录一次最终频率
+        for (size_t i{ 0 }; i < dict_items.size(); ++i) {
+            auto item{ dict_items[i] };
+            bool logged{ false };
+            for (size_t j{ 0 }; j < i; ++j)
+                logged = logged || dict_items[j]->same_entry(*item);
+            if (logged)
+                continue;
+            m_journal->append({
+                Journal::EventType::SetFreq, std::string{ item->chinese() },
+                item->pinyin(), (*dict)[dict->find(*item)].freq()
+            });
+        }
+    }
+    for (auto dict : touched)
+        dict->freeze();
+    publish(current->m_system_trie, std::move(user_trie), current->m_ngram);
+    if (m_journal)
+        m_journal->commit();
+}
+
+} // namespace pinyin_ime
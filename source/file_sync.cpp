@@ -0,0 +1,65 @@
+#include "file_sync.h"
+#include <filesystem>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
+
+namespace pinyin_ime {
+
+namespace {
+
+std::runtime_error io_error(const char *what, int err)
+{
+    using std::operator""s;
+    return std::runtime_error{ what + ": "s + std::error_code(err, std::generic_category()).message() };
+}
+
+} // namespace
+
+void FileSync::sync_file(std::string_view file)
+{
+#ifdef _WIN32
+    int fd{ ::_open(std::string{ file }.c_str(), _O_RDONLY | _O_BINARY) };
+#else
+    int fd{ ::open(std::string{ file }.c_str(), O_RDONLY | O_CLOEXEC) };
+#endif
+    if (fd < 0)
+        throw io_error("Open file failed", errno);
+#ifdef _WIN32
+    int r{ ::_commit(fd) };
+    int err{ errno };
+    ::_close(fd);
+#else
+    int r{ ::fsync(fd) };
+    int err{ errno };
+    ::close(fd);
+#endif
+    if (r != 0)
+        throw io_error("Sync file failed", err);
+}
+
+void FileSync::sync_parent_dir([[maybe_unused]] std::string_view file)
+{
+#ifndef _WIN32
+    auto dir{ std::filesystem::path{ file }.parent_path() };
+    if (dir.empty())
+        dir = ".";
+    int fd{ ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+    if (fd < 0)
+        throw io_error("Open directory failed", errno);
+    int r{ ::fsync(fd) };
+    int err{ errno };
+    ::close(fd);
+    if (r != 0)
+        throw io_error("Sync directory failed", err);
+#endif
+}
+
+} // namespace pinyin_ime
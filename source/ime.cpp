@@ -1,270 +1,270 @@
 #include "ime.h"
-#include <map>
-#include <fstream>
 
 namespace pinyin_ime {
 
+IME::IME()
+    : IME{ std::make_shared<Engine>() }
+{}
+
+IME::IME(std::shared_ptr<Engine> engine)
+    : m_engine{ engine }, m_session{ std::move(engine) }
+{}
+
 IME::IME(std::string_view dict_file)
+    : IME{ std::make_shared<Engine>(dict_file) }
+{}
+
+void IME::load(std::string_view dict_file)
 {
-    load(dict_file);
+    m_engine->load(dict_file);
+    m_session.reset_search();
 }
 
-void IME::load(std::string_view dict_file)
+void IME::load_async(std::string_view dict_file, size_t head_size)
 {
-    using std::operator""s;
-
-    std::ifstream file{ dict_file.data(), std::ios::binary };
-    if (!file)
-        throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
-    // remove BOM
-    uint8_t bom[3]{ 0 };
-    file.read(reinterpret_cast<char*>(bom), 3);
-    if (file.gcount() != 3)
-        throw std::runtime_error{ "Read file failed: "s + std::error_code(errno, std::generic_category()).message() };
-    if (bom[0] != 0xef || bom[1] != 0xbb || bom[2] != 0xbf)
-        file.seekg(0);
-
-    for (std::string line; std::getline(file, line);) {
-        add_item_from_line(line);
-    }
+    m_engine->load_async(dict_file, head_size);
+}
+
+void IME::reload(std::string_view dict_file)
+{
+    m_engine->reload(dict_file);
+}
+
+void IME::reload_async(std::string_view dict_file)
+{
+    m_engine->reload_async(dict_file);
+}
+
+Engine::LoadProgress IME::load_progress() const noexcept
+{
+    return m_engine->load_progress();
+}
+
+void IME::wait_load()
+{
+    m_engine->wait_load();
+    m_session.reset_search();
 }
 
 void IME::save(std::string_view dict_file) const
 {
-    using std::operator""s;
-
-    std::ofstream file{ dict_file.data(), std::ios::binary | std::ios::trunc };
-    if (!file)
-        throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
-
-    auto end_iter{ m_dict_trie.end() };
-    for (auto dict_it{ m_dict_trie.begin() }; dict_it != end_iter; ++dict_it) {
-        Dict &dict{ *dict_it };
-        for (auto item_it{ dict.begin() }; item_it != dict.end(); ++item_it) {
-            const DictItem &item{ *item_it };
-            file << item.chinese() << ' ';
-            file << item.freq() << ' ';
-            file << item.pinyin() << '\n';
-        }
-    }
+    m_engine->save(dict_file);
+}
+
+void IME::save_compiled(std::string_view dict_file) const
+{
+    m_engine->save_compiled(dict_file);
+}
+
+void IME::load_user(std::string_view dict_file)
+{
+    m_engine->load_user(dict_file);
+    m_session.reset_search();
+}
+
+void IME::save_user(std::string_view dict_file) const
+{
+    m_engine->save_user(dict_file);
+}
+
+void IME::open_journal(std::string_view journal_file)
+{
+    m_engine->open_journal(journal_file);
+    m_session.reset_search();
+}
+
+void IME::close_journal()
+{
+    m_engine->close_journal();
+}
+
+void IME::open_trace(std::string_view trace_file)
+{
+    m_trace = std::make_unique<KeystrokeTrace>(trace_file);
+}
+
+void IME::close_trace()
+{
+    if (!m_trace)
+        return;
+    auto trace{ std::move(m_trace) };
+    trace->flush();
+}
+
+void IME::compact(std::string_view dict_file)
+{
+    m_engine->compact(dict_file);
+}
+
+void IME::wait_compaction()
+{
+    m_engine->wait_compaction();
+}
+
+void IME::add_item_from_line(std::string_view line)
+{
+    m_engine->add_item_from_line(line);
+    m_session.reset_search();
+}
+
+void IME::load_ngram(std::string_view ngram_file)
+{
+    m_engine->load_ngram(ngram_file);
+    m_session.reset_search();
 }
 
 const Candidates& IME::candidates() const noexcept
 {
-    return m_candidates;
+    return m_session.candidates();
 }
 
-const Candidates&IME::search(std::string_view pinyin)
+const Candidates& IME::search(std::string_view pinyin)
 {
-    std::string_view cur_pinyin{ m_pinyin.pinyin() };
-    if (!pinyin.starts_with(cur_pinyin)) {
-        if (cur_pinyin.starts_with(pinyin)) {
-            auto count = cur_pinyin.size() - pinyin.size();
-            if (count <= m_pinyin.unfixed_letters().size())
-                return backspace(count);
-        }
-        reset_search();
-        return push_back(pinyin);
-    } else if (pinyin.size() == cur_pinyin.size()) {
-        return m_candidates;
+    if (!m_trace)
+        return m_session.search(pinyin);
+
+    // 以与 Session::search() 相同的规则，记录为等效的事件
+    using ET = KeystrokeTrace::EventType;
+    std::string_view cur_pinyin{ m_session.pinyin() };
+    std::vector<KeystrokeTrace::Event> events;
+    if (pinyin.starts_with(cur_pinyin)) {
+        if (pinyin.size() > cur_pinyin.size())
+            events.push_back({ ET::PushBack, std::string{ pinyin.substr(cur_pinyin.size()) }, 0 });
+    } else if (cur_pinyin.starts_with(pinyin)
+               && cur_pinyin.size() - pinyin.size() <= m_session.unfixed_letters().size()) {
+        events.push_back({ ET::Backspace, {}, cur_pinyin.size() - pinyin.size() });
     } else {
-        return push_back(std::string_view{ pinyin.begin() + cur_pinyin.size(), pinyin.end() });
+        events.push_back({ ET::Reset, {}, 0 });
+        if (!pinyin.empty())
+            events.push_back({ ET::PushBack, std::string{ pinyin }, 0 });
     }
+    auto &candidates{ m_session.search(pinyin) };
+    for (auto &event : events)
+        record(std::move(event));
+    return candidates;
 }
 
-const Candidates& IME::search_impl(PinYin::TokenSpan tokens)
+const Candidates& IME::choose(size_t idx)
 {
-    std::stack<PinYin::TokenSpan> tokens_for_search;
-    size_t tokens_size{ tokens.size() };
-    for (size_t i{ 0 }; i < tokens_size; ++i) {
-        PinYin::TokenSpan sub_tokens{ tokens.begin(), tokens.begin() + i + 1 };
-        std::string acronym;
-        for (auto &token : sub_tokens) {
-            if (!token.m_token.empty())
-                acronym.push_back(token.m_token.front());
-        }
-        if (m_dict_trie.contains(acronym))
-            tokens_for_search.push(sub_tokens);
-    }
-    m_candidates.clear();
-    while (!tokens_for_search.empty()) {
-        Query q{ m_dict_trie, tokens_for_search.top() };
-        if (q.size())
-            m_candidates.push_back(std::move(q));
-        tokens_for_search.pop();
-    }
-    return m_candidates;
+    auto &candidates{ m_session.choose(idx) };
+    record({ KeystrokeTrace::EventType::Choose, {}, idx });
+    return candidates;
+}
+
+const Candidates& IME::choose(const CandidateStream::Entry &entry)
+{
+    return m_session.choose(entry);
+}
+
+const Candidates& IME::choose(const SentenceComposer::Sentence &sentence)
+{
+    auto &candidates{ m_session.choose(sentence) };
+    record({ KeystrokeTrace::EventType::ChooseSentence, {}, 0 });
+    return candidates;
+}
+
+CandidateStream IME::candidate_stream(CandidateStream::Scorer scorer) const
+{
+    return m_session.candidate_stream(std::move(scorer));
+}
+
+SentenceComposer::Sentence IME::compose_sentence(std::chrono::microseconds budget)
+{
+    return m_session.compose_sentence(budget);
+}
+
+void IME::set_bigram_cost(SentenceComposer::BigramCost cost, size_t beam_width)
+{
+    m_session.set_bigram_cost(std::move(cost), beam_width);
 }
 
 const Candidates& IME::push_back(std::string_view pinyin)
 {
-    return search_impl(m_pinyin.push_back(pinyin));
+    auto &candidates{ m_session.push_back(pinyin) };
+    if (m_trace && !pinyin.empty())
+        record({ KeystrokeTrace::EventType::PushBack, std::string{ pinyin }, 0 });
+    return candidates;
 }
 
 const Candidates& IME::backspace(size_t count)
 {
-    // TODO: behaviour
-    return search_impl(m_pinyin.backspace(count));
+    auto &candidates{ m_session.backspace(count) };
+    record({ KeystrokeTrace::EventType::Backspace, {}, count });
+    return candidates;
 }
 
 void IME::finish_search(bool inc_freq, bool add_new_sentence)
 {
-    size_t choices_count{ m_choices.size() };
-    if (choices_count && inc_freq) {
-        std::map<Dict*, std::vector<size_t>> map;
-        for (auto &c : m_choices) {
-            map[&c.m_dict].emplace_back(c.m_idx);
-        }
-        for (auto &p : map) {
-            p.first->auto_inc_freq(p.second);
-        }
-    }
-    if (choices_count && add_new_sentence) {
-        std::string chinese;
-        std::string pinyin;
-        for (size_t i{ 0 }; i < choices_count; ++i) {
-            auto &choice{ m_choices[i] };
-            chinese += choice.m_dict[choice.m_idx].chinese();
-            pinyin += choice.m_dict[choice.m_idx].pinyin();
-            if (i != choices_count - 1)
-                pinyin.push_back(PinYin::s_delim);
-        }
-        DictItem new_item{ std::move(chinese), std::move(pinyin), 1 };
-        m_dict_trie.add_if_miss(new_item.acronym()).add(std::move(new_item));
+    m_session.finish_search(inc_freq, add_new_sentence);
+    if (m_trace) {
+        record({ KeystrokeTrace::EventType::FinishSearch, {},
+                 (inc_freq ? KeystrokeTrace::s_inc_freq : 0) | (add_new_sentence ? KeystrokeTrace::s_add_new_sentence : 0) });
+        m_trace->flush();
     }
-    reset_search();
+}
+
+void IME::flush()
+{
+    m_engine->flush();
+    m_session.reset_search();
 }
 
 void IME::reset_search() noexcept
 {
-    m_candidates.clear();
-    m_choices.clear();
-    m_pinyin.clear();
+    if (!m_session.pinyin().empty() || !m_session.choices().empty())
+        record({ KeystrokeTrace::EventType::Reset, {}, 0 });
+    m_session.reset_search();
 }
 
 const std::vector<IME::Choice>& IME::choices() const noexcept
 {
-    return m_choices;
+    return m_session.choices();
 }
 
 PinYin::TokenSpan IME::tokens() const noexcept
 {
-    return m_pinyin.tokens();
+    return m_session.tokens();
 }
 
 PinYin::TokenSpan IME::fixed_tokens() const noexcept
 {
-    return m_pinyin.fixed_tokens();
+    return m_session.fixed_tokens();
 }
 
 PinYin::TokenSpan IME::unfixed_tokens() const noexcept
 {
-    return m_pinyin.unfixed_tokens();
+    return m_session.unfixed_tokens();
 }
 
 std::string_view IME::pinyin() const noexcept
 {
-    return m_pinyin.pinyin();
+    return m_session.pinyin();
 }
 
 std::string_view IME::fixed_letters() const noexcept
 {
-    return m_pinyin.fixed_letters();
+    return m_session.fixed_letters();
 }
 
 std::string_view IME::unfixed_letters() const noexcept
 {
-    return m_pinyin.unfixed_letters();
+    return m_session.unfixed_letters();
 }
 
-const Candidates& IME::choose(size_t idx)
+const std::shared_ptr<Engine>& IME::engine() const noexcept
 {
-    using std::string_literals::operator""s;
-    try {
-        auto qi{ m_candidates.to_query_and_index(idx) };
-        Query &query{ qi.first.get() };
-        size_t q_idx{ qi.second };
-        if (!query.dict()) // should not happen
-            throw std::logic_error{ "Query has no dict" };
-        Dict &dict{ *(query.dict()) };
-        size_t item_index{ dict.item_index(query[q_idx]) };
-        if (item_index == Dict::s_npos) // should not happen
-            throw std::logic_error{ "Get dict item index failed" };
-        size_t fix_count{ m_pinyin.fix_count_for_tokens(query.tokens()) };
-        if (fix_count == 0)
-            throw std::logic_error{ "Tokens to fix is empty" };
-        if (!m_pinyin.fix_front_tokens(fix_count))
-            throw std::logic_error{ "Fix tokens failed" };
-        m_choices.emplace_back(Choice{ query.tokens(), dict, item_index });
-        return search_impl(m_pinyin.unfixed_tokens());
-    } catch (const std::exception &e) {
-        std::throw_with_nested(
-            std::runtime_error{ "Choose candidate of index "s
-                + std::to_string(idx) + "failed" });
-    }
+    return m_engine;
 }
 
-void IME::add_item_from_line(std::string_view line)
-{
-    reset_search();
-    DictItem item{ line_to_item(line) };
-    std::string acronym;
-    for (auto &s : item.syllables()) {
-        if (!s.empty()) {
-            PinYin::add_syllable(s);
-            acronym.push_back(s.front());
-        }
-    }
-    m_dict_trie.add_if_miss(acronym).add(std::move(item));
-}
-
-DictItem IME::line_to_item(std::string_view line)
-{
-    std::string_view chinese, pinyin;
-    uint32_t freq{ 0 };
-    auto start{ std::string::npos };
-    auto end{ std::string::npos };
-
-    start = line.find_first_not_of(" \t\r");
-    if (start == std::string::npos)
-        throw std::invalid_argument{ "Line format wrong" };
-    end = line.find_first_of(" \t\r", start);
-    if (end == std::string::npos)
-        throw std::invalid_argument{ "Line format wrong" };
-    chinese = std::string_view{ line.begin() + start, line.begin() + end };
-
-    start = line.find_first_not_of(" \t\r", end);
-    if (start == std::string::npos)
-        throw std::invalid_argument{ "Line format wrong" };
-    end = line.find_first_of(" \t\r", start);
-    if (end == std::string::npos)
-        throw std::invalid_argument{ "Line format wrong" };
-    freq = static_cast<uint32_t>(std::stoul(std::string{ line.begin() + start, line.begin() + end }));
-
-    start = line.find_first_not_of(" \t\r", end);
-    if (start == std::string::npos)
-        throw std::invalid_argument{ "Line format wrong" };
-    end = line.find_first_of(" \t\r", start);
-    if (end == std::string::npos)
-        pinyin = std::string_view{ line.begin() + start, line.end() };
-    else
-        pinyin = std::string_view{ line.begin() + start, line.begin() + end };
-
-    return DictItem{ std::string{ chinese }, std::string{ pinyin }, freq };
-}
-
-IME::Choice::Choice(PinYin::TokenSpan tokens, Dict &dict, size_t index) noexcept
-    : m_tokens{ tokens }, m_dict{ dict }, m_idx{ index }
-{}
-
-PinYin::TokenSpan IME::Choice::tokens() const noexcept
+Session& IME::session() noexcept
 {
-    return m_tokens;
+    return m_session;
 }
 
-std::string_view IME::Choice::chinese() const noexcept
+void IME::record(KeystrokeTrace::Event event) noexcept
 {
-    return m_dict[m_idx].chinese();
+    if (m_trace)
+        m_trace->record(event);
 }
 
-} // namespace pinyin_ime
\ No newline at end of file
+} // namespace pinyin_ime
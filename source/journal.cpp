@@ -0,0 +1,283 @@
+#include "journal.h"
+#include "file_sync.h"
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#ifdef _WIN32
+#  include <io.h>
+#  define PINYIN_IME_OPEN ::_open
+#  define PINYIN_IME_WRITE ::_write
+#  define PINYIN_IME_CLOSE ::_close
+#  define PINYIN_IME_DATASYNC ::_commit
+#  define PINYIN_IME_TRUNCATE ::_chsize_s
+#  define PINYIN_IME_SEEK ::_lseeki64
+#  define PINYIN_IME_OPEN_FLAGS (_O_BINARY)
+#else
+#  include <unistd.h>
+#  define PINYIN_IME_OPEN ::open
+#  define PINYIN_IME_WRITE ::write
+#  define PINYIN_IME_CLOSE ::close
+#  if defined(__APPLE__)
+#    define PINYIN_IME_DATASYNC ::fsync
+#  else
+#    define PINYIN_IME_DATASYNC ::fdatasync
+#  endif
+#  define PINYIN_IME_TRUNCATE ::ftruncate
+#  define PINYIN_IME_SEEK ::lseek
+#  define PINYIN_IME_OPEN_FLAGS (O_CLOEXEC)
+#endif
+
+namespace pinyin_ime {
+
+namespace {
+
+// 记录格式：uint32 负载长度、uint32 负载校验和、负载
+// 负载格式：uint64 序号、uint8 类型、uint32 频率、uint16 中文长度、uint16 拼音长度、中文、拼音
+constexpr size_t s_record_header_size{ 2 * sizeof(uint32_t) };
+constexpr size_t s_payload_fixed_size{ sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t) + 2 * sizeof(uint16_t) };
+
+uint32_t checksum(std::string_view data) noexcept
+{
+    uint32_t h{ 2166136261u };
+    for (unsigned char c : data)
+        h = (h ^ c) * 16777619u;
+    return h;
+}
+
+template <class T>
+void put(std::string &out, T value)
+{
+    char buf[sizeof(T)];
+    std::memcpy(buf, &value, sizeof(T));
+    out.append(buf, sizeof(T));
+}
+
+template <class T>
+T get(std::string_view &in) noexcept
+{
+    T value;
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return value;
+}
+
+std::runtime_error io_error(const char *what, int err)
+{
+    using std::operator""s;
+    return std::runtime_error{ what + ": "s + std::error_code(err, std::generic_category()).message() };
+}
+
+void write_all(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        auto n{ PINYIN_IME_WRITE(fd, data.data(), static_cast<unsigned>(data.size())) };
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw io_error("Write file failed", errno);
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+}
+
+} // namespace
+
+Journal::Journal(std::string_view file)
+    : m_file{ file }
+{
+    size_t valid_size{ 0 };
+    auto events{ read_events(valid_size) };
+    if (!events.empty())
+        m_last_seq = events.back().m_seq;
+    open_file();
+    try {
+        if (valid_size == 0) {
+            // 新文件，或文件头不完整
+            if (PINYIN_IME_TRUNCATE(m_fd, 0) != 0)
+                throw io_error("Truncate file failed", errno);
+            std::string header{ s_magic, sizeof(s_magic) };
+            put(header, s_version);
+            write_all(m_fd, header);
+            if (PINYIN_IME_DATASYNC(m_fd) != 0)
+                throw io_error("Sync file failed", errno);
+        } else if (PINYIN_IME_TRUNCATE(m_fd, static_cast<off_t>(valid_size)) != 0) {
+            throw io_error("Truncate file failed", errno);
+        }
+    } catch (...) {
+        close_file();
+        throw;
+    }
+}
+
+Journal::~Journal()
+{
+    try {
+        commit();
+    } catch (...) {}
+    close_file();
+}
+
+void Journal::open_file()
+{
+    m_fd = PINYIN_IME_OPEN(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | PINYIN_IME_OPEN_FLAGS, 0644);
+    if (m_fd < 0)
+        throw io_error("Open file failed", errno);
+}
+
+void Journal::close_file() noexcept
+{
+    if (m_fd >= 0) {
+        PINYIN_IME_CLOSE(m_fd);
+        m_fd = -1;
+    }
+}
+
+std::vector<Journal::Event> Journal::read_events(size_t &valid_size) const
+{
+    valid_size = 0;
+    std::vector<Event> events;
+    std::ifstream in{ m_file, std::ios::binary };
+    if (!in)
+        return events;
+    std::string content{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+    if (in.bad())
+        throw io_error("Read file failed", errno);
+    if (content.size() < s_header_size)
+        return events;
+    std::string_view data{ content };
+    if (std::memcmp(data.data(), s_magic, sizeof(s_magic)) != 0)
+        throw std::invalid_argument{ "Not a journal file" };
+    data.remove_prefix(sizeof(s_magic));
+    if (get<uint32_t>(data) != s_version)
+        throw std::invalid_argument{ "Journal version mismatch" };
+    valid_size = s_header_size;
+
+    // 遇到不完整或校验失败的记录即停止，其后的内容视为崩溃残留
+    while (data.size() >= s_record_header_size) {
+        std::string_view record{ data };
+        auto size{ get<uint32_t>(record) };
+        auto sum{ get<uint32_t>(record) };
+        if (size < s_payload_fixed_size || record.size() < size)
+            break;
+        std::string_view payload{ record.substr(0, size) };
+        if (checksum(payload) != sum)
+            break;
+        Event event;
+        event.m_seq = get<uint64_t>(payload);
+        event.m_type = static_cast<EventType>(get<uint8_t>(payload));
+        event.m_freq = get<uint32_t>(payload);
+        auto chinese_size{ get<uint16_t>(payload) };
+        auto pinyin_size{ get<uint16_t>(payload) };
+        if (payload.size() != size_t{ chinese_size } + pinyin_size)
+            break;
+        event.m_chinese = payload.substr(0, chinese_size);
+        event.m_pinyin = payload.substr(chinese_size);
+        events.push_back(std::move(event));
+        data.remove_prefix(s_record_header_size + size);
+        valid_size += s_record_header_size + size;
+    }
+    return events;
+}
+
+void Journal::encode(const Event &event, std::string &out)
+{
+    if (event.m_chinese.size() > UINT16_MAX || event.m_pinyin.size() > UINT16_MAX)
+        throw std::length_error{ "Journal event too long" };
+    std::string payload;
+    put(payload, event.m_seq);
+    put(payload, static_cast<uint8_t>(event.m_type));
+    put(payload, event.m_freq);
+    put(payload, static_cast<uint16_t>(event.m_chinese.size()));
+    put(payload, static_cast<uint16_t>(event.m_pinyin.size()));
+    payload += event.m_chinese;
+    payload += event.m_pinyin;
+    put(out, static_cast<uint32_t>(payload.size()));
+    put(out, checksum(payload));
+    out += payload;
+}
+
+void Journal::replay(const std::function<void(const Event&)> &f) const
+{
+    std::vector<Event> events;
+    {
+        std::lock_guard lock{ m_mutex };
+        size_t valid_size{ 0 };
+        events = read_events(valid_size);
+    }
+    for (auto &event : events)
+        f(event);
+}
+
+uint64_t Journal::append(Event event)
+{
+    std::lock_guard lock{ m_mutex };
+    event.m_seq = m_last_seq + 1;
+    encode(event, m_buffer);
+    return ++m_last_seq;
+}
+
+void Journal::commit()
+{
+    std::lock_guard lock{ m_mutex };
+    if (m_broken)
+        throw std::runtime_error{ "Journal is broken by an earlier failed commit" };
+    if (m_buffer.empty())
+        return;
+    auto size{ PINYIN_IME_SEEK(m_fd, 0, SEEK_END) };
+    if (size < 0)
+        throw io_error("Seek file failed", errno);
+    try {
+        write_all(m_fd, m_buffer);
+        if (PINYIN_IME_DATASYNC(m_fd) != 0)
+            throw io_error("Sync file failed", errno);
+    } catch (...) {
+        // 截掉写入了一部分的记录并保留缓冲区，下次提交时重新写入；
+        // 否则之后追加的记录会排在不完整的记录之后，下次打开时随之被截断
+        if (PINYIN_IME_TRUNCATE(m_fd, size) != 0)
+            m_broken = true;
+        throw;
+    }
+    m_buffer.clear();
+}
+
+uint64_t Journal::last_seq() const noexcept
+{
+    std::lock_guard lock{ m_mutex };
+    return m_last_seq;
+}
+
+void Journal::discard_through(uint64_t seq)
+{
+    commit();
+    std::lock_guard lock{ m_mutex };
+    size_t valid_size{ 0 };
+    auto events{ read_events(valid_size) };
+    std::string content{ s_magic, sizeof(s_magic) };
+    put(content, s_version);
+    for (auto &event : events) {
+        if (event.m_seq > seq)
+            encode(event, content);
+    }
+
+    std::string tmp_file{ m_file + ".tmp" };
+    {
+        std::ofstream out{ tmp_file, std::ios::binary | std::ios::trunc };
+        if (!out || !out.write(content.data(), static_cast<std::streamsize>(content.size())) || !out.flush())
+            throw io_error("Write file failed", errno);
+    }
+    FileSync::sync_file(tmp_file);
+    close_file();
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, m_file, ec);
+    open_file();
+    if (ec)
+        throw std::runtime_error{ "Rename file failed: " + ec.message() };
+    FileSync::sync_parent_dir(m_file);
+}
+
+} // namespace pinyin_ime
@@ -0,0 +1,150 @@
+#include "keystroke_trace.h"
+#include <algorithm>
+#include <charconv>
+#include <exception>
+#include <stdexcept>
+
+namespace pinyin_ime {
+
+namespace {
+
+constexpr std::string_view s_type_names[KeystrokeTrace::s_event_type_count]{
+    "push_back", "backspace", "choose", "choose_sentence", "finish_search", "reset"
+};
+
+/**
+ * \brief 取出 line 开头以空白字符分隔的一个字段。
+ */
+std::string_view next_field(std::string_view &line) noexcept
+{
+    auto begin{ line.find_first_not_of(" \t\r") };
+    if (begin == std::string_view::npos) {
+        line = {};
+        return {};
+    }
+    line.remove_prefix(begin);
+    auto end{ std::min(line.find_first_of(" \t\r"), line.size()) };
+    auto field{ line.substr(0, end) };
+    line.remove_prefix(end);
+    return field;
+}
+
+size_t parse_number(std::string_view field)
+{
+    size_t value{ 0 };
+    auto [ptr, ec]{ std::from_chars(field.data(), field.data() + field.size(), value) };
+    if (field.empty() || ec != std::errc{} || ptr != field.data() + field.size())
+        throw std::invalid_argument{ "Invalid number in trace event" };
+    return value;
+}
+
+} // namespace
+
+std::string_view KeystrokeTrace::type_name(EventType type) noexcept
+{
+    return s_type_names[static_cast<size_t>(type)];
+}
+
+KeystrokeTrace::Event KeystrokeTrace::parse_line(std::string_view line)
+{
+    auto name{ next_field(line) };
+    Event event;
+    size_t type{ 0 };
+    while (type < s_event_type_count && s_type_names[type] != name)
+        ++type;
+    if (type == s_event_type_count)
+        throw std::invalid_argument{ "Unknown trace event type" };
+    event.m_type = static_cast<EventType>(type);
+
+    using ET = EventType;
+    switch (event.m_type) {
+    case ET::PushBack:
+        event.m_letters = next_field(line);
+        if (event.m_letters.empty())
+            throw std::invalid_argument{ "Missing letters in push_back event" };
+        break;
+    case ET::Backspace:
+    case ET::Choose:
+        event.m_value = parse_number(next_field(line));
+        break;
+    case ET::FinishSearch:
+        if (parse_number(next_field(line)))
+            event.m_value |= s_inc_freq;
+        if (parse_number(next_field(line)))
+            event.m_value |= s_add_new_sentence;
+        break;
+    case ET::ChooseSentence:
+    case ET::Reset:
+        break;
+    }
+    if (!next_field(line).empty())
+        throw std::invalid_argument{ "Extra field in trace event" };
+    return event;
+}
+
+void KeystrokeTrace::write(std::ostream &out, const Event &event)
+{
+    out << type_name(event.m_type);
+    using ET = EventType;
+    switch (event.m_type) {
+    case ET::PushBack:
+        out << ' ' << event.m_letters;
+        break;
+    case ET::Backspace:
+    case ET::Choose:
+        out << ' ' << event.m_value;
+        break;
+    case ET::FinishSearch:
+        out << ((event.m_value & s_inc_freq) ? " 1" : " 0")
+            << ((event.m_value & s_add_new_sentence) ? " 1" : " 0");
+        break;
+    case ET::ChooseSentence:
+    case ET::Reset:
+        break;
+    }
+}
+
+std::vector<KeystrokeTrace::Event> KeystrokeTrace::read(std::string_view file)
+{
+    std::ifstream in{ std::string{ file } };
+    if (!in)
+        throw std::runtime_error{ "Open file failed" };
+    std::vector<Event> events;
+    std::string line;
+    for (size_t line_no{ 1 }; std::getline(in, line); ++line_no) {
+        std::string_view view{ line };
+        auto begin{ view.find_first_not_of(" \t\r") };
+        if (begin == std::string_view::npos || view[begin] == '#')
+            continue;
+        try {
+            events.push_back(parse_line(view));
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::invalid_argument{ "Invalid trace event at line " + std::to_string(line_no) });
+        }
+    }
+    if (in.bad())
+        throw std::runtime_error{ "Read file failed" };
+    return events;
+}
+
+KeystrokeTrace::KeystrokeTrace(std::string_view file)
+    : m_out{ std::string{ file }, std::ios::out | std::ios::trunc }
+{
+    if (!m_out)
+        throw std::runtime_error{ "Open file failed" };
+}
+
+void KeystrokeTrace::record(const Event &event) noexcept
+{
+    // 写入错误使流进入失败状态，由 flush() 报告
+    write(m_out, event);
+    m_out << '\n';
+}
+
+void KeystrokeTrace::flush()
+{
+    if (!m_out.flush())
+        throw std::runtime_error{ "Write file failed" };
+}
+
+} // namespace pinyin_ime
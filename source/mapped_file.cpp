@@ -0,0 +1,69 @@
+#include "mapped_file.h"
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+#if defined(__unix__) || defined(__APPLE__)
+#  define PINYIN_IME_HAS_MMAP 1
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace pinyin_ime {
+
+MappedFile::MappedFile(std::string_view file)
+{
+    using std::operator""s;
+
+#ifdef PINYIN_IME_HAS_MMAP
+    int fd{ ::open(std::string{ file }.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0)
+        throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int err{ errno };
+        ::close(fd);
+        throw std::runtime_error{ "Stat file failed: "s + std::error_code(err, std::generic_category()).message() };
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size != 0) {
+        void *p{ ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0) };
+        if (p == MAP_FAILED) {
+            int err{ errno };
+            ::close(fd);
+            throw std::runtime_error{ "Map file failed: "s + std::error_code(err, std::generic_category()).message() };
+        }
+        m_data = static_cast<const char*>(p);
+        m_mapped = true;
+    }
+    ::close(fd);
+#else
+    std::ifstream in{ std::string{ file }, std::ios::binary | std::ios::ate };
+    if (!in)
+        throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
+    m_buffer.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size())))
+        throw std::runtime_error{ "Read file failed: "s + std::error_code(errno, std::generic_category()).message() };
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef PINYIN_IME_HAS_MMAP
+    if (m_mapped)
+        ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+}
+
+std::span<const char> MappedFile::data() const noexcept
+{
+    return { m_data, m_size };
+}
+
+} // namespace pinyin_ime
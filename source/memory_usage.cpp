@@ -0,0 +1,59 @@
+#include "memory_usage.h"
+#include <iomanip>
+
+namespace pinyin_ime {
+
+namespace {
+
+constexpr std::string_view s_subsystem_names[MemoryReport::s_subsystem_count]{
+    "system_trie", "system_dicts", "user_trie", "user_dicts",
+    "string_pool", "syllable_table", "syllable_trie", "ngram"
+};
+
+void write_row(std::ostream &out, std::string_view name, const MemoryUsage &usage)
+{
+    out << std::left << std::setw(16) << name << std::right
+        << std::setw(10) << usage.m_nodes
+        << std::setw(10) << usage.m_items
+        << std::setw(14) << usage.m_used_bytes
+        << std::setw(14) << usage.m_unused_bytes
+        << std::setw(14) << usage.m_mapped_bytes << '\n';
+}
+
+} // namespace
+
+std::string_view MemoryReport::subsystem_name(Subsystem subsystem) noexcept
+{
+    return s_subsystem_names[static_cast<size_t>(subsystem)];
+}
+
+MemoryUsage MemoryReport::total() const noexcept
+{
+    MemoryUsage result;
+    for (auto &usage : m_subsystems)
+        result += usage;
+    return result;
+}
+
+void MemoryReport::write(std::ostream &out) const
+{
+    out << std::left << std::setw(16) << "subsystem" << std::right
+        << std::setw(10) << "nodes" << std::setw(10) << "items"
+        << std::setw(14) << "used_bytes" << std::setw(14) << "unused_bytes"
+        << std::setw(14) << "mapped_bytes" << '\n';
+    for (size_t i{ 0 }; i < s_subsystem_count; ++i)
+        write_row(out, s_subsystem_names[i], m_subsystems[i]);
+    write_row(out, "total", total());
+    out << "learned_items " << m_learned_items << '\n';
+    if (m_largest_buckets.empty())
+        return;
+    out << std::left << std::setw(16) << "acronym" << std::right
+        << std::setw(8) << "dict" << std::setw(10) << "items" << std::setw(14) << "bytes" << '\n';
+    for (auto &bucket : m_largest_buckets) {
+        out << std::left << std::setw(16) << bucket.m_acronym << std::right
+            << std::setw(8) << (bucket.m_user ? "user" : "system")
+            << std::setw(10) << bucket.m_items << std::setw(14) << bucket.m_bytes << '\n';
+    }
+}
+
+} // namespace pinyin_ime
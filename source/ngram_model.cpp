@@ -0,0 +1,380 @@
+#include "ngram_model.h"
+#include "file_sync.h"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <mutex>
+#include <system_error>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+
+namespace pinyin_ime {
+
+namespace {
+
+constexpr size_t s_alignment{ 8 };
+
+size_t align_up(size_t n) noexcept
+{
+    return (n + s_alignment - 1) / s_alignment * s_alignment;
+}
+
+uint64_t bigram_key(uint32_t prev, uint32_t next) noexcept
+{
+    return uint64_t{ prev } << 32 | next;
+}
+
+} // namespace
+
+void NGramCounts::add_sentence(std::span<const std::string_view> words, uint32_t count)
+{
+    uint32_t prev{ UINT32_MAX };
+    for (auto word : words) {
+        if (word.empty())
+            continue;
+        uint32_t id{ word_id(word) };
+        m_unigrams[id] += count;
+        if (prev != UINT32_MAX)
+            m_bigrams[bigram_key(prev, id)] += count;
+        prev = id;
+    }
+}
+
+size_t NGramCounts::word_count() const noexcept
+{
+    return m_words.size();
+}
+
+size_t NGramCounts::bigram_count() const noexcept
+{
+    return m_bigrams.size();
+}
+
+uint32_t NGramCounts::word_id(std::string_view word)
+{
+    auto [iter, inserted] = m_word_ids.try_emplace(std::string{ word }, static_cast<uint32_t>(m_words.size()));
+    if (inserted) {
+        if (m_words.size() >= UINT32_MAX - 1) {
+            m_word_ids.erase(iter);
+            throw std::length_error{ "Too many words" };
+        }
+        m_words.emplace_back(word);
+        m_unigrams.push_back(0);
+    }
+    return iter->second;
+}
+
+template <class T>
+std::span<const T> NGramModel::section(const Section &s) const
+{
+    auto data{ m_file->data() };
+    if (s.m_offset % alignof(T) != 0 || s.m_size % sizeof(T) != 0
+        || s.m_offset > data.size() || s.m_size > data.size() - s.m_offset)
+        throw std::invalid_argument{ "NGram model section corrupted" };
+    return {
+        reinterpret_cast<const T*>(data.data() + s.m_offset),
+        static_cast<size_t>(s.m_size / sizeof(T))
+    };
+}
+
+NGramModel::NGramModel(std::string_view file)
+    : m_file{ std::make_unique<MappedFile>(file) }
+{
+    auto data{ m_file->data() };
+    if (data.size() < sizeof(Header))
+        throw std::invalid_argument{ "NGram model file too small" };
+    Header header;
+    std::memcpy(&header, data.data(), sizeof(Header));
+    if (std::memcmp(header.m_magic, s_magic, sizeof(s_magic)) != 0)
+        throw std::invalid_argument{ "Not a ngram model file" };
+    if (header.m_version != s_version)
+        throw std::invalid_argument{ "NGram model version mismatch" };
+    if (header.m_byte_order != s_byte_order)
+        throw std::invalid_argument{ "NGram model layout mismatch" };
+
+    auto words{ section<TextEntry>(header.m_words) };
+    auto word_text{ section<char>(header.m_word_text) };
+    m_unigrams = section<Unigram>(header.m_unigrams);
+    m_successor_offsets = section<uint32_t>(header.m_successor_offsets);
+    m_successors = section<Successor>(header.m_successors);
+
+    if (m_unigrams.size() != words.size() || m_successor_offsets.size() != words.size() + 1
+        || m_successor_offsets.front() != 0 || m_successor_offsets.back() != m_successors.size())
+        throw std::invalid_argument{ "NGram model index corrupted" };
+    for (size_t i{ 0 }; i < words.size(); ++i) {
+        if (m_successor_offsets[i] > m_successor_offsets[i + 1])
+            throw std::invalid_argument{ "NGram model index corrupted" };
+    }
+    for (auto &s : m_successors) {
+        if (s.m_word >= words.size())
+            throw std::invalid_argument{ "NGram model index corrupted" };
+    }
+
+    m_word_ids.reserve(words.size());
+    for (size_t i{ 0 }; i < words.size(); ++i) {
+        auto &e{ words[i] };
+        if (e.m_size == 0 || e.m_offset > word_text.size() || e.m_size > word_text.size() - e.m_offset)
+            throw std::invalid_argument{ "NGram model word table corrupted" };
+        auto ref{ StringPool::intern({ word_text.data() + e.m_offset, e.m_size }) };
+        m_word_ids.emplace(ref.m_offset, static_cast<uint32_t>(i));
+    }
+}
+
+bool NGramModel::is_ngram_model(std::string_view file) noexcept
+{
+    std::ifstream in{ std::string{ file }, std::ios::binary };
+    char magic[sizeof(s_magic)]{};
+    if (!in.read(magic, sizeof(magic)))
+        return false;
+    return std::memcmp(magic, s_magic, sizeof(s_magic)) == 0;
+}
+
+void NGramModel::write(const NGramCounts &counts, std::string_view file)
+{
+    using std::operator""s;
+
+    size_t word_count{ counts.m_words.size() };
+    if (counts.m_bigrams.size() > UINT32_MAX)
+        throw std::length_error{ "Too many bigrams" };
+    std::vector<TextEntry> words;
+    std::string word_text;
+    for (auto &word : counts.m_words) {
+        if (word_text.size() + word.size() > UINT32_MAX)
+            throw std::length_error{ "Word text too long" };
+        words.push_back({ static_cast<uint32_t>(word_text.size()), static_cast<uint32_t>(word.size()) });
+        word_text += word;
+    }
+
+    // 一元概率加一平滑，保证每个词的概率都不为 0
+    uint64_t total{ 0 };
+    for (auto c : counts.m_unigrams)
+        total += c;
+    std::vector<double> unigram_probs(word_count);
+    for (size_t i{ 0 }; i < word_count; ++i)
+        unigram_probs[i] = static_cast<double>(counts.m_unigrams[i] + 1) / static_cast<double>(total + word_count);
+
+    // 按 (前一个词, 后一个词) 排序后，同一个词的后继词连续且有序
+    std::vector<std::pair<uint64_t, uint64_t>> bigrams{ counts.m_bigrams.begin(), counts.m_bigrams.end() };
+    std::ranges::sort(bigrams);
+    std::vector<Unigram> unigrams(word_count);
+    std::vector<uint32_t> successor_offsets(word_count + 1);
+    std::vector<Successor> successors;
+    successors.reserve(bigrams.size());
+    size_t pos{ 0 };
+    for (uint32_t prev{ 0 }; prev < word_count; ++prev) {
+        successor_offsets[prev] = static_cast<uint32_t>(successors.size());
+        size_t end{ pos };
+        uint64_t context{ 0 };
+        while (end < bigrams.size() && (bigrams[end].first >> 32) == prev)
+            context += bigrams[end++].second;
+        // 绝对折扣插值：P(next|prev) = max(c - D, 0) / context + backoff * P(next)
+        double backoff{ 1.0 };
+        if (context != 0)
+            backoff = s_discount * static_cast<double>(end - pos) / static_cast<double>(context);
+        unigrams[prev] = { quantize(std::log(unigram_probs[prev])), quantize(std::log(backoff)) };
+        for (; pos < end; ++pos) {
+            auto next{ static_cast<uint32_t>(bigrams[pos].first) };
+            double prob{
+                (static_cast<double>(bigrams[pos].second) - s_discount) / static_cast<double>(context)
+                + backoff * unigram_probs[next]
+            };
+            successors.push_back({ next, quantize(std::log(prob)), 0 });
+        }
+    }
+    successor_offsets[word_count] = static_cast<uint32_t>(successors.size());
+
+    Header header{};
+    std::memcpy(header.m_magic, s_magic, sizeof(s_magic));
+    header.m_version = s_version;
+    header.m_byte_order = s_byte_order;
+    size_t offset{ align_up(sizeof(Header)) };
+    auto place = [&offset](Section &s, size_t size) {
+        s.m_offset = offset;
+        s.m_size = size;
+        offset = align_up(offset + size);
+    };
+    place(header.m_words, words.size() * sizeof(TextEntry));
+    place(header.m_word_text, word_text.size());
+    place(header.m_unigrams, unigrams.size() * sizeof(Unigram));
+    place(header.m_successor_offsets, successor_offsets.size() * sizeof(uint32_t));
+    place(header.m_successors, successors.size() * sizeof(Successor));
+
+    std::string tmp_file{ std::string{ file } + ".tmp" };
+    {
+        std::ofstream out{ tmp_file, std::ios::binary | std::ios::trunc };
+        if (!out)
+            throw std::runtime_error{ "Open file failed: "s + std::error_code(errno, std::generic_category()).message() };
+        size_t written{ 0 };
+        auto put = [&out, &written](const Section &s, const void *data) {
+            static const char zeros[s_alignment]{};
+            out.write(zeros, static_cast<std::streamsize>(s.m_offset - written));
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(s.m_size));
+            written = s.m_offset + s.m_size;
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        written = sizeof(Header);
+        put(header.m_words, words.data());
+        put(header.m_word_text, word_text.data());
+        put(header.m_unigrams, unigrams.data());
+        put(header.m_successor_offsets, successor_offsets.data());
+        put(header.m_successors, successors.data());
+        out.flush();
+        if (!out)
+            throw std::runtime_error{ "Write file failed: "s + std::error_code(errno, std::generic_category()).message() };
+    }
+    FileSync::sync_file(tmp_file);
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, std::string{ file }, ec);
+    if (ec)
+        throw std::runtime_error{ "Rename file failed: "s + ec.message() };
+    FileSync::sync_parent_dir(file);
+}
+
+uint16_t NGramModel::quantize(double log_prob) noexcept
+{
+    double q{ std::round(-log_prob * s_quant_scale) };
+    return static_cast<uint16_t>(std::clamp(q, 0.0, static_cast<double>(UINT16_MAX)));
+}
+
+double NGramModel::dequantize(uint16_t q) noexcept
+{
+    return -static_cast<double>(q) / s_quant_scale;
+}
+
+uint32_t NGramModel::word_id(const DictItem &item) const noexcept
+{
+    auto ref{ item.chinese_ref() };
+    if (ref.m_size == 0)
+        return s_npos;
+    auto iter{ m_word_ids.find(ref.m_offset) };
+    return iter == m_word_ids.end() ? s_npos : iter->second;
+}
+
+double NGramModel::base_log_prob(uint32_t prev, uint32_t next) const noexcept
+{
+    if (next == s_npos)
+        return s_unknown_log_prob;
+    double unigram{ dequantize(m_unigrams[next].m_log_prob) };
+    if (prev == s_npos)
+        return unigram;
+    auto begin{ m_successors.begin() + m_successor_offsets[prev] };
+    auto end{ m_successors.begin() + m_successor_offsets[prev + 1] };
+    auto iter{ std::lower_bound(begin, end, next, [](const Successor &s, uint32_t word) {
+        return s.m_word < word;
+    }) };
+    if (iter != end && iter->m_word == next)
+        return dequantize(iter->m_log_prob);
+    return dequantize(m_unigrams[prev].m_backoff) + unigram;
+}
+
+double NGramModel::log_prob(const DictItem &next) const noexcept
+{
+    return base_log_prob(s_npos, word_id(next));
+}
+
+double NGramModel::log_prob(const DictItem &prev, const DictItem &next) const noexcept
+{
+    double base{ base_log_prob(word_id(prev), word_id(next)) };
+    std::shared_lock lock{ m_delta_mutex };
+    if (m_delta_contexts.empty())
+        return base;
+    auto context{ m_delta_contexts.find(prev.chinese_ref().m_offset) };
+    if (context == m_delta_contexts.end())
+        return base;
+    double count{ 0 };
+    auto bigram{ m_delta_bigrams.find(bigram_key(prev.chinese_ref().m_offset, next.chinese_ref().m_offset)) };
+    if (bigram != m_delta_bigrams.end())
+        count = bigram->second;
+    double c{ static_cast<double>(context->second) };
+    double weight{ c / (c + s_delta_weight) };
+    return std::log((1 - weight) * std::exp(base) + weight * count / c);
+}
+
+double NGramModel::bigram_cost(const DictItem &prev, const DictItem &next) const noexcept
+{
+    return log_prob(next) - log_prob(prev, next);
+}
+
+void NGramModel::observe(std::span<const DictItem> words)
+{
+    std::unique_lock lock{ m_delta_mutex };
+    for (size_t i{ 1 }; i < words.size(); ++i) {
+        auto prev{ words[i - 1].chinese_ref() };
+        auto next{ words[i].chinese_ref() };
+        if (prev.m_size == 0 || next.m_size == 0)
+            continue;
+        ++m_delta_bigrams[bigram_key(prev.m_offset, next.m_offset)];
+        ++m_delta_contexts[prev.m_offset];
+    }
+}
+
+void NGramModel::collect_words(std::unordered_set<uint32_t> &offsets) const
+{
+    for (auto &[offset, id] : m_word_ids)
+        offsets.insert(offset);
+    std::shared_lock lock{ m_delta_mutex };
+    for (auto &[key, count] : m_delta_bigrams) {
+        offsets.insert(static_cast<uint32_t>(key >> 32));
+        offsets.insert(static_cast<uint32_t>(key));
+    }
+}
+
+NGramModel::WordTables NGramModel::remap_words(const std::unordered_map<uint32_t, StringPool::Ref> &moved) const
+{
+    auto remap{ [&](uint32_t offset) {
+        auto it{ moved.find(offset) };
+        return it == moved.end() ? offset : it->second.m_offset;
+    } };
+    WordTables tables;
+    tables.m_word_ids.reserve(m_word_ids.size());
+    for (auto &[offset, id] : m_word_ids)
+        tables.m_word_ids.emplace(remap(offset), id);
+    std::shared_lock lock{ m_delta_mutex };
+    tables.m_delta_bigrams.reserve(m_delta_bigrams.size());
+    for (auto &[key, count] : m_delta_bigrams) {
+        tables.m_delta_bigrams.emplace(
+            bigram_key(remap(static_cast<uint32_t>(key >> 32)), remap(static_cast<uint32_t>(key))), count);
+    }
+    tables.m_delta_contexts.reserve(m_delta_contexts.size());
+    for (auto &[offset, count] : m_delta_contexts)
+        tables.m_delta_contexts.emplace(remap(offset), count);
+    return tables;
+}
+
+void NGramModel::swap_words(WordTables &tables) noexcept
+{
+    // 调用者保证没有其它线程使用模型，不加锁，避免加锁失败时抛出异常
+    m_word_ids.swap(tables.m_word_ids);
+    m_delta_bigrams.swap(tables.m_delta_bigrams);
+    m_delta_contexts.swap(tables.m_delta_contexts);
+}
+
+size_t NGramModel::word_count() const noexcept
+{
+    return m_unigrams.size();
+}
+
+size_t NGramModel::bigram_count() const noexcept
+{
+    return m_successors.size();
+}
+
+size_t NGramModel::delta_bigram_count() const noexcept
+{
+    std::shared_lock lock{ m_delta_mutex };
+    return m_delta_bigrams.size();
+}
+
+MemoryUsage NGramModel::memory_usage() const noexcept
+{
+    auto usage{ MemoryUsage::hash_table(m_word_ids) };
+    if (m_file)
+        usage.m_mapped_bytes = m_file->data().size();
+    std::shared_lock lock{ m_delta_mutex };
+    usage += MemoryUsage::hash_table(m_delta_bigrams);
+    usage += MemoryUsage::hash_table(m_delta_contexts);
+    return usage;
+}
+
+} // namespace pinyin_ime
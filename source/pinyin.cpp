@@ -1,8 +1,11 @@
 #include "pinyin.h"
+#include "stats.h"
+#include <mutex>
 
 namespace pinyin_ime {
 
 Trie PinYin::s_syllable_trie;
+std::shared_mutex PinYin::s_syllable_mutex;
 
 PinYin::PinYin()
 {
@@ -10,6 +13,12 @@ PinYin::PinYin()
     m_tokens.reserve(s_capacity);
 }
 
+PinYin::PinYin(std::pmr::memory_resource *scratch)
+    : PinYin{}
+{
+    m_scratch = scratch;
+}
+
 PinYin::PinYin(std::string str)
     : m_pinyin{ std::move(str) }
 {
@@ -124,13 +133,29 @@ const Trie& PinYin::syllableTrie() noexcept
     return s_syllable_trie;
 }
 
+MemoryUsage PinYin::syllable_trie_memory_usage()
+{
+    std::shared_lock lock{ s_syllable_mutex };
+    return s_syllable_trie.memory_usage();
+}
+
 void PinYin::add_syllable(std::string_view syllable)
 {
+    using MR = Trie::MatchResult;
+    {
+        // 加载词库时绝大多数音节已经存在，只需共享锁
+        std::shared_lock lock{ s_syllable_mutex };
+        auto result{ s_syllable_trie.match(syllable) };
+        if (result == MR::Complete || result == MR::Extendible)
+            return;
+    }
+    std::unique_lock lock{ s_syllable_mutex };
     s_syllable_trie.add_if_miss(syllable);
 }
 
 void PinYin::remove_syllable(std::string_view syllable) noexcept
 {
+    std::unique_lock lock{ s_syllable_mutex };
     s_syllable_trie.remove(syllable);
 }
 
@@ -147,8 +172,7 @@ PinYin::TokenSpan PinYin::backspace(size_t count)
     }
     if (count > free_letters)
         count = free_letters;
-    m_fixed_letters = m_pinyin.size() - count;
-    m_pinyin.erase(m_fixed_letters);
+    m_pinyin.erase(m_pinyin.size() - count);
     return update_tokens();
 }
 
@@ -185,11 +209,12 @@ void PinYin::clear() noexcept
     m_pinyin.clear();
 }
 
-std::vector<PinYin::TokenVec> PinYin::token_split_candidates() const
+std::pmr::vector<PinYin::ScratchTokenVec> PinYin::token_split_candidates(std::pmr::memory_resource *resource) const
 {
     using MR = Trie::MatchResult;
-    std::vector<TokenVec> candidates;
-    std::vector<TokenVec> pending_tasks;
+    std::shared_lock lock{ s_syllable_mutex };
+    std::pmr::vector<ScratchTokenVec> candidates{ resource };
+    std::pmr::vector<ScratchTokenVec> pending_tasks{ resource };
 
     pending_tasks.emplace_back();
     while (!pending_tasks.empty()) {
@@ -202,8 +227,9 @@ std::vector<PinYin::TokenVec> PinYin::token_split_candidates() const
         pending_tasks.pop_back();
         if (!list.empty()) {
             auto &last_token = list.back();
+            // offset 从 m_pinyin 开头计算，已包含固定的字母
             auto offset = last_token.m_token.data() - m_pinyin.data() + last_token.m_token.size();
-            cur_iter = start_iter = begin_iter = begin_iter + offset;
+            cur_iter = start_iter = begin_iter = m_pinyin.begin() + offset;
         }
         for (auto prev_type = TokenType::Invalid; cur_iter != end_iter;) {
             auto cur_end_iter = cur_iter + 1;
@@ -269,12 +295,16 @@ std::vector<PinYin::TokenVec> PinYin::token_split_candidates() const
 
 PinYin::TokenSpan PinYin::update_tokens()
 {
-    auto candidates{ token_split_candidates() };
+    Stats::ScopedStage stage{ Stats::Stage::Tokenize };
+    // 分割方案只在本函数内使用，先从栈上的缓冲区分配，不足时再从 m_scratch 分配
+    std::byte buffer[s_split_buffer_size];
+    std::pmr::monotonic_buffer_resource arena{ buffer, sizeof(buffer), m_scratch };
+    auto candidates{ token_split_candidates(&arena) };
     if (candidates.empty()) {
         m_tokens.erase(m_tokens.begin() + m_fixed_tokens, m_tokens.end());
         return m_tokens;
     }
-    auto token_invalid_count = [](const TokenVec& tokens)->size_t{
+    auto token_invalid_count = [](const ScratchTokenVec& tokens)->size_t{
         size_t count{ 0 };
         for (const auto &token : tokens) {
             if (token.m_type == TokenType::Invalid)
@@ -295,8 +325,8 @@ PinYin::TokenSpan PinYin::update_tokens()
             }
             continue;
         }
-        TokenVec &winner_vec = *(winner.first);
-        TokenVec &cand_vec = *iter;
+        ScratchTokenVec &winner_vec = *(winner.first);
+        ScratchTokenVec &cand_vec = *iter;
         size_t s = std::min(winner_vec.size(), cand_vec.size());
         for (size_t i = 0; i < s; ++i) {
             if (winner_vec[i].m_type != cand_vec[i].m_type) {
@@ -1,32 +1,42 @@
 #include "query.h"
+#include <algorithm>
 
 namespace pinyin_ime {
 
-Query::Query(BasicTrie<Dict> &dict_trie) noexcept
-    : m_dict_trie_ref{ dict_trie }
+Query::Query(const Dict *system_dict, const Dict *user_dict, std::shared_ptr<const void> owner) noexcept
+    : m_system_dict{ system_dict }, m_user_dict{ user_dict }, m_owner{ std::move(owner) }
 {}
 
-Query::Query(BasicTrie<Dict> &dict_trie, PinYin::TokenSpan tokens) noexcept
-    : m_dict_trie_ref{ dict_trie }, m_tokens{ tokens }
+Query::Query(const Dict *system_dict, const Dict *user_dict, PinYin::TokenSpan tokens,
+             std::shared_ptr<const void> owner) noexcept
+    : m_system_dict{ system_dict }, m_user_dict{ user_dict }, m_owner{ std::move(owner) }, m_tokens{ tokens }
 {
     exec(m_tokens);
 }
 
 Query::Query(Query&& other) noexcept
-    : m_dict_trie_ref{ other.m_dict_trie_ref },
-      m_dict{ other.m_dict },
+    : m_system_dict{ other.m_system_dict },
+      m_user_dict{ other.m_user_dict },
+      m_owner{ other.m_owner },
       m_tokens{ other.m_tokens },
-      m_items{ std::move(other.m_items) }
+      m_system_items{ std::move(other.m_system_items) },
+      m_user_items{ std::move(other.m_user_items) },
+      m_user_positions{ std::move(other.m_user_positions) },
+      m_prefix_complete{ other.m_prefix_complete }
 {
     other.clear();
 }
 
 Query& Query::operator=(Query &&other) noexcept
 {
-    m_dict_trie_ref = other.m_dict_trie_ref;
-    m_dict = other.m_dict;
+    m_system_dict = other.m_system_dict;
+    m_user_dict = other.m_user_dict;
+    m_owner = other.m_owner;
     m_tokens = other.m_tokens;
-    m_items = std::move(other.m_items);
+    m_system_items = std::move(other.m_system_items);
+    m_user_items = std::move(other.m_user_items);
+    m_user_positions = std::move(other.m_user_positions);
+    m_prefix_complete = other.m_prefix_complete;
     other.clear();
     return *this;
 }
@@ -35,61 +45,149 @@ bool Query::exec(PinYin::TokenSpan tokens) noexcept
 {
     try {
         m_tokens = tokens;
-        std::string acronym;
-        for (auto &token : tokens) {
-            if (!token.m_token.empty())
-                acronym.push_back(token.m_token.front());
-        }
-        m_dict = &(m_dict_trie_ref.get().data(acronym));
-        m_items = m_dict->search(tokens);
+        m_system_items.clear();
+        m_user_items.clear();
+        m_user_positions.clear();
+        m_prefix_complete = false;
+        if (!m_system_dict && !m_user_dict)
+            return false;
+
+        bool system_full{ false };
+        bool user_full{ false };
+        if (m_system_dict)
+            m_system_dict->search(tokens, m_system_items, system_full);
+        if (m_user_dict)
+            m_user_dict->search(tokens, m_user_items, user_full);
+        m_prefix_complete = !system_full && !user_full;
+        merge_layers(system_full, user_full, true);
         return true;
     } catch (const std::exception &e) {
-        m_dict = nullptr;
-        m_items.clear();
+        clear();
+        m_tokens = tokens;
         return false;
     }
 }
 
-bool Query::is_active() const noexcept
+bool Query::narrow(PinYin::TokenSpan tokens) noexcept
 {
-    return !m_tokens.empty();
+    if (!m_prefix_complete)
+        return exec(tokens);
+    try {
+        // 上次的结果均为开头匹配，已经移除了被覆盖的词条，分别筛选两层结果后再应用完全匹配优先的规则即可
+        bool system_full{ false };
+        bool user_full{ false };
+        DictSelection selection;
+        if (!m_system_items.empty()) {
+            m_system_dict->filter(m_system_items, tokens, selection, system_full);
+            std::swap(m_system_items, selection);
+        }
+        if (!m_user_items.empty()) {
+            m_user_dict->filter(m_user_items, tokens, selection, user_full);
+            std::swap(m_user_items, selection);
+        }
+        m_tokens = tokens;
+        m_prefix_complete = !system_full && !user_full;
+        merge_layers(system_full, user_full, false);
+        return true;
+    } catch (const std::exception &e) {
+        return exec(tokens);
+    }
 }
 
-PinYin::TokenSpan Query::tokens() const noexcept
+void Query::merge_layers(bool system_full, bool user_full, bool dedup)
 {
-    return m_tokens;
+    m_user_positions.clear();
+    if (m_user_items.empty())
+        return;
+    if (!m_system_items.empty() && system_full != user_full)
+        (system_full ? m_user_items : m_system_items).clear();
+    if (m_user_items.empty())
+        return;
+
+    auto user_item = [this](size_t rank) -> const DictItem& {
+        return (*m_user_dict)[m_user_items.index(rank)];
+    };
+    if (dedup && !m_system_items.empty()) {
+        // 用户词典中的词条覆盖系统词典中的同一词条
+        DictSelection kept;
+        kept.reset(m_system_dict->size());
+        m_system_items.for_each([&](size_t idx) {
+            auto &item{ (*m_system_dict)[idx] };
+            for (size_t rank{ 0 }; rank < m_user_items.size(); ++rank) {
+                if (user_item(rank).same_entry(item))
+                    return;
+            }
+            kept.push_back(idx);
+        });
+        m_system_items = std::move(kept);
+    }
+    // 与 std::merge 以用户词典结果为第一个序列相同：排序相等时用户词典的 DictItem 在前
+    m_user_positions.reserve(m_user_items.size());
+    size_t system_rank{ 0 };
+    for (size_t rank{ 0 }; rank < m_user_items.size(); ++rank) {
+        auto &item{ user_item(rank) };
+        size_t first{ system_rank };
+        size_t last{ m_system_items.size() };
+        while (first < last) {
+            auto mid{ first + (last - first) / 2 };
+            if ((*m_system_dict)[m_system_items.index(mid)] < item)
+                first = mid + 1;
+            else
+                last = mid;
+        }
+        system_rank = first;
+        m_user_positions.push_back(static_cast<uint32_t>(rank + system_rank));
+    }
+}
+
+void Query::rebind(PinYin::TokenSpan tokens) noexcept
+{
+    m_tokens = tokens;
 }
 
-Dict* Query::dict() const noexcept
+bool Query::is_prefix_complete() const noexcept
 {
-    return m_dict;
+    return m_prefix_complete;
 }
 
-const Dict::ItemCRefVec& Query::items() const noexcept
+bool Query::is_active() const noexcept
 {
-    return m_items;
+    return !m_tokens.empty();
+}
+
+PinYin::TokenSpan Query::tokens() const noexcept
+{
+    return m_tokens;
 }
 
 size_t Query::size() const noexcept
 {
-    return m_items.size();
+    return m_system_items.size() + m_user_items.size();
 }
 
 bool Query::empty() const noexcept
 {
-    return m_items.empty();
+    return m_system_items.empty() && m_user_items.empty();
 }
 
 const DictItem& Query::operator[](size_t idx) const noexcept
 {
-    return m_items[idx];
+    if (m_user_positions.empty())
+        return (*m_system_dict)[m_system_items.index(idx)];
+    auto it{ std::ranges::lower_bound(m_user_positions, idx) };
+    auto user_before{ static_cast<size_t>(it - m_user_positions.begin()) };
+    if (it != m_user_positions.end() && *it == idx)
+        return (*m_user_dict)[m_user_items.index(user_before)];
+    return (*m_system_dict)[m_system_items.index(idx - user_before)];
 }
 
 void Query::clear() noexcept
 {
-    m_dict = nullptr;
+    m_prefix_complete = false;
     m_tokens = {};
-    m_items.clear();
+    m_system_items.clear();
+    m_user_items.clear();
+    m_user_positions.clear();
 }
 
-} // namespace pinyin_ime
\ No newline at end of file
+} // namespace pinyin_ime
@@ -0,0 +1,193 @@
+#include "sentence_composer.h"
+#include "stats.h"
+#include "query.h"
+#include <algorithm>
+#include <cmath>
+
+namespace pinyin_ime {
+
+SentenceComposer::SentenceComposer(const BasicTrie<Dict> &system_trie, const BasicTrie<Dict> &user_trie) noexcept
+    : m_system_trie_ref{ system_trie }, m_user_trie_ref{ user_trie }
+{}
+
+void SentenceComposer::set_bigram_cost(BigramCost cost, size_t beam_width)
+{
+    m_bigram_cost = std::move(cost);
+    // 只有一元代价时，每个位置只需保留代价最小的路径和代价最小的边
+    m_beam_width = m_bigram_cost ? std::max<size_t>(beam_width, 1) : 1;
+    reset();
+}
+
+void SentenceComposer::rebind(const BasicTrie<Dict> &system_trie, const BasicTrie<Dict> &user_trie) noexcept
+{
+    m_system_trie_ref = system_trie;
+    m_user_trie_ref = user_trie;
+    reset();
+}
+
+void SentenceComposer::reset() noexcept
+{
+    m_columns.clear();
+    m_letters.clear();
+    m_tokens.clear();
+}
+
+void SentenceComposer::update_tokens(PinYin::TokenSpan tokens)
+{
+    size_t same_count{ 0 };
+    size_t common_count{ std::min(tokens.size(), m_tokens.size()) };
+    while (same_count < common_count
+           && tokens[same_count].m_type == m_tokens[same_count].m_type
+           && tokens[same_count].m_token == m_tokens[same_count].m_token)
+        ++same_count;
+
+    m_columns.resize(tokens.size());
+    for (size_t pos{ 0 }; pos < m_columns.size(); ++pos) {
+        auto &column{ m_columns[pos] };
+        size_t max_length{ pos < same_count ? same_count - pos : 0 };
+        if (column.m_built_length <= max_length)
+            continue;
+        std::erase_if(column.m_edges, [max_length](const Edge &edge) {
+            return edge.m_length > max_length;
+        });
+        column.m_built_length = max_length;
+    }
+
+    m_letters.clear();
+    for (auto &token : tokens)
+        m_letters += token.m_token;
+    m_tokens.clear();
+    size_t offset{ 0 };
+    for (auto &token : tokens) {
+        m_tokens.emplace_back(token.m_type, std::string_view{ m_letters.data() + offset, token.m_token.size() });
+        offset += token.m_token.size();
+    }
+}
+
+void SentenceComposer::build_edges(PinYin::TokenSpan tokens, size_t pos, size_t length)
+{
+    // 从 pos 开始、长度为 length 的 acronym 对应的两层 Dict
+    std::string acronym;
+    for (auto &token : tokens.subspan(pos, length))
+        acronym.push_back(token.m_token.empty() ? '\0' : token.m_token.front());
+    const Dict *dicts[2]{ nullptr, nullptr };
+    const BasicTrie<Dict> *tries[2]{ &m_system_trie_ref.get(), &m_user_trie_ref.get() };
+    for (size_t i{ 0 }; i < 2; ++i) {
+        tries[i]->common_prefix_search(acronym, [&](size_t size, const Dict &dict) {
+            if (size == length)
+                dicts[i] = &dict;
+        });
+    }
+
+    auto &column{ m_columns[pos] };
+    if (dicts[0] || dicts[1]) {
+        // 查询结果按频率从高到低排列，只有前 m_beam_width 个可能出现在结果中
+        Query query{ dicts[0], dicts[1], tokens.subspan(pos, length) };
+        for (size_t i{ 0 }; i < query.size() && i < m_beam_width; ++i) {
+            const DictItem &item{ query[i] };
+            column.m_edges.push_back({ length, &item, s_word_cost - std::log1p(static_cast<double>(item.freq())) });
+        }
+    }
+    if (length == 1 && column.m_edges.empty())
+        column.m_edges.push_back({ 1, nullptr, s_unknown_cost });
+    column.m_built_length = length;
+}
+
+SentenceComposer::Sentence SentenceComposer::compose(PinYin::TokenSpan tokens, std::chrono::microseconds budget)
+{
+    Stats::ScopedStage stage{ Stats::Stage::SentenceCompose };
+    using Clock = std::chrono::steady_clock;
+    auto deadline{ Clock::now() + budget };
+    update_tokens(tokens);
+    if (tokens.empty())
+        return {};
+
+    size_t count{ tokens.size() };
+    auto max_length = [count](size_t pos) {
+        return std::min(DictItem::s_max_syllables, count - pos);
+    };
+    // 单个 Token 的边保证整句结果存在，不受时间预算限制
+    for (size_t pos{ 0 }; pos < count; ++pos) {
+        if (m_columns[pos].m_built_length == 0)
+            build_edges(tokens, pos, 1);
+    }
+    bool truncated{ false };
+    for (size_t length{ 2 }; !truncated && length <= DictItem::s_max_syllables; ++length) {
+        for (size_t pos{ 0 }; pos < count; ++pos) {
+            auto &column{ m_columns[pos] };
+            if (column.m_built_length != length - 1 || length > max_length(pos))
+                continue;
+            if (Clock::now() >= deadline) {
+                truncated = true;
+                break;
+            }
+            build_edges(tokens, pos, length);
+        }
+    }
+
+    auto sentence{ search(tokens) };
+    for (size_t pos{ 0 }; pos < count; ++pos) {
+        if (m_columns[pos].m_built_length < max_length(pos))
+            sentence.m_truncated = true;
+    }
+    return sentence;
+}
+
+SentenceComposer::Sentence SentenceComposer::search(PinYin::TokenSpan tokens) const
+{
+    struct State {
+        double m_cost;
+        const Edge *m_edge;
+        size_t m_prev_pos;
+        size_t m_prev_state;
+    };
+    size_t count{ tokens.size() };
+    std::vector<std::vector<State>> states(count + 1);
+    states[0].push_back({ 0, nullptr, 0, 0 });
+    for (size_t pos{ 0 }; pos < count; ++pos) {
+        for (size_t s{ 0 }; s < states[pos].size(); ++s) {
+            const State &state{ states[pos][s] };
+            for (auto &edge : m_columns[pos].m_edges) {
+                double cost{ state.m_cost + edge.m_cost };
+                if (m_bigram_cost && state.m_edge && state.m_edge->m_item && edge.m_item)
+                    cost += m_bigram_cost(*state.m_edge->m_item, *edge.m_item);
+                // 每个位置保留代价最小的 m_beam_width 条路径
+                auto &next{ states[pos + edge.m_length] };
+                State new_state{ cost, &edge, pos, s };
+                if (next.size() < m_beam_width) {
+                    next.push_back(new_state);
+                    continue;
+                }
+                auto worst{ std::ranges::max_element(next, {}, &State::m_cost) };
+                if (cost < worst->m_cost)
+                    *worst = new_state;
+            }
+        }
+    }
+
+    Sentence sentence;
+    if (states[count].empty())
+        return sentence;
+    auto best{ std::ranges::min_element(states[count], {}, &State::m_cost) };
+    sentence.m_cost = best->m_cost;
+    size_t pos{ count };
+    size_t s{ static_cast<size_t>(best - states[count].begin()) };
+    while (pos != 0) {
+        const State &state{ states[pos][s] };
+        sentence.m_segments.push_back({ tokens.subspan(state.m_prev_pos, state.m_edge->m_length), state.m_edge->m_item });
+        pos = state.m_prev_pos;
+        s = state.m_prev_state;
+    }
+    std::reverse(sentence.m_segments.begin(), sentence.m_segments.end());
+    for (auto &segment : sentence.m_segments) {
+        if (segment.m_item) {
+            sentence.m_chinese += segment.m_item->chinese();
+            continue;
+        }
+        for (auto &token : segment.m_tokens)
+            sentence.m_chinese += token.m_token;
+    }
+    return sentence;
+}
+
+} // namespace pinyin_ime
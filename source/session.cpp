@@ -0,0 +1,302 @@
+#include "session.h"
+#include "stats.h"
+
+namespace pinyin_ime {
+
+Session::Session(std::shared_ptr<Engine> engine)
+    : m_engine{ engine ? std::move(engine) : throw std::invalid_argument{ "Engine is null" } },
+      m_snapshot{ m_engine->snapshot() },
+      m_pinyin{ &m_scratch },
+      m_composer{ *m_snapshot->m_system_trie, *m_snapshot->m_user_trie }
+{
+    bind_bigram_cost();
+}
+
+const std::shared_ptr<Engine>& Session::engine() const noexcept
+{
+    return m_engine;
+}
+
+void Session::refresh_snapshot() noexcept
+{
+    auto snapshot{ m_pinned_snapshot ? m_pinned_snapshot : m_engine->snapshot() };
+    if (snapshot == m_snapshot)
+        return;
+    bool ngram_changed{ !snapshot->m_ngram != !m_snapshot->m_ngram };
+    m_snapshot = std::move(snapshot);
+    m_composer.rebind(*m_snapshot->m_system_trie, *m_snapshot->m_user_trie);
+    if (ngram_changed && !m_bigram_cost)
+        bind_bigram_cost();
+}
+
+void Session::bind_bigram_cost()
+{
+    if (m_bigram_cost) {
+        m_composer.set_bigram_cost(m_bigram_cost, m_beam_width);
+    } else if (m_snapshot->m_ngram) {
+        // 通过 m_snapshot 访问语言模型，切换快照后无需重新设置
+        m_composer.set_bigram_cost([this](const DictItem &prev, const DictItem &next) {
+            return m_snapshot->m_ngram->bigram_cost(prev, next);
+        }, m_beam_width);
+    } else {
+        m_composer.set_bigram_cost({}, m_beam_width);
+    }
+}
+
+const Candidates& Session::candidates() const noexcept
+{
+    return m_candidates;
+}
+
+const Candidates& Session::search(std::string_view pinyin)
+{
+    std::string_view cur_pinyin{ m_pinyin.pinyin() };
+    if (!pinyin.starts_with(cur_pinyin)) {
+        if (cur_pinyin.starts_with(pinyin)) {
+            auto count = cur_pinyin.size() - pinyin.size();
+            if (count <= m_pinyin.unfixed_letters().size())
+                return backspace(count);
+        }
+        reset_search();
+        return push_back(pinyin);
+    } else if (pinyin.size() == cur_pinyin.size()) {
+        return m_candidates;
+    } else {
+        return push_back(std::string_view{ pinyin.begin() + cur_pinyin.size(), pinyin.end() });
+    }
+}
+
+const Candidates& Session::search_impl(PinYin::TokenSpan tokens)
+{
+    auto prefixes{ m_snapshot->prefix_dicts(tokens, &m_scratch) };
+    Stats::ScopedStage stage{ Stats::Stage::CandidatesAssembly };
+
+    // 与上次搜索的 Token 比较：前 same_count 个 Token 未改变，
+    // 若 extended 为 true，第 same_count + 1 个 Token 仅在尾部增加了字符
+    using TT = PinYin::TokenType;
+    size_t same_count{ 0 };
+    size_t common_count{ std::min(tokens.size(), m_searched_tokens.size()) };
+    while (same_count < common_count
+           && tokens[same_count].m_type == m_searched_tokens[same_count].m_type
+           && tokens[same_count].m_token == m_searched_tokens[same_count].m_token)
+        ++same_count;
+    bool extended{
+        same_count < common_count
+        && (m_searched_tokens[same_count].m_type == TT::Initial
+            || m_searched_tokens[same_count].m_type == TT::Extendible)
+        && tokens[same_count].m_token.starts_with(m_searched_tokens[same_count].m_token)
+    };
+
+    // 上次的 Query 以 Token 数量为索引
+    auto old_queries{ m_candidates.take() };
+    std::pmr::vector<Query*> old_by_count(std::max(tokens.size(), m_searched_tokens.size()) + 1, nullptr, &m_scratch);
+    for (auto &query : old_queries) {
+        if (query.tokens().size() < old_by_count.size())
+            old_by_count[query.tokens().size()] = &query;
+    }
+
+    // 较长的 TokenSpan 的结果优先，结果为空的 Query 同样保留，供下次搜索沿用
+    for (auto &[count, system_dict, user_dict] : prefixes) {
+        auto sub_tokens{ tokens.first(count) };
+        Query *old{ old_by_count[count] };
+        if (old && count <= same_count) {
+            old->rebind(sub_tokens);
+            m_candidates.push_back(std::move(*old));
+        } else if (old && extended && count == same_count + 1) {
+            old->narrow(sub_tokens);
+            m_candidates.push_back(std::move(*old));
+        } else {
+            m_candidates.push_back(Query{ system_dict, user_dict, sub_tokens, m_snapshot });
+        }
+    }
+
+    auto pinyin{ m_pinyin.pinyin() };
+    m_searched_letters.assign(pinyin);
+    m_searched_tokens.clear();
+    for (auto &token : tokens) {
+        size_t offset{ static_cast<size_t>(token.m_token.data() - pinyin.data()) };
+        m_searched_tokens.emplace_back(
+            token.m_type, std::string_view{ m_searched_letters.data() + offset, token.m_token.size() });
+    }
+    return m_candidates;
+}
+
+const Candidates& Session::push_back(std::string_view pinyin)
+{
+    // 空闲时开始新的输入，切换到最新的快照
+    if (m_pinyin.pinyin().empty() && m_choices.empty())
+        refresh_snapshot();
+    return search_impl(m_pinyin.push_back(pinyin));
+}
+
+const Candidates& Session::backspace(size_t count)
+{
+    return search_impl(m_pinyin.backspace(count));
+}
+
+void Session::finish_search(bool inc_freq, bool add_new_sentence)
+{
+    if (!m_choices.empty() && (inc_freq || add_new_sentence)) {
+        std::vector<DictItem> items;
+        items.reserve(m_choices.size());
+        for (auto &c : m_choices)
+            items.push_back(c.m_item);
+        m_engine->learn(items, inc_freq, add_new_sentence);
+    }
+    reset_search();
+}
+
+void Session::reset_search() noexcept
+{
+    m_searched_letters.clear();
+    m_searched_tokens.clear();
+    m_candidates.clear();
+    m_choices.clear();
+    m_pinyin.clear();
+    m_composer.reset();
+    // 临时对象都已释放，将临时内存归还，空闲的 Session 不占用内存
+    m_scratch.release();
+    refresh_snapshot();
+}
+
+void Session::pin_snapshot(std::shared_ptr<const Engine::Snapshot> snapshot) noexcept
+{
+    m_pinned_snapshot = std::move(snapshot);
+    reset_search();
+}
+
+const std::vector<Session::Choice>& Session::choices() const noexcept
+{
+    return m_choices;
+}
+
+PinYin::TokenSpan Session::tokens() const noexcept
+{
+    return m_pinyin.tokens();
+}
+
+PinYin::TokenSpan Session::fixed_tokens() const noexcept
+{
+    return m_pinyin.fixed_tokens();
+}
+
+PinYin::TokenSpan Session::unfixed_tokens() const noexcept
+{
+    return m_pinyin.unfixed_tokens();
+}
+
+std::string_view Session::pinyin() const noexcept
+{
+    return m_pinyin.pinyin();
+}
+
+std::string_view Session::fixed_letters() const noexcept
+{
+    return m_pinyin.fixed_letters();
+}
+
+std::string_view Session::unfixed_letters() const noexcept
+{
+    return m_pinyin.unfixed_letters();
+}
+
+const Candidates& Session::choose(size_t idx)
+{
+    using std::string_literals::operator""s;
+    try {
+        auto qi{ m_candidates.to_query_and_index(idx) };
+        Query &query{ qi.first.get() };
+        return choose_impl(query.tokens(), query[qi.second]);
+    } catch (const std::exception &e) {
+        std::throw_with_nested(
+            std::runtime_error{ "Choose candidate of index "s
+                + std::to_string(idx) + "failed" });
+    }
+}
+
+const Candidates& Session::choose(const CandidateStream::Entry &entry)
+{
+    try {
+        return choose_impl(entry.m_tokens, entry.m_item);
+    } catch (const std::exception &e) {
+        std::throw_with_nested(std::runtime_error{ "Choose candidate failed" });
+    }
+}
+
+const Candidates& Session::choose_impl(PinYin::TokenSpan tokens, const DictItem &item)
+{
+    size_t fix_count{ m_pinyin.fix_count_for_tokens(tokens) };
+    if (fix_count == 0)
+        throw std::logic_error{ "Tokens to fix is empty" };
+    // 固定 Token 后 tokens 可能失效，先保存 Choice
+    Choice choice{ tokens, item };
+    if (!m_pinyin.fix_front_tokens(fix_count))
+        throw std::logic_error{ "Fix tokens failed" };
+    m_choices.push_back(choice);
+    return search_impl(m_pinyin.unfixed_tokens());
+}
+
+const Candidates& Session::choose(const SentenceComposer::Sentence &sentence)
+{
+    try {
+        // 每个词都只固定 Token 而不重新搜索，最后搜索一次
+        bool fixed{ false };
+        for (auto &segment : sentence.m_segments) {
+            if (!segment.m_item)
+                break;
+            size_t fix_count{ m_pinyin.fix_count_for_tokens(segment.m_tokens) };
+            if (fix_count == 0)
+                throw std::logic_error{ "Tokens to fix is empty" };
+            Choice choice{ segment.m_tokens, *segment.m_item };
+            if (!m_pinyin.fix_front_tokens(fix_count))
+                throw std::logic_error{ "Fix tokens failed" };
+            m_choices.push_back(choice);
+            fixed = true;
+        }
+        return fixed ? search_impl(m_pinyin.unfixed_tokens()) : m_candidates;
+    } catch (const std::exception &e) {
+        std::throw_with_nested(std::runtime_error{ "Choose sentence failed" });
+    }
+}
+
+SentenceComposer::Sentence Session::compose_sentence(std::chrono::microseconds budget)
+{
+    return m_composer.compose(m_pinyin.unfixed_tokens(), budget);
+}
+
+void Session::set_bigram_cost(SentenceComposer::BigramCost cost, size_t beam_width)
+{
+    m_bigram_cost = std::move(cost);
+    m_beam_width = beam_width;
+    bind_bigram_cost();
+}
+
+CandidateStream Session::candidate_stream(CandidateStream::Scorer scorer) const
+{
+    CandidateStream stream{ std::move(scorer) };
+    auto tokens{ m_pinyin.unfixed_tokens() };
+    for (auto &[count, system_dict, user_dict] : m_snapshot->prefix_dicts(tokens))
+        stream.add_source(system_dict, user_dict, tokens.first(count), m_snapshot);
+    return stream;
+}
+
+Session::Choice::Choice(PinYin::TokenSpan tokens, const DictItem &item) noexcept
+    : m_tokens{ tokens }, m_item{ item }
+{}
+
+PinYin::TokenSpan Session::Choice::tokens() const noexcept
+{
+    return m_tokens;
+}
+
+std::string_view Session::Choice::chinese() const noexcept
+{
+    return m_item.chinese();
+}
+
+const DictItem& Session::Choice::item() const noexcept
+{
+    return m_item;
+}
+
+} // namespace pinyin_ime
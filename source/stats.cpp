@@ -0,0 +1,147 @@
+#include "stats.h"
+#include <atomic>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define PINYIN_IME_RDTSC() __rdtsc()
+#elif defined(_M_X64) || defined(_M_IX86)
+#  include <intrin.h>
+#  define PINYIN_IME_RDTSC() __rdtsc()
+#endif
+
+namespace pinyin_ime {
+
+namespace {
+
+constexpr std::string_view s_stage_names[Stats::s_stage_count]{
+    "tokenize", "acronym_lookup", "dict_search", "candidates_assembly", "sentence_compose"
+};
+constexpr std::string_view s_counter_names[Stats::s_counter_count]{
+    "items_scanned", "items_matched", "trie_nodes_visited", "allocations"
+};
+
+// 计数槽位：先是各计数器，然后每个阶段依次为调用次数、耗时、分配次数
+constexpr size_t s_stage_base{ Stats::s_counter_count };
+constexpr size_t s_slot_count{ s_stage_base + 3 * Stats::s_stage_count };
+constexpr size_t s_shard_count{ 16 };
+
+/**
+ * \brief 一个分片的所有计数槽位，独占缓存行。
+ */
+struct alignas(64) Shard {
+    std::atomic<uint64_t> m_slots[s_slot_count]{};
+};
+
+Shard s_shards[s_shard_count];
+std::atomic<size_t> s_next_shard{ 0 };
+thread_local size_t s_thread_shard{ s_next_shard.fetch_add(1, std::memory_order_relaxed) % s_shard_count };
+thread_local uint64_t s_thread_allocations{ 0 };
+
+uint64_t now_ticks() noexcept
+{
+#ifdef PINYIN_IME_RDTSC
+    return PINYIN_IME_RDTSC();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * \brief 程序启动时记录的 tick 与时钟，用于计算 tick 的频率。
+ */
+struct TickOrigin {
+    uint64_t m_ticks{ now_ticks() };
+    std::chrono::steady_clock::time_point m_time{ std::chrono::steady_clock::now() };
+};
+const TickOrigin s_origin;
+
+double ticks_per_second() noexcept
+{
+#ifdef PINYIN_IME_RDTSC
+    // 以启动以来的 TSC 增量与时钟增量之比估计频率，时间太短时等待至少 1ms 以保证精度
+    std::chrono::duration<double> elapsed;
+    uint64_t ticks;
+    do {
+        ticks = now_ticks();
+        elapsed = std::chrono::steady_clock::now() - s_origin.m_time;
+    } while (elapsed < std::chrono::milliseconds{ 1 });
+    return static_cast<double>(ticks - s_origin.m_ticks) / elapsed.count();
+#else
+    return 1e9;
+#endif
+}
+
+} // namespace
+
+std::string_view Stats::stage_name(Stage stage) noexcept
+{
+    return s_stage_names[static_cast<size_t>(stage)];
+}
+
+std::string_view Stats::counter_name(Counter counter) noexcept
+{
+    return s_counter_names[static_cast<size_t>(counter)];
+}
+
+void Stats::note_allocation() noexcept
+{
+#ifdef PINYIN_IME_STATS
+    ++s_thread_allocations;
+    add_slot(static_cast<size_t>(Counter::Allocations), 1);
+#endif
+}
+
+Stats::Snapshot Stats::snapshot() noexcept
+{
+    Snapshot result;
+    if constexpr (!s_enabled)
+        return result;
+    uint64_t slots[s_slot_count]{};
+    for (auto &shard : s_shards) {
+        for (size_t i{ 0 }; i < s_slot_count; ++i)
+            slots[i] += shard.m_slots[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i{ 0 }; i < s_counter_count; ++i)
+        result.m_counters[i] = slots[i];
+    for (size_t i{ 0 }; i < s_stage_count; ++i) {
+        auto slot{ slots + s_stage_base + 3 * i };
+        result.m_stages[i] = { slot[0], slot[1], slot[2] };
+    }
+    result.m_ticks_per_second = ticks_per_second();
+    return result;
+}
+
+void Stats::reset() noexcept
+{
+    for (auto &shard : s_shards) {
+        for (auto &slot : shard.m_slots)
+            slot.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Stats::ticks() noexcept
+{
+    return now_ticks();
+}
+
+uint64_t Stats::thread_allocations() noexcept
+{
+    return s_thread_allocations;
+}
+
+void Stats::add_slot(size_t slot, uint64_t value) noexcept
+{
+    s_shards[s_thread_shard].m_slots[slot].fetch_add(value, std::memory_order_relaxed);
+}
+
+void Stats::finish_stage(Stage stage, uint64_t ticks, uint64_t allocations) noexcept
+{
+    auto base{ s_stage_base + 3 * static_cast<size_t>(stage) };
+    add_slot(base, 1);
+    add_slot(base + 1, ticks);
+    if (allocations)
+        add_slot(base + 2, allocations);
+}
+
+} // namespace pinyin_ime
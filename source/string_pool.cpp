@@ -0,0 +1,253 @@
+#include "string_pool.h"
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+
+namespace pinyin_ime {
+
+std::array<const char*, StringPool::s_max_blocks> StringPool::s_blocks{};
+std::vector<std::unique_ptr<char[]>> StringPool::s_owned_blocks;
+std::shared_ptr<const void> StringPool::s_base_owner;
+std::span<const StringPool::Ref> StringPool::s_pending_refs;
+size_t StringPool::s_block_count{ 0 };
+size_t StringPool::s_block_used{ 0 };
+std::vector<StringPool::Ref> StringPool::s_index;
+size_t StringPool::s_index_count{ 0 };
+std::mutex StringPool::s_mutex;
+
+StringPool::Ref StringPool::intern(std::string_view str)
+{
+    std::lock_guard lock{ s_mutex };
+    return intern_locked(str);
+}
+
+void StringPool::intern(std::span<const std::string_view> strs, std::span<Ref> refs)
+{
+    if (strs.size() != refs.size())
+        throw std::logic_error{ "Size of strings and refs do not match" };
+    std::lock_guard lock{ s_mutex };
+    for (size_t i{ 0 }; i < strs.size(); ++i)
+        refs[i] = intern_locked(strs[i]);
+}
+
+StringPool::Ref StringPool::intern_locked(std::string_view str)
+{
+    if (str.empty())
+        return {};
+    if (str.size() > s_block_size)
+        throw std::length_error{ "String too long for pool" };
+    if (!s_pending_refs.empty()) {
+        auto refs{ s_pending_refs };
+        s_pending_refs = {};
+        for (auto &ref : refs)
+            index_ref(ref);
+    }
+    // 负载因子不超过 1/2
+    if ((s_index_count + 1) * 2 > s_index.size())
+        grow_index();
+
+    size_t mask{ s_index.size() - 1 };
+    size_t slot{ std::hash<std::string_view>{}(str) & mask };
+    for (; s_index[slot].m_size != 0; slot = (slot + 1) & mask) {
+        if (view(s_index[slot]) == str)
+            return s_index[slot];
+    }
+
+    if (s_block_count == 0 || s_block_used + str.size() > s_block_size) {
+        if (s_block_count == s_max_blocks)
+            throw std::length_error{ "String pool is full" };
+        s_owned_blocks.emplace_back(new char[s_block_size]);
+        s_blocks[s_block_count] = s_owned_blocks.back().get();
+        ++s_block_count;
+        s_block_used = 0;
+    }
+    char *block{ s_owned_blocks.back().get() };
+    std::memcpy(block + s_block_used, str.data(), str.size());
+    Ref ref{
+        static_cast<uint32_t>((s_block_count - 1) * s_block_size + s_block_used),
+        static_cast<uint32_t>(str.size())
+    };
+    s_block_used += str.size();
+    s_index[slot] = ref;
+    ++s_index_count;
+    return ref;
+}
+
+std::string_view StringPool::view(Ref ref) noexcept
+{
+    if (ref.m_size == 0)
+        return {};
+    return {
+        s_blocks[ref.m_offset / s_block_size] + ref.m_offset % s_block_size,
+        ref.m_size
+    };
+}
+
+size_t StringPool::size() noexcept
+{
+    std::lock_guard lock{ s_mutex };
+    if (s_block_count == 0)
+        return 0;
+    return (s_block_count - 1) * s_block_size + s_block_used;
+}
+
+MemoryUsage StringPool::memory_usage() noexcept
+{
+    std::lock_guard lock{ s_mutex };
+    MemoryUsage usage;
+    usage.m_nodes = s_block_count;
+    usage.m_items = s_index_count + s_pending_refs.size();
+    size_t owned{ s_owned_blocks.size() };
+    usage.m_mapped_bytes = (s_block_count - owned) * s_block_size;
+    // 新文本总是追加在最后一个块中，之前块尾部放不下的空间不再使用，计为已使用
+    if (owned != 0) {
+        usage.m_used_bytes = owned * s_block_size - (s_block_size - s_block_used);
+        usage.m_unused_bytes = s_block_size - s_block_used;
+    }
+    usage.m_used_bytes += s_index_count * sizeof(Ref);
+    usage.m_unused_bytes += (s_index.capacity() - s_index_count) * sizeof(Ref);
+    return usage;
+}
+
+bool StringPool::attach(std::span<const char> base, std::span<const Ref> refs,
+                        std::shared_ptr<const void> owner)
+{
+    std::lock_guard lock{ s_mutex };
+    if (s_block_count != 0 || s_index_count != 0)
+        return false;
+    size_t block_count{ (base.size() + s_block_size - 1) / s_block_size };
+    if (block_count > s_max_blocks)
+        return false;
+    for (size_t i{ 0 }; i < block_count; ++i)
+        s_blocks[i] = base.data() + i * s_block_size;
+    s_block_count = block_count;
+    // 外部内存只读，之后加入的文本总是存放在新块中
+    s_block_used = s_block_size;
+    s_base_owner = std::move(owner);
+    s_pending_refs = refs;
+    return true;
+}
+
+const std::unordered_map<uint32_t, StringPool::Ref>& StringPool::Compaction::moved() const noexcept
+{
+    return m_moved;
+}
+
+StringPool::Compaction StringPool::prepare_compact(const std::unordered_set<uint32_t> &live)
+{
+    std::lock_guard lock{ s_mutex };
+    if (!s_pending_refs.empty()) {
+        auto refs{ s_pending_refs };
+        s_pending_refs = {};
+        for (auto &ref : refs)
+            index_ref(ref);
+    }
+    Compaction compaction;
+    compaction.m_prepared_count = s_index_count;
+    size_t base_blocks{ s_block_count - s_owned_blocks.size() };
+    uint32_t base_end{ static_cast<uint32_t>(base_blocks * s_block_size) };
+    std::vector<Ref> base_refs;
+    std::vector<Ref> moved_refs;
+    bool base_used{ false };
+    for (auto &ref : s_index) {
+        if (ref.m_size == 0)
+            continue;
+        if (ref.m_offset < base_end) {
+            base_refs.push_back(ref);
+            base_used = base_used || live.contains(ref.m_offset);
+        } else if (live.contains(ref.m_offset)) {
+            moved_refs.push_back(ref);
+        }
+    }
+    if (!base_used) {
+        base_blocks = 0;
+        base_refs.clear();
+    }
+    // 按原偏移依次拷贝，文本的相对顺序不变
+    std::ranges::sort(moved_refs, {}, &Ref::m_offset);
+
+    // 在新的块与索引中构造，池本身不变；新位置的文本与原位置相同，按原位置计算哈希
+    auto &blocks{ compaction.m_blocks };
+    auto &index{ compaction.m_index };
+    size_t block_used{ s_block_size };
+    index.resize(1024);
+    while (base_refs.size() + moved_refs.size() > index.size() / 2)
+        index.resize(index.size() * 2);
+    auto insert_index{ [&](Ref ref, std::string_view str) {
+        size_t mask{ index.size() - 1 };
+        size_t slot{ std::hash<std::string_view>{}(str) & mask };
+        while (index[slot].m_size != 0)
+            slot = (slot + 1) & mask;
+        index[slot] = ref;
+    } };
+    for (auto &ref : base_refs)
+        insert_index(ref, view(ref));
+    compaction.m_moved.reserve(moved_refs.size());
+    for (auto &ref : moved_refs) {
+        if (block_used + ref.m_size > s_block_size) {
+            blocks.emplace_back(new char[s_block_size]);
+            block_used = 0;
+        }
+        std::memcpy(blocks.back().get() + block_used, view(ref).data(), ref.m_size);
+        Ref new_ref{
+            static_cast<uint32_t>((base_blocks + blocks.size() - 1) * s_block_size + block_used),
+            ref.m_size
+        };
+        block_used += ref.m_size;
+        insert_index(new_ref, view(ref));
+        compaction.m_moved.emplace(ref.m_offset, new_ref);
+    }
+    compaction.m_base_blocks = base_blocks;
+    compaction.m_block_used = block_used;
+    compaction.m_index_count = base_refs.size() + moved_refs.size();
+    return compaction;
+}
+
+void StringPool::commit_compact(Compaction &compaction) noexcept
+{
+    std::lock_guard lock{ s_mutex };
+    assert(s_pending_refs.empty() && s_index_count == compaction.m_prepared_count);
+    auto &blocks{ compaction.m_blocks };
+    size_t base_blocks{ compaction.m_base_blocks };
+    for (size_t i{ 0 }; i < blocks.size(); ++i)
+        s_blocks[base_blocks + i] = blocks[i].get();
+    for (size_t i{ base_blocks + blocks.size() }; i < s_block_count; ++i)
+        s_blocks[i] = nullptr;
+    s_block_count = base_blocks + blocks.size();
+    s_block_used = compaction.m_block_used;
+    // 原来的块交给 compaction，随其一起释放
+    s_owned_blocks.swap(blocks);
+    if (base_blocks == 0)
+        s_base_owner.reset();
+    s_index.swap(compaction.m_index);
+    s_index_count = compaction.m_index_count;
+}
+
+void StringPool::grow_index()
+{
+    std::vector<Ref> index(s_index.empty() ? 1024 : s_index.size() * 2);
+    std::swap(index, s_index);
+    s_index_count = 0;
+    for (auto &ref : index) {
+        if (ref.m_size != 0)
+            index_ref(ref);
+    }
+}
+
+void StringPool::index_ref(Ref ref)
+{
+    if ((s_index_count + 1) * 2 > s_index.size())
+        grow_index();
+    size_t mask{ s_index.size() - 1 };
+    size_t slot{ std::hash<std::string_view>{}(view(ref)) & mask };
+    for (; s_index[slot].m_size != 0; slot = (slot + 1) & mask) {
+        if (s_index[slot] == ref)
+            return;
+    }
+    s_index[slot] = ref;
+    ++s_index_count;
+}
+
+} // namespace pinyin_ime
@@ -0,0 +1,75 @@
+#include "syllable_table.h"
+#include <mutex>
+#include <stdexcept>
+
+namespace pinyin_ime {
+
+std::array<std::unique_ptr<std::string[]>, SyllableTable::s_max_chunks> SyllableTable::s_chunks;
+std::atomic<size_t> SyllableTable::s_size{ 0 };
+std::unordered_map<std::string_view, SyllableTable::Id> SyllableTable::s_ids;
+std::shared_mutex SyllableTable::s_mutex;
+
+SyllableTable::Id SyllableTable::intern(std::string_view syllable)
+{
+    if (syllable.empty())
+        throw std::logic_error{ "Syllable is empty" };
+    if (auto id{ find(syllable) }; id != s_invalid_id)
+        return id;
+
+    std::unique_lock lock{ s_mutex };
+    if (auto it{ s_ids.find(syllable) }; it != s_ids.end())
+        return it->second;
+    size_t size{ s_size.load(std::memory_order_relaxed) };
+    if (size >= s_invalid_id)
+        throw std::length_error{ "Syllable table is full" };
+    auto &chunk{ s_chunks[size / s_chunk_size] };
+    if (!chunk)
+        chunk.reset(new std::string[s_chunk_size]);
+    auto &stored{ chunk[size % s_chunk_size] };
+    stored = syllable;
+    Id id{ static_cast<Id>(size) };
+    s_ids.emplace(stored, id);
+    s_size.store(size + 1, std::memory_order_release);
+    return id;
+}
+
+SyllableTable::Id SyllableTable::find(std::string_view syllable) noexcept
+{
+    std::shared_lock lock{ s_mutex };
+    auto it{ s_ids.find(syllable) };
+    if (it == s_ids.end())
+        return s_invalid_id;
+    return it->second;
+}
+
+std::string_view SyllableTable::syllable(Id id) noexcept
+{
+    if (id >= s_size.load(std::memory_order_acquire))
+        return {};
+    return s_chunks[id / s_chunk_size][id % s_chunk_size];
+}
+
+size_t SyllableTable::size() noexcept
+{
+    return s_size.load(std::memory_order_acquire);
+}
+
+MemoryUsage SyllableTable::memory_usage() noexcept
+{
+    std::shared_lock lock{ s_mutex };
+    auto usage{ MemoryUsage::hash_table(s_ids) };
+    size_t size{ s_size.load(std::memory_order_relaxed) };
+    usage.m_nodes = (size + s_chunk_size - 1) / s_chunk_size;
+    usage.m_items = size;
+    usage.m_used_bytes += size * sizeof(std::string);
+    usage.m_unused_bytes += (s_chunk_size - size % s_chunk_size) % s_chunk_size * sizeof(std::string);
+    // 音节很短，通常存放在 std::string 的短字符串缓冲区中，只有超出时才分配堆内存
+    for (size_t i{ 0 }; i < size; ++i) {
+        auto &stored{ s_chunks[i / s_chunk_size][i % s_chunk_size] };
+        if (stored.capacity() > std::string{}.capacity())
+            usage.m_used_bytes += stored.capacity() + 1;
+    }
+    return usage;
+}
+
+} // namespace pinyin_ime
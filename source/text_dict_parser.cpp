@@ -0,0 +1,238 @@
+#include "text_dict_parser.h"
+#include "pinyin.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace pinyin_ime {
+
+namespace {
+
+/**
+ * \brief 一行文本的解析结果及其 acronym，视图指向原始文本。
+ */
+struct Record {
+    TextDictParser::Line m_line;
+    char m_acronym[DictItem::s_max_syllables];
+    uint8_t m_acronym_size;
+};
+
+/**
+ * \brief 使用 thread_count 个线程并行执行 f(0) ... f(count - 1)，
+ *        任一调用抛出异常时，在所有线程结束后重新抛出首个异常。
+ */
+template <class F>
+void parallel_for(size_t count, size_t thread_count, F f)
+{
+    std::atomic<size_t> next{ 0 };
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        try {
+            for (size_t i{ next++ }; i < count; i = next++)
+                f(i);
+        } catch (...) {
+            std::lock_guard lock{ error_mutex };
+            if (!error)
+                error = std::current_exception();
+            next = count;
+        }
+    };
+    thread_count = std::min(thread_count, count);
+    {
+        std::vector<std::jthread> threads;
+        for (size_t i{ 1 }; i < thread_count; ++i)
+            threads.emplace_back(worker);
+        worker();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+size_t acronym_partition(const char *acronym, size_t size, size_t partition_count) noexcept
+{
+    size_t h{ 14695981039346656037ull };
+    for (size_t i{ 0 }; i < size; ++i)
+        h = (h ^ static_cast<unsigned char>(acronym[i])) * 1099511628211ull;
+    return h % partition_count;
+}
+
+} // namespace
+
+TextDictParser::Line TextDictParser::parse_line(std::string_view line)
+{
+    Line result;
+    auto start{ std::string::npos };
+    auto end{ std::string::npos };
+
+    start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos)
+        throw std::invalid_argument{ "Line format wrong" };
+    end = line.find_first_of(" \t\r", start);
+    if (end == std::string::npos)
+        throw std::invalid_argument{ "Line format wrong" };
+    result.m_chinese = line.substr(start, end - start);
+
+    start = line.find_first_not_of(" \t\r", end);
+    if (start == std::string::npos)
+        throw std::invalid_argument{ "Line format wrong" };
+    end = line.find_first_of(" \t\r", start);
+    if (end == std::string::npos)
+        throw std::invalid_argument{ "Line format wrong" };
+    auto freq_first{ line.data() + start };
+    auto freq_last{ line.data() + end };
+    auto [ptr, ec] = std::from_chars(freq_first, freq_last, result.m_freq);
+    if (ec != std::errc{} || ptr != freq_last)
+        throw std::invalid_argument{ "Line format wrong" };
+
+    start = line.find_first_not_of(" \t\r", end);
+    if (start == std::string::npos)
+        throw std::invalid_argument{ "Line format wrong" };
+    end = line.find_first_of(" \t\r", start);
+    if (end == std::string::npos)
+        result.m_pinyin = line.substr(start);
+    else
+        result.m_pinyin = line.substr(start, end - start);
+    return result;
+}
+
+TextDictParser::Result TextDictParser::parse(std::span<const char> text, size_t thread_count, size_t head_size)
+{
+    std::string_view data{ text.data(), text.size() };
+    if (data.starts_with("\xef\xbb\xbf"))
+        data.remove_prefix(3);
+    if (data.empty())
+        return {};
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk_count{ std::clamp<size_t>(data.size() / s_min_chunk_size, 1, thread_count) };
+    size_t partition_count{ chunk_count * 4 };
+
+    // 1. 按行边界切分文本
+    std::vector<std::string_view> chunks;
+    for (size_t i{ 0 }, pos{ 0 }; i < chunk_count && pos < data.size(); ++i) {
+        size_t end{ data.size() };
+        if (i != chunk_count - 1) {
+            size_t target{ std::max(pos, data.size() / chunk_count * (i + 1)) };
+            end = data.find('\n', target);
+            end = (end == std::string_view::npos) ? data.size() : end + 1;
+        }
+        chunks.push_back(data.substr(pos, end - pos));
+        pos = end;
+    }
+
+    // 2. 并行解析各分块，按 acronym 分区
+    std::vector<std::vector<std::vector<Record>>> records(chunks.size());
+    std::atomic<size_t> skipped{ 0 };
+    parallel_for(chunks.size(), thread_count, [&](size_t c) {
+        auto &parts{ records[c] };
+        parts.resize(partition_count);
+        std::string_view chunk{ chunks[c] };
+        while (!chunk.empty()) {
+            auto line_end{ chunk.find('\n') };
+            auto line{ chunk.substr(0, line_end) };
+            chunk.remove_prefix(line_end == std::string_view::npos ? chunk.size() : line_end + 1);
+
+            Record record{ parse_line(line), {}, 0 };
+            std::string_view pinyin{ record.m_line.m_pinyin };
+            bool too_long{ false };
+            for (size_t pos{ 0 }; pos < pinyin.size() && !too_long; ++pos) {
+                if (pinyin[pos] == PinYin::s_delim || (pos != 0 && pinyin[pos - 1] != PinYin::s_delim))
+                    continue;
+                too_long = record.m_acronym_size == DictItem::s_max_syllables;
+                if (!too_long)
+                    record.m_acronym[record.m_acronym_size++] = pinyin[pos];
+            }
+            if (too_long) {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            auto p{ acronym_partition(record.m_acronym, record.m_acronym_size, partition_count) };
+            parts[p].push_back(record);
+        }
+    });
+
+    // 3. 并行构造各分区的 DictItem，排序后按 acronym 分组
+    std::vector<std::vector<Bucket>> partitions(partition_count);
+    parallel_for(partition_count, thread_count, [&](size_t p) {
+        std::vector<const Record*> selected;
+        for (auto &parts : records) {
+            for (auto &record : parts[p])
+                selected.push_back(&record);
+        }
+        if (selected.empty())
+            return;
+        if (head_size != s_all) {
+            // 只保留每个 acronym 中频率最高的 head_size 条记录，其余记录不构造 DictItem
+            std::sort(selected.begin(), selected.end(), [](const Record *lhs, const Record *rhs) {
+                std::string_view l{ lhs->m_acronym, lhs->m_acronym_size };
+                std::string_view r{ rhs->m_acronym, rhs->m_acronym_size };
+                if (l != r)
+                    return l < r;
+                return lhs->m_line.m_freq > rhs->m_line.m_freq;
+            });
+            size_t kept{ 0 };
+            std::string_view acronym;
+            std::erase_if(selected, [&](const Record *record) {
+                std::string_view a{ record->m_acronym, record->m_acronym_size };
+                if (a != acronym) {
+                    acronym = a;
+                    kept = 0;
+                }
+                return kept++ >= head_size;
+            });
+        }
+        size_t count{ selected.size() };
+        std::vector<std::string_view> chinese;
+        std::vector<StringPool::Ref> refs(count);
+        chinese.reserve(count);
+        for (auto record : selected)
+            chinese.push_back(record->m_line.m_chinese);
+        StringPool::intern(chinese, refs);
+
+        std::unordered_map<std::string_view, SyllableTable::Id> syllable_ids;
+        std::vector<DictItem> items;
+        items.reserve(count);
+        for (size_t i{ 0 }; i < count; ++i) {
+            DictItem::SyllableId ids[DictItem::s_max_syllables];
+            size_t id_count{ 0 };
+            std::string_view pinyin{ selected[i]->m_line.m_pinyin };
+            while (!pinyin.empty()) {
+                auto pos{ pinyin.find(PinYin::s_delim) };
+                auto s{ pinyin.substr(0, pos) };
+                pinyin.remove_prefix(pos == std::string_view::npos ? pinyin.size() : pos + 1);
+                if (s.empty())
+                    continue;
+                auto [iter, inserted] = syllable_ids.try_emplace(s);
+                if (inserted)
+                    iter->second = SyllableTable::intern(s);
+                ids[id_count++] = iter->second;
+            }
+            items.emplace_back(refs[i], std::span{ ids, id_count }, selected[i]->m_line.m_freq);
+        }
+        std::sort(items.begin(), items.end());
+
+        auto &buckets{ partitions[p] };
+        for (auto begin{ items.begin() }; begin != items.end();) {
+            // 已排序的 DictItem 按 acronym 连续分布，每组只构造一次 acronym 字符串
+            auto end{ std::find_if(begin + 1, items.end(), [&begin](const DictItem &item) {
+                return !item.same_acronym(*begin);
+            }) };
+            buckets.push_back({ begin->acronym(), std::vector<DictItem>(begin, end) });
+            begin = end;
+        }
+    });
+
+    Result result;
+    for (auto &buckets : partitions) {
+        std::move(buckets.begin(), buckets.end(), std::back_inserter(result.m_buckets));
+    }
+    result.m_skipped = skipped.load(std::memory_order_relaxed);
+    return result;
+}
+
+} // namespace pinyin_ime
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include "batch_converter.h"
+#include "print_exception.h"
+
+namespace {
+
+// 每次从标准输入读取并转换的行数
+constexpr size_t s_block_lines{ 1 << 16 };
+
+void print_usage(const char *name)
+{
+    std::cerr << "Usage: " << name
+              << " [-t <thread count>] [-n <top n>] [-g <ngram model>] [-s] <dict>\n"
+              << "    Reads one pinyin per line from stdin, writes the conversions separated by tabs to stdout.\n"
+              << "    -s  print throughput to stderr" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    using namespace pinyin_ime;
+
+    size_t thread_count{ 0 };
+    size_t top_n{ 1 };
+    std::string ngram_file;
+    bool stats{ false };
+    int i{ 1 };
+    try {
+        for (; i < argc && argv[i][0] == '-'; ++i) {
+            std::string_view option{ argv[i] };
+            if (option == "-s")
+                stats = true;
+            else if (option == "-t" && i + 1 < argc)
+                thread_count = std::stoul(argv[++i]);
+            else if (option == "-n" && i + 1 < argc)
+                top_n = std::stoul(argv[++i]);
+            else if (option == "-g" && i + 1 < argc)
+                ngram_file = argv[++i];
+            else
+                throw std::invalid_argument{ "Unknown option" };
+        }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (argc - i != 1) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    try {
+        auto engine{ std::make_shared<Engine>() };
+        try {
+            engine->load(argv[i]);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Load dict failed" });
+        }
+        if (!ngram_file.empty()) {
+            try {
+                engine->load_ngram(ngram_file);
+            } catch (const std::exception &e) {
+                std::throw_with_nested(std::runtime_error{ "Load ngram model failed" });
+            }
+        }
+
+        std::ios::sync_with_stdio(false);
+        BatchConverter converter{ engine, thread_count };
+        std::vector<std::string> lines;
+        std::vector<std::string_view> pinyins;
+        size_t total{ 0 };
+        std::chrono::steady_clock::duration elapsed{};
+        while (std::cin) {
+            lines.clear();
+            std::string line;
+            while (lines.size() < s_block_lines && std::getline(std::cin, line)) {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                lines.push_back(std::move(line));
+            }
+            if (lines.empty())
+                break;
+            pinyins.assign(lines.begin(), lines.end());
+
+            auto start{ std::chrono::steady_clock::now() };
+            auto results{ converter.convert(pinyins, top_n) };
+            elapsed += std::chrono::steady_clock::now() - start;
+            total += lines.size();
+
+            for (auto &result : results) {
+                for (size_t r{ 0 }; r < result.size(); ++r) {
+                    if (r != 0)
+                        std::cout << '\t';
+                    std::cout << result[r];
+                }
+                std::cout << '\n';
+            }
+        }
+        std::cout.flush();
+        if (std::cin.bad() || !std::cout)
+            throw std::runtime_error{ "Read or write failed" };
+
+        if (stats) {
+            double seconds{ std::chrono::duration<double>(elapsed).count() };
+            std::cerr << std::fixed << std::setprecision(1)
+                      << "threads: " << converter.thread_count()
+                      << ", lines: " << total
+                      << ", " << (seconds > 0 ? total / seconds : 0.0) << " lines/s" << std::endl;
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        print_exception(e);
+        return 1;
+    }
+}
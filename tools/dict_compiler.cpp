@@ -0,0 +1,30 @@
+#include <iostream>
+#include "ime.h"
+#include "print_exception.h"
+
+int main(int argc, char *argv[])
+{
+    using namespace pinyin_ime;
+
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <text dict> <compiled dict>" << std::endl;
+        return 2;
+    }
+    try {
+        IME ime;
+        try {
+            ime.load(argv[1]);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Load dict failed" });
+        }
+        try {
+            ime.save_compiled(argv[2]);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Save compiled dict failed" });
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        print_exception(e);
+        return 1;
+    }
+}
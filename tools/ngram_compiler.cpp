@@ -0,0 +1,53 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "ime.h"
+#include "print_exception.h"
+
+int main(int argc, char *argv[])
+{
+    using namespace pinyin_ime;
+
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <segmented corpus> <ngram model>" << std::endl;
+        return 2;
+    }
+    try {
+        // 语料每行为一个句子，词之间以空白字符分隔
+        NGramCounts counts;
+        try {
+            std::ifstream in{ argv[1] };
+            if (!in)
+                throw std::runtime_error{ "Open file failed" };
+            std::string line;
+            std::vector<std::string_view> words;
+            while (std::getline(in, line)) {
+                words.clear();
+                std::string_view rest{ line };
+                while (!rest.empty()) {
+                    auto begin{ rest.find_first_not_of(" \t\r") };
+                    if (begin == std::string_view::npos)
+                        break;
+                    rest.remove_prefix(begin);
+                    auto end{ std::min(rest.find_first_of(" \t\r"), rest.size()) };
+                    words.push_back(rest.substr(0, end));
+                    rest.remove_prefix(end);
+                }
+                counts.add_sentence(words);
+            }
+            if (in.bad())
+                throw std::runtime_error{ "Read file failed" };
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Load corpus failed" });
+        }
+        try {
+            NGramModel::write(counts, argv[2]);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Save ngram model failed" });
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        print_exception(e);
+        return 1;
+    }
+}
@@ -0,0 +1,338 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include "ime.h"
+#include "text_dict_parser.h"
+#include "print_exception.h"
+
+namespace {
+
+using namespace pinyin_ime;
+using Clock = std::chrono::steady_clock;
+using Event = KeystrokeTrace::Event;
+using ET = KeystrokeTrace::EventType;
+
+// 按拼音长度统计时，超过此长度的归入最后一组
+constexpr size_t s_max_length{ 32 };
+
+void print_usage(const char *name)
+{
+    std::cerr << "Usage: " << name
+              << " [-t <threads>] [-s <sessions>] [-S <seed>] [-l] [-m] [-w <trace output>] <dict> [trace...]\n"
+              << "    Replays the traces against one shared engine, thread i replays trace i % count.\n"
+              << "    Without traces, each thread replays sessions synthesized from the frequencies in\n"
+              << "    <dict>, which must then be a text dict.\n"
+              << "    -s  sessions synthesized per thread (default 1000)\n"
+              << "    -l  learn on finish_search in synthesized sessions\n"
+              << "    -m  report memory usage after loading and after replay\n"
+              << "    -w  write the sessions synthesized for thread 0 to a trace file" << std::endl;
+}
+
+/**
+ * \brief 按文本词库中的频率抽取词语，合成逐键输入的轨迹。
+ */
+class Synthesizer {
+public:
+    explicit Synthesizer(const std::string &dict_file)
+    {
+        std::ifstream in{ dict_file };
+        if (!in)
+            throw std::runtime_error{ "Open file failed" };
+        std::vector<double> weights;
+        std::string line;
+        while (std::getline(in, line)) {
+            auto parsed{ TextDictParser::parse_line(line) };
+            std::string letters;
+            for (char ch : parsed.m_pinyin) {
+                if (ch != PinYin::s_delim)
+                    letters += ch;
+            }
+            m_words.push_back(std::move(letters));
+            weights.push_back(parsed.m_freq);
+        }
+        if (in.bad())
+            throw std::runtime_error{ "Read file failed" };
+        if (m_words.empty())
+            throw std::invalid_argument{ "Dict is empty" };
+        m_distribution = std::discrete_distribution<size_t>{ weights.begin(), weights.end() };
+    }
+
+    /**
+     * \brief 合成 session_count 次输入：每次输入 1 至 4 个词的拼音，偶尔输错后退格，
+     *        每个词选择一次候选词（多数为首个），最后结束搜索。
+     */
+    std::vector<Event> synthesize(size_t session_count, uint32_t seed, bool learn)
+    {
+        std::mt19937 rng{ seed };
+        std::geometric_distribution<size_t> extra_words{ 0.5 };
+        std::bernoulli_distribution typo{ 0.03 };
+        std::discrete_distribution<size_t> choice{ 80, 10, 5, 3, 2 };
+        std::uniform_int_distribution<int> letter{ 'a', 'z' };
+
+        std::vector<Event> events;
+        for (size_t s{ 0 }; s < session_count; ++s) {
+            size_t word_count{ 1 + std::min<size_t>(extra_words(rng), 3) };
+            for (size_t w{ 0 }; w < word_count; ++w) {
+                for (char ch : m_words[m_distribution(rng)]) {
+                    if (typo(rng)) {
+                        events.push_back({ ET::PushBack, std::string(1, static_cast<char>(letter(rng))) });
+                        events.push_back({ ET::Backspace, {}, 1 });
+                    }
+                    events.push_back({ ET::PushBack, std::string(1, ch) });
+                }
+            }
+            for (size_t w{ 0 }; w < word_count; ++w)
+                events.push_back({ ET::Choose, {}, choice(rng) });
+            events.push_back({ ET::FinishSearch, {},
+                               learn ? KeystrokeTrace::s_inc_freq | KeystrokeTrace::s_add_new_sentence : 0 });
+        }
+        return events;
+    }
+private:
+    std::vector<std::string> m_words;
+    std::discrete_distribution<size_t> m_distribution;
+};
+
+/**
+ * \brief 一个线程回放得到的延迟（纳秒），按操作类型以及按操作后的拼音长度分组。
+ */
+struct Latencies {
+    std::array<std::vector<int64_t>, KeystrokeTrace::s_event_type_count> m_by_type;
+    std::array<std::vector<int64_t>, s_max_length + 1> m_by_length;
+    size_t m_skipped{ 0 };
+};
+
+/**
+ * \brief 以 ime 回放 events。没有可选择的候选词时跳过 choose 事件，索引超出范围时选择最后一个候选词，
+ *        使合成的或在不同词库上记录的轨迹也能回放。
+ */
+void replay(IME &ime, const std::vector<Event> &events, Latencies &latencies)
+{
+    for (auto &event : events) {
+        if (event.m_type == ET::Choose && (ime.candidates().empty() || ime.unfixed_tokens().empty())) {
+            ++latencies.m_skipped;
+            continue;
+        }
+        auto start{ Clock::now() };
+        switch (event.m_type) {
+        case ET::PushBack:
+            ime.push_back(event.m_letters);
+            break;
+        case ET::Backspace:
+            ime.backspace(event.m_value);
+            break;
+        case ET::Choose:
+            ime.choose(std::min(event.m_value, ime.candidates().size() - 1));
+            break;
+        case ET::ChooseSentence:
+            ime.choose(ime.compose_sentence());
+            break;
+        case ET::FinishSearch:
+            ime.finish_search(event.m_value & KeystrokeTrace::s_inc_freq,
+                              event.m_value & KeystrokeTrace::s_add_new_sentence);
+            break;
+        case ET::Reset:
+            ime.reset_search();
+            break;
+        }
+        auto elapsed{ std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() };
+        latencies.m_by_type[static_cast<size_t>(event.m_type)].push_back(elapsed);
+        if (event.m_type == ET::PushBack || event.m_type == ET::Backspace)
+            latencies.m_by_length[std::min(ime.pinyin().size(), s_max_length)].push_back(elapsed);
+    }
+}
+
+void print_row(std::string_view label, std::vector<int64_t> &samples)
+{
+    if (samples.empty())
+        return;
+    std::sort(samples.begin(), samples.end());
+    auto percentile{ [&](double p) {
+        return static_cast<double>(samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]) / 1000.0;
+    } };
+    std::cout << std::left << std::setw(16) << label << std::right << std::setw(10) << samples.size()
+              << std::fixed << std::setprecision(1)
+              << std::setw(10) << percentile(0.5) << std::setw(10) << percentile(0.9)
+              << std::setw(10) << percentile(0.99) << std::setw(10) << percentile(0.999)
+              << std::setw(12) << static_cast<double>(samples.back()) / 1000.0 << '\n';
+}
+
+void print_header(std::string_view label)
+{
+    std::cout << std::left << std::setw(16) << label << std::right << std::setw(10) << "count"
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(12) << "max (us)" << '\n';
+}
+
+void print_stats(const Stats::Snapshot &stats)
+{
+    double us_per_tick{ 1e6 / stats.m_ticks_per_second };
+    std::cout << "\nstages:\n" << std::left << std::setw(22) << "stage" << std::right
+              << std::setw(12) << "calls" << std::setw(14) << "total (ms)" << std::setw(12) << "mean (us)"
+              << std::setw(14) << "allocs/call" << '\n';
+    for (size_t k{ 0 }; k < Stats::s_stage_count; ++k) {
+        auto &stage{ stats.m_stages[k] };
+        double calls{ static_cast<double>(std::max<uint64_t>(stage.m_calls, 1)) };
+        std::cout << std::left << std::setw(22) << Stats::stage_name(static_cast<Stats::Stage>(k)) << std::right
+                  << std::setw(12) << stage.m_calls << std::fixed << std::setprecision(1)
+                  << std::setw(14) << stage.m_ticks * us_per_tick / 1000.0
+                  << std::setprecision(2) << std::setw(12) << stage.m_ticks * us_per_tick / calls
+                  << std::setw(14) << stage.m_allocations / calls << '\n';
+    }
+    std::cout << "\ncounters:\n";
+    for (size_t k{ 0 }; k < Stats::s_counter_count; ++k)
+        std::cout << std::left << std::setw(22) << Stats::counter_name(static_cast<Stats::Counter>(k))
+                  << std::right << std::setw(16) << stats.m_counters[k] << '\n';
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t thread_count{ 1 };
+    size_t session_count{ 1000 };
+    uint32_t seed{ 1 };
+    bool learn{ false };
+    bool memory{ false };
+    std::string output_file;
+    int i{ 1 };
+    try {
+        for (; i < argc && argv[i][0] == '-'; ++i) {
+            std::string_view option{ argv[i] };
+            if (option == "-l")
+                learn = true;
+            else if (option == "-m")
+                memory = true;
+            else if (option == "-t" && i + 1 < argc)
+                thread_count = std::stoul(argv[++i]);
+            else if (option == "-s" && i + 1 < argc)
+                session_count = std::stoul(argv[++i]);
+            else if (option == "-S" && i + 1 < argc)
+                seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (option == "-w" && i + 1 < argc)
+                output_file = argv[++i];
+            else
+                throw std::invalid_argument{ "Unknown option" };
+        }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (argc - i < 1 || thread_count == 0) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    std::string dict_file{ argv[i] };
+    std::vector<std::string> trace_files(argv + i + 1, argv + argc);
+
+    try {
+        auto engine{ std::make_shared<Engine>() };
+        try {
+            engine->load(dict_file);
+        } catch (const std::exception &e) {
+            std::throw_with_nested(std::runtime_error{ "Load dict failed" });
+        }
+
+        std::vector<std::vector<Event>> traces;
+        if (trace_files.empty()) {
+            try {
+                Synthesizer synthesizer{ dict_file };
+                for (size_t t{ 0 }; t < thread_count; ++t)
+                    traces.push_back(synthesizer.synthesize(session_count, seed + static_cast<uint32_t>(t), learn));
+            } catch (const std::exception &e) {
+                std::throw_with_nested(std::runtime_error{ "Synthesize trace failed" });
+            }
+            if (!output_file.empty()) {
+                try {
+                    KeystrokeTrace trace{ output_file };
+                    for (auto &event : traces.front())
+                        trace.record(event);
+                    trace.flush();
+                } catch (const std::exception &e) {
+                    std::throw_with_nested(std::runtime_error{ "Write trace failed" });
+                }
+            }
+        } else {
+            for (auto &file : trace_files) {
+                try {
+                    traces.push_back(KeystrokeTrace::read(file));
+                } catch (const std::exception &e) {
+                    std::throw_with_nested(std::runtime_error{ "Read trace " + file + " failed" });
+                }
+            }
+        }
+
+        std::optional<MemoryReport> loaded_memory;
+        if (memory)
+            loaded_memory = engine->memory_usage();
+
+        // 所有线程共享同一个 Engine，各自使用一个 IME
+        Engine::reset_stats();
+        std::vector<Latencies> latencies(thread_count);
+        std::vector<std::exception_ptr> errors(thread_count);
+        auto start{ Clock::now() };
+        {
+            std::vector<std::jthread> threads;
+            for (size_t t{ 0 }; t < thread_count; ++t) {
+                threads.emplace_back([&, t] {
+                    try {
+                        IME ime{ engine };
+                        replay(ime, traces[t % traces.size()], latencies[t]);
+                    } catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+        }
+        auto wall{ std::chrono::duration<double>(Clock::now() - start).count() };
+        auto stats{ Engine::stats() };
+        for (auto &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        Latencies all;
+        for (auto &l : latencies) {
+            for (size_t k{ 0 }; k < l.m_by_type.size(); ++k)
+                all.m_by_type[k].insert(all.m_by_type[k].end(), l.m_by_type[k].begin(), l.m_by_type[k].end());
+            for (size_t k{ 0 }; k < l.m_by_length.size(); ++k)
+                all.m_by_length[k].insert(all.m_by_length[k].end(), l.m_by_length[k].begin(), l.m_by_length[k].end());
+            all.m_skipped += l.m_skipped;
+        }
+        size_t total{ 0 };
+        for (auto &samples : all.m_by_type)
+            total += samples.size();
+
+        std::cout << "threads: " << thread_count << ", events: " << total << ", skipped: " << all.m_skipped
+                  << ", " << std::fixed << std::setprecision(1) << total / wall << " events/s\n\n";
+        print_header("operation");
+        for (size_t k{ 0 }; k < all.m_by_type.size(); ++k)
+            print_row(KeystrokeTrace::type_name(static_cast<ET>(k)), all.m_by_type[k]);
+        std::cout << "\npush_back and backspace by pinyin length:\n";
+        print_header("length");
+        for (size_t k{ 0 }; k < all.m_by_length.size(); ++k)
+            print_row(k == s_max_length ? ">=" + std::to_string(k) : std::to_string(k), all.m_by_length[k]);
+        if (Stats::s_enabled)
+            print_stats(stats);
+        if (memory) {
+            engine->flush();
+            std::cout << "\nmemory after loading:\n";
+            loaded_memory->write(std::cout);
+            std::cout << "\nmemory after replay:\n";
+            engine->memory_usage().write(std::cout);
+        }
+        std::cout.flush();
+        return 0;
+    } catch (const std::exception &e) {
+        print_exception(e);
+        return 1;
+    }
+}